@@ -16,6 +16,12 @@ enum bdmcf_commands {
 	CMD_BDMCF_WR_MEM_B = 0x1800,
 	CMD_BDMCF_WR_MEM_W = 0x1840,
 	CMD_BDMCF_WR_MEM_L = 0x1880,
+	CMD_BDMCF_DUMP_B = 0x1d00,
+	CMD_BDMCF_DUMP_W = 0x1d40,
+	CMD_BDMCF_DUMP_L = 0x1d80,
+	CMD_BDMCF_FILL_B = 0x1c00,
+	CMD_BDMCF_FILL_W = 0x1c40,
+	CMD_BDMCF_FILL_L = 0x1c80,
 };
 
 #endif /* bdm_defs_hh */
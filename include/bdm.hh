@@ -3,11 +3,37 @@
 
 #include "coldfire.hh"
 #include "bdm-defs.hh"
+#include "driver-core.hh"
+#include "pool.hh"
 #include <cstdint>
+#include <functional>
+#include <future>
 
-class driver;
+struct cf_cpu;
 
-static constexpr int max_bdm_buff = 2048;
+/*
+ * Memory access of a batch, size is 1, 2 or 4.
+ */
+struct mem_access {
+	uint32_t addr;
+	int size;
+	uint32_t value;
+};
+
+/*
+ * Reply of a queued command, status is an xfer_result, the value is
+ * only meaningful with xr_ok.
+ */
+struct bdm_reply {
+	int status;
+	uint32_t value;
+};
+
+/* longs read per batch by read_block */
+static constexpr int max_dump_batch = 256;
+/* verified loads, bytes compared and written again at once */
+static constexpr uint32_t verify_chunk = 0x400;
+static constexpr int verify_retries = 3;
 
 /*
  * BDM registers
@@ -15,6 +41,12 @@ static constexpr int max_bdm_buff = 2048;
 enum bdm_cf26_registers {
 	BDM_REG_CSR = 0x00,
 	BDM_REG_XCSR = 0x01,
+	BDM_REG_AATR = 0x06,
+	BDM_REG_TDR = 0x07,
+	BDM_REG_PBR = 0x08,
+	BDM_REG_PBMR = 0x09,
+	BDM_REG_ABHR = 0x0c,
+	BDM_REG_ABLR = 0x0d,
 };
 
 constexpr int CSR_SSM = (1 << 4);
@@ -25,6 +57,30 @@ constexpr int CSR_MAP = (1 << 15);
 constexpr int CSR_BPKT = (1 << 24);
 constexpr int CSR_HALT = (1 << 25);
 constexpr int CSR_TRG = (1 << 26);
+/* CSR[31:28], breakpoint status, not cleared by CSR reads */
+constexpr int CSR_BSTAT_SHIFT = 28;
+constexpr int CSR_BSTAT_L1_WAIT = 0x1;
+constexpr int CSR_BSTAT_L1_HIT = 0x2;
+
+/* TDR, trigger definition */
+constexpr int TDR_L1EPC = (1 << 1);
+constexpr int TDR_L1EAR = (1 << 4);
+constexpr int TDR_L1EBL = (1 << 13);
+constexpr int TDR_TRC_HALT = (1 << 30);
+
+/* AATR, address attribute trigger, size, type and mode ignored */
+constexpr int AATR_R = (1 << 7);
+constexpr int AATR_IGNORE = (3 << 13) | (3 << 11) | (7 << 8);
+constexpr int AATR_RM = (1 << 15);
+
+enum watch_type {
+	wt_write,
+	wt_read,
+	wt_access,
+};
+
+/* Opcodes used by step over / step out decoding */
+constexpr uint16_t OP_RTS = 0x4e75;
 
 /* Control reg types */
 enum  cr_type {
@@ -58,9 +114,26 @@ public:
 	bdm_ops(driver *current_driver);
 
 	void reset(bool state);
+	uint32_t reset_target();
+	uint32_t poll_csr(uint32_t mask, int timeout_ms);
+	int sense_state(uint32_t csr);
+	int get_state() { return state; }
+	/* csr of the last stop seen by poll_halted, status bits kept */
+	uint32_t get_stop_csr() { return stop_csr; }
 	void go();
 	void halt();
 	uint32_t step();
+	uint32_t next(const std::function<bool()> &cancel);
+	uint32_t run_to(uint32_t address, const std::function<bool()> &cancel);
+	bool poll_halted();
+	int wait_halted(const std::function<bool()> &cancel);
+	int set_pc_breakpoint(uint32_t address);
+	void clear_pc_breakpoint();
+	int set_watchpoint(uint32_t address, uint32_t size, int type);
+	void clear_watchpoint();
+	void clear_breakpoints();
+	int read_all_regs(uint32_t *regs);
+	/* writes return the xfer_result of the command */
 	uint32_t read_dm_reg(uint8_t reg);
 	uint32_t write_dm_reg(uint8_t reg, uint32_t value);
 	uint32_t read_ad_reg(uint8_t reg);
@@ -71,14 +144,59 @@ public:
 	uint32_t write_mem_byte(uint32_t address, uint8_t value);
 	uint32_t write_mem_word(uint32_t address, uint16_t value);
 	uint32_t write_mem_long(uint32_t address, uint32_t value);
+	int read_mem_batch(mem_access *acc, int count);
+
+	/*
+	 * Asynchronous operations, the driver status with the raw 32 bit
+	 * reply of the sync ones. Independent operations are pipelined
+	 * by drivers with an i/o thread, the result of each one must be
+	 * taken.
+	 */
+	std::future<bdm_reply> read_dm_reg_async(uint8_t reg);
+	std::future<bdm_reply> write_dm_reg_async(uint8_t reg, uint32_t value);
+	std::future<bdm_reply> read_ad_reg_async(uint8_t reg);
+	std::future<bdm_reply> write_ad_reg_async(uint8_t reg, uint32_t value);
+	std::future<bdm_reply> read_mem_async(uint32_t address, int size);
+	std::future<bdm_reply> write_mem_async(uint32_t address, int size,
+					      uint32_t value);
+	std::future<bdm_reply> read_ctrl_reg_async(cr_type type);
+	std::future<bdm_reply> write_ctrl_reg_async(cr_type type,
+						   uint32_t value);
+
+	int xfer_batch(bdm_xfer *xfers, int count);
+	void fill_mem_read(bdm_xfer &x, uint32_t address, int size);
+	void fill_mem_dump(bdm_xfer &x, int size);
+	void fill_mem_write(bdm_xfer &x, uint32_t address, int size,
+			    uint32_t value);
+	void fill_dm_read(bdm_xfer &x, uint8_t reg);
+	void fill_dm_write(bdm_xfer &x, uint8_t reg, uint32_t value);
+	void fill_ad_read(bdm_xfer &x, uint8_t reg);
+	void fill_ad_write(bdm_xfer &x, uint8_t reg, uint32_t value);
+	void fill_ctrl_read(bdm_xfer &x, cr_type type);
+	void fill_ctrl_write(bdm_xfer &x, cr_type type, uint32_t value);
+	int read_block(uint32_t address, uint8_t *data, uint32_t size);
 	uint32_t read_ctrl_reg(cr_type type);
 	uint32_t write_ctrl_reg(cr_type type, uint32_t value);
 	int load_segment(uint8_t *data, uint32_t dest, uint32_t size);
+	int load_verified(uint8_t *data, uint32_t dest, uint32_t size);
+	void set_progress(const std::function<bool(int)> &fn);
+	driver *get_driver() { return drv; }
+	/* part found on attach, NULL if not in the database */
+	void set_part(const cf_cpu *p) { part = p; }
+	const cf_cpu *get_part() { return part; }
 
 private:
+	std::future<bdm_reply> submit(bdm_xfer *x);
+	int call_insn_len(uint16_t opcode);
+	void write_tdr();
+
 	int state {};
+	uint32_t go_csr {};
+	uint32_t stop_csr {};
+	uint32_t tdr {};
 	driver *drv;
-	char buff[max_bdm_buff];
+	const cf_cpu *part {};
+	object_pool<bdm_xfer> pool;
 };
 
 
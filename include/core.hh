@@ -3,33 +3,38 @@
 
 #include "driver-core.hh"
 #include "bdm.hh"
+#include "parts.hh"
+#include "profile.hh"
 #include <string>
 
 using std::string;
 
-struct cf_cpu {
-	uint32_t d0_rst;
-	uint32_t d1_rst;
-	const char *name;
-};
-
 class core
 {
 public:
 	core();
+	core(driver *d);
 	~core();
 
 	int run();
+	int attach();
+	bdm_ops *get_bdm() { return bdm; }
 
 private:
 	int examine();
+	int identify();
+	void setup_part();
 	int get_programmer_info();
 	int get_cpu_info();
+	int session();
+	void save_profile();
 
 private:
 	driver_core dc;
 	driver *drv;
 	bdm_ops *bdm;
+	target_profile profile;
+	bool known {};
 };
 
 
@@ -0,0 +1,52 @@
+#ifndef daemon_hh
+#define daemon_hh
+
+#include "parser.hh"
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+/*
+ * Keeps the pod open and serves parser commands to short lived
+ * clients over a unix domain socket. Requests are text lines,
+ * the reply is the command output followed by
+ *
+ *   0x04 <exit code> '\n'
+ *
+ * Commands otherwise stopped by a key, such as monitor or go with
+ * semihosting, stop when the client hangs up or sends anything more.
+ */
+static constexpr char daemon_eot = 0x04;
+
+struct daemon_client {
+	int fd;
+	string in;
+};
+
+struct daemon_server
+{
+	daemon_server(parser *p) : prs(p) {
+		prs->no_keyboard([this] { return stopped(); });
+	}
+	~daemon_server();
+
+	int run(const string &path);
+	static int client(const string &path, const string &line);
+
+private:
+	int serve_line(int fd, const string &line);
+	int read_client(daemon_client &c);
+	bool stopped();
+
+	parser *prs;
+	string sock_path;
+	int lfd {-1};
+	/* client of the command in progress */
+	int serving {-1};
+	vector<daemon_client> clients;
+};
+
+#endif /* daemon_hh */
@@ -0,0 +1,70 @@
+#ifndef driver_async_hh
+#define driver_async_hh
+
+#include "driver-core.hh"
+#include "pool.hh"
+#include "spsc.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+/*
+ * A pod operation, executed by the i/o thread.
+ */
+struct async_req {
+	std::function<int()> fn;
+	std::promise<int> result;
+};
+
+static constexpr int ASYNC_QUEUE_SIZE = 64;
+
+/*
+ * Runs all the pod traffic of the wrapped driver on its own i/o
+ * thread. Halt and reset go through the urgent lane, that is also
+ * served between the exchanges of batches and big block writes of
+ * drivers calling the yield hook. Any thread can queue, producers
+ * are serialized so the queues stay spsc.
+ */
+struct driver_async : public driver {
+
+	driver_async(driver *d);
+	virtual ~driver_async();
+
+	virtual int probe();
+	virtual int get_programmer_info();
+	virtual int xfer_bdm_data(char *io_buff, int len);
+	virtual int xfer_bdm_batch(bdm_xfer *xfers, int count);
+	virtual std::future<int> xfer_bdm_async(bdm_xfer *xfer);
+	virtual int send_big_block(uint8_t *data, uint32_t dest_addr,
+				   int size);
+	virtual void send_reset(bool state);
+	virtual void send_go();
+	virtual void send_halt();
+	virtual vector<int> get_bdm_clocks();
+	virtual int get_bdm_clock();
+	virtual int set_bdm_clock(int div, bool fallback);
+	virtual string get_serial();
+
+private:
+	std::future<int> submit(const std::function<int()> &fn,
+				bool prio = false);
+	int call(const std::function<int()> &fn, bool prio = false);
+	void execute(async_req *r);
+	void io_loop();
+
+	driver *inner;
+	spsc_queue<async_req *, ASYNC_QUEUE_SIZE> normal;
+	spsc_queue<async_req *, ASYNC_QUEUE_SIZE> urgent;
+	object_pool<async_req> reqs;
+	std::mutex mtx;
+	std::mutex producer;
+	std::condition_variable cv_work;
+	std::atomic<bool> quit {};
+	std::thread io;
+};
+
+#endif /* driver_async_hh */
@@ -2,13 +2,36 @@
 #define driver_core_hh
 
 #include <libusb-1.0/libusb.h>
+#include <functional>
+#include <future>
 #include <map>
 #include <string>
+#include <vector>
 
 using std::map;
 using std::string;
+using std::vector;
 
 static constexpr int USB_BUFF_SIZE = 4096;
+static constexpr int BDM_XFER_SIZE = 256;
+
+/*
+ * Bdm transfer results, a refused command got a not ready, bus error
+ * or illegal command response, the link itself is fine.
+ */
+enum xfer_result {
+	xr_ok,
+	xr_link,
+	xr_refused,
+};
+
+/*
+ * One bdm command of a batch, reply is returned in place.
+ */
+struct bdm_xfer {
+	char buff[BDM_XFER_SIZE];
+	int len;
+};
 
 struct driver {
 	driver() {}
@@ -17,19 +40,63 @@ struct driver {
 	virtual int probe() = 0;
 	virtual int get_programmer_info() = 0;
 	virtual int xfer_bdm_data(char *io_buff, int len) = 0;
+	virtual int xfer_bdm_batch(bdm_xfer *xfers, int count);
+	virtual std::future<int> xfer_bdm_async(bdm_xfer *xfer);
 	virtual int send_big_block(uint8_t *data, uint32_t dest_addr,
 				   int size) = 0;
 	virtual void send_reset(bool state) = 0;
 	virtual void send_go() = 0;
 	virtual void send_halt() = 0;
 
+	/*
+	 * Bdm clock, as a divider of the target clock, lower is faster.
+	 * Pods without a known clock command have no dividers. With
+	 * fallback, a failing exchange is retried at the next slower one.
+	 */
+	virtual vector<int> get_bdm_clocks() { return {}; }
+	virtual int get_bdm_clock() { return 0; }
+	virtual int set_bdm_clock(int div, bool fallback) { return 1; }
+	virtual string get_serial() { return ""; }
+
+	/* CSR as read by the pod right after go, 0 if not read */
+	uint32_t get_go_csr() { return go_csr; }
+
+	/*
+	 * Called by big block writes after each chunk with its size,
+	 * returning false aborts the write. Set it while idle only.
+	 */
+	void set_chunk_hook(const std::function<bool(int)> &fn) {
+		on_chunk = fn;
+	}
+
+	/*
+	 * Called between the exchanges of batches and big blocks, so a
+	 * wrapper can serve other requests meanwhile. Set it while idle.
+	 */
+	void set_yield_hook(const std::function<void()> &fn) {
+		on_yield = fn;
+	}
+
 protected:
 	libusb_device *dev;
-	libusb_device_handle *handle;
+	libusb_device_handle *handle {};
 	unsigned int endpoint_in;
 	unsigned int endpoint_out;
 	unsigned char ibuf[USB_BUFF_SIZE];
 	unsigned char obuf[USB_BUFF_SIZE];
+	uint32_t go_csr {};
+	std::function<bool(int)> on_chunk;
+	std::function<void()> on_yield;
+};
+
+/*
+ * A detected pod, device is referenced.
+ */
+struct pod_info {
+	libusb_device *device;
+	string class_name;
+	string name;
+	string serial;
 };
 
 struct driver_core {
@@ -37,7 +104,10 @@ struct driver_core {
 	~driver_core();
 
 	int init();
+	int init_context();
 	int detect_usb_pod();
+	int enumerate_pods(vector<pod_info> &pods);
+	driver *create(const string &class_name, libusb_device *device);
 
 	driver *get_current_driver() { return drv; }
 
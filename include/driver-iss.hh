@@ -0,0 +1,75 @@
+#ifndef driver_iss_hh
+#define driver_iss_hh
+
+#include "driver-sim.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/*
+ * Simulated pod executing the target code: a ColdFire ISA_A/A+
+ * interpreter on the driver_sim memory and registers. The core runs
+ * on its own thread between go and halt, in slices, so the pod side
+ * still answers bdm traffic while the code runs.
+ */
+struct driver_iss : public driver_sim {
+
+	driver_iss(libusb_device *device);
+	virtual ~driver_iss();
+
+	virtual int probe();
+
+protected:
+	virtual int send_and_recv(int tx_count, int rx_count);
+	virtual void run(bool step);
+
+private:
+	struct ea_t {
+		uint32_t *reg;
+		uint32_t addr;
+	};
+
+	void cpu_loop();
+	int execute(int count);
+
+	inline uint16_t fetch16();
+	inline uint32_t fetch32();
+	inline uint32_t rd(uint32_t addr, int size);
+	inline void wr(uint32_t addr, int size, uint32_t value);
+	inline void watch(uint32_t addr, bool read);
+	inline uint32_t index(uint32_t base);
+	inline uint32_t ea_addr(int mode, int reg, int size);
+	inline ea_t ea(int mode, int reg, int size);
+	inline uint32_t get(const ea_t &e, int size);
+	inline void put(const ea_t &e, int size, uint32_t value);
+	inline void push(uint32_t value);
+	inline uint32_t pop();
+	inline bool cond(int cc);
+	inline void flags_logic(uint32_t r, int size);
+	inline void flags_add(uint32_t s, uint32_t d, uint32_t r, int size);
+	inline void flags_sub(uint32_t s, uint32_t d, uint32_t r, int size,
+			      bool x);
+	void exception(int vec, uint32_t fault_pc);
+
+	/* hot state, loaded from and stored back to ctrl per slice */
+	uint32_t pc {};
+	uint32_t sr {};
+	uint32_t vbr {};
+	uint32_t imm {};
+	bool bp_on {};
+	bool wp_on {};
+	bool wp_hit {};
+	bool skip_bp {};
+	bool stopped {};
+	uint64_t insns {};
+
+	std::thread cpu;
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::atomic<int> waiting {};
+	bool quit {};
+};
+
+#endif /* driver_iss_hh */
@@ -12,9 +12,45 @@
 using std::map;
 using std::tuple;
 
+/* P&E packet framing, see send_generic() */
+static constexpr unsigned char REP_VERSION_INFO[] = {0x99, 0x66, 0x00, 0x64};
+
+static constexpr int OFS_BDM_PREFIX = 5;
+static constexpr int OFS_BDM = 6;
+static constexpr int PEMU_CMD_REPLY_LEN = 4;
+static constexpr int PEMU_STD_PKT_SIZE = 256;
+static constexpr int PEMU_MAX_PKT_SIZE = 1280;
+static constexpr int PEMU_MAX_BIG_BLOCK	= 0x4a8;
+
+enum pemu_prefixes {
+	CMD_PEMU_RESET = 0x01,
+	CMD_PEMU_GO = 0x02,
+	CMD_PEMU_GET_VERSION_STR = 0x0b,
+	CMD_PEMU_BDM_MEM_R = 0x11,
+	CMD_PEMU_BDM_REG_R = 0x13,
+	CMD_PEMU_BDM_SCR_W = 0x14,
+	CMD_PEMU_BDM_MEM_W = 0x15,
+	CMD_PEMU_BDM_REG_W = 0x16,
+	CMD_PEMU_GET_ALL_CPU_REGS = 0x18,
+	CMD_PEMU_W_MEM_BLOCK = 0x19,
+};
+
+enum pemu_pkt_types {
+	PEMU_PT_GENERIC = 0xaa55,
+	PEMU_PT_CMD = 0xab56,
+	PEMU_PT_WBLOCK = 0xbc67,
+};
+
+enum pemu_cmd_type {
+	CMD_TYPE_GENERIC = 0x01,
+	CMD_TYPE_IFACE = 0x04,
+	CMD_TYPE_DATA = 0x07,
+};
+
 struct driver_pemu : public driver {
 
 	driver_pemu(libusb_device *device);
+	~driver_pemu();
 
 	virtual int probe();
 	virtual int get_programmer_info();
@@ -23,14 +59,29 @@ struct driver_pemu : public driver {
 	virtual void send_reset(bool state);
 	virtual void send_go();
 	virtual void send_halt();
+	virtual int get_bdm_clock() { return clock_div; }
+	virtual string get_serial();
+
+protected:
+	int transfer(int tx_count, int rx_count);
+	virtual int send_and_recv(int tx_count, int rx_count);
+
+	/*
+	 * 0 while the pod runs its own default, the P&E clock command
+	 * is not known so this pod has no dividers.
+	 */
+	int clock_div {};
+	bool clock_fallback {};
 
 private:
+	int exchange(int tx_count, int rx_count);
+	bool slow_down(int tx_count);
 	int extract_info(unsigned char *offset, int pos, char *res);
-	int send_and_recv(int tx_count, int rx_count);
+	int bulk_xfer(unsigned int endpoint, unsigned char *buff, int count);
 	int send_generic(uint8_t cmd_type, uint16_t len);
+	int send_chunk(uint8_t *data, uint32_t dest_addr, int size);
 	int write_mem_byte(uint32_t dest_addr, uint8_t byte);
 
-
 	map<int, tuple<int, int>> bdm_prefixes;
 };
 
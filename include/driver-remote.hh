@@ -0,0 +1,68 @@
+#ifndef driver_remote_hh
+#define driver_remote_hh
+
+#include "driver-core.hh"
+#include "pod-proto.hh"
+
+#include <atomic>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+/*
+ * An in flight request, replies are copied in place.
+ */
+struct remote_req {
+	std::promise<int> result;
+	bdm_xfer *xfers;
+	int count;
+};
+
+/* big block chunks in flight */
+static constexpr int REMOTE_WINDOW = 8;
+static constexpr int REMOTE_CHUNK = 0x1000;
+
+/*
+ * A pod served by another opencf with --serve, requests are
+ * pipelined, a reader thread completes them.
+ */
+struct driver_remote : public driver {
+
+	driver_remote(libusb_device *device);
+	virtual ~driver_remote();
+
+	virtual int probe();
+	virtual int get_programmer_info();
+	virtual int xfer_bdm_data(char *io_buff, int len);
+	virtual int xfer_bdm_batch(bdm_xfer *xfers, int count);
+	virtual std::future<int> xfer_bdm_async(bdm_xfer *xfer);
+	virtual int send_big_block(uint8_t *data, uint32_t dest_addr,
+				   int size);
+	virtual void send_reset(bool state);
+	virtual void send_go();
+	virtual void send_halt();
+
+private:
+	std::future<int> submit(uint16_t op, const vector<uint8_t> &payload,
+				bdm_xfer *xfers = 0, int count = 0);
+	std::future<int> submit_xfers(bdm_xfer *xfers, int count);
+	void rx_loop();
+	void fail_pending();
+
+	int fd {-1};
+	uint32_t next_id {};
+	bool dead {};
+	std::atomic<bool> closing {};
+	std::mutex mtx;
+	std::mutex tx;
+	std::map<uint32_t, remote_req *> pending;
+	std::thread rx;
+};
+
+#endif /* driver_remote_hh */
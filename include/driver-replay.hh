@@ -0,0 +1,40 @@
+#ifndef driver_replay_hh
+#define driver_replay_hh
+
+#include "driver-pemu.hh"
+#include "recorder.hh"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+/*
+ * Pod played back from a --record capture, --replay file[:speed].
+ * Replies come from the capture at the original pace times speed,
+ * 0 as fast as possible, requests are checked against it.
+ */
+struct driver_replay : public driver_pemu {
+
+	driver_replay(libusb_device *device);
+	virtual ~driver_replay();
+
+	virtual int probe();
+
+protected:
+	virtual int send_and_recv(int tx_count, int rx_count);
+
+private:
+	const rec_hdr *next(const uint8_t **data);
+
+	vector<uint8_t> capture;
+	size_t pos {};
+	double speed {1};
+	uint64_t frames {};
+	uint64_t diverged {};
+	uint64_t capture_us {};
+	std::chrono::steady_clock::time_point start;
+};
+
+#endif /* driver_replay_hh */
@@ -0,0 +1,92 @@
+#ifndef driver_sim_hh
+#define driver_sim_hh
+
+#include "driver-pemu.hh"
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+using std::map;
+using std::vector;
+
+static constexpr int SIM_PAGE_SHIFT = 16;
+static constexpr uint32_t SIM_PAGE_SIZE = 1 << SIM_PAGE_SHIFT;
+
+static constexpr int SIM_CLOCKS[] = { 1, 2, 3, 4, 6, 8, 12, 16 };
+static constexpr int SIM_DEFAULT_CLOCK = 8;
+
+/*
+ * Software pod, speaking the P&E framing of driver_pemu to an in
+ * memory coldfire: sparse big endian memory, register files and the
+ * bdm state. Each usb transaction can be charged a latency plus its
+ * size over a bandwidth, as of the default bdm clock, and the link
+ * gets unreliable below a divider, from
+ * --sim latency_us[:KB/s[:min_div]].
+ */
+struct driver_sim : public driver_pemu {
+
+	driver_sim(libusb_device *device);
+	virtual ~driver_sim();
+
+	virtual int probe();
+	virtual int xfer_bdm_data(char *io_buff, int size);
+	virtual vector<int> get_bdm_clocks();
+	virtual int set_bdm_clock(int div, bool fallback);
+	virtual string get_serial() { return "sim"; }
+
+protected:
+	virtual int send_and_recv(int tx_count, int rx_count);
+	/* core execution on go, for a step or until halted */
+	virtual void run(bool step);
+
+	int process(int rx_count);
+	void model(int bytes);
+	bool link_fault();
+	void garble();
+
+	uint8_t *page(uint32_t addr, bool alloc) {
+		std::unique_ptr<uint8_t[]> &p = pages[addr >> SIM_PAGE_SHIFT];
+
+		if (!p && alloc)
+			p.reset(new uint8_t[SIM_PAGE_SIZE]());
+
+		return p.get();
+	}
+
+	uint32_t mem_read(uint32_t addr, int size);
+	void mem_write(uint32_t addr, int size, uint32_t value);
+	void halt_core(uint32_t status);
+
+	uint32_t ad[16] {};
+	uint32_t dm[16] {};
+	map<uint32_t, uint32_t> ctrl;
+	bool running {};
+
+private:
+	void reset_core();
+	uint32_t *ctrl_reg(uint32_t reg);
+	/* bdm response status, 0 if valid */
+	int bdm_command(const uint8_t *cmd, uint8_t *reply);
+	void reset_line(uint8_t state);
+
+	vector<std::unique_ptr<uint8_t[]>> pages;
+	bool in_reset {};
+	/* status of the last single bdm command */
+	bool refused {};
+	uint32_t csr_status {};
+	uint32_t dump_addr {};
+
+	int latency_us {};
+	int kbytes_s {};
+	int min_div {};
+	uint32_t noise {0x2545f491};
+	uint64_t xacts {};
+	uint64_t bytes {};
+	uint64_t model_us {};
+	std::chrono::steady_clock::time_point busy_until;
+};
+
+#endif /* driver_sim_hh */
@@ -2,20 +2,55 @@
 #define elf_hh
 
 #include "bdm.hh"
+#include "frame.hh"
 #include <string>
+#include <vector>
 
 using std::string;
+using std::vector;
+
+struct elf_symbol {
+	uint32_t addr;
+	uint32_t size;
+	uint8_t type;
+	string name;
+};
+
+struct elf_segment {
+	uint32_t addr;
+	uint32_t size;
+	const uint8_t *data;
+};
 
 struct elf
 {
 	elf(bdm_ops *b) : bdm(b) {}
+	~elf();
 
 	char *load_elf(const string &path);
+	int parse(const string &path);
+	int program(bdm_ops *b, bool verify = false) const;
+	int verify(bdm_ops *b) const;
+	int check(bdm_ops *b, bool force = false) const;
+	uint32_t image_size() const;
+	int load_symbols(const string &path);
 	int load_program_headers(const char *elf,
 				 const char *offs, int entries);
 
+	const elf_symbol *find_function(uint32_t addr) const;
+	const elf_symbol *find_symbol(const string &name) const;
+	/* caller of the function at pc, core halted */
+	int return_address(bdm_ops *b, uint32_t pc, uint32_t &ret) const;
+
 private:
+	int read_symtab(const char *elf);
+
 	bdm_ops *bdm;
+	char *image {};
+	uint32_t entry {};
+	vector<elf_segment> segments;
+	vector<elf_symbol> symbols;
+	call_frames frames;
 };
 
 #endif /* elf_hh */
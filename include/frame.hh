@@ -0,0 +1,63 @@
+#ifndef frame_hh
+#define frame_hh
+
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+/*
+ * Return address of the frame at some pc: the canonical frame
+ * address is a register (dwarf numbers, 0-7 d0-d7, 8-15 a0-a7) plus
+ * an offset, the return address is saved at an offset from it.
+ */
+struct frame_rule {
+	int cfa_reg;
+	int32_t cfa_offset;
+	int32_t ra_offset;
+};
+
+/*
+ * Call frame information from .debug_frame, 32 bit dwarf, cies with
+ * no augmentation. Only the cfa and return address rules are kept.
+ */
+struct call_frames {
+	int parse(const char *elf);
+	int find(uint32_t pc, frame_rule &r) const;
+
+private:
+	/* instructions from insns to insns_end, section offsets */
+	struct cie {
+		uint32_t offset;
+		uint32_t code_align;
+		int32_t data_align;
+		uint32_t ra_reg;
+		uint32_t insns;
+		uint32_t insns_end;
+	};
+
+	struct fde {
+		uint32_t pc_start;
+		uint32_t pc_end;
+		int cie;
+		uint32_t insns;
+		uint32_t insns_end;
+	};
+
+	struct state {
+		int cfa_reg;
+		int32_t cfa_offset;
+		bool ra_saved;
+		int32_t ra_offset;
+	};
+
+	bool execute(const cie &c, uint32_t from, uint32_t to,
+		     uint32_t loc, uint32_t pc, const state &init,
+		     state &s) const;
+
+	vector<uint8_t> section;
+	vector<cie> cies;
+	vector<fde> fdes;
+};
+
+#endif /* frame_hh */
@@ -0,0 +1,40 @@
+#ifndef gang_hh
+#define gang_hh
+
+#include "driver-core.hh"
+#include "elf.hh"
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+struct gang_result {
+	string serial;
+	bool ok;
+	string error;
+	double attach_ms;
+	double load_ms;
+	double verify_ms;
+};
+
+/*
+ * Same image, programmed and verified on all the connected pods,
+ * one worker thread per pod.
+ */
+struct gang
+{
+	gang(driver_core &d) : dc(d) {}
+
+	int run(const string &path);
+
+private:
+	void worker(const pod_info &pod, const elf &img, gang_result &res);
+	void report(const vector<gang_result> &results, uint32_t size,
+		    double total_ms);
+
+	driver_core &dc;
+};
+
+#endif /* gang_hh */
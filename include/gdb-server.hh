@@ -0,0 +1,55 @@
+#ifndef gdb_server_hh
+#define gdb_server_hh
+
+#include "bdm.hh"
+
+#include <string>
+
+using std::string;
+
+/* bytes, advertised to gdb in qSupported */
+static constexpr int gdb_packet_size = 0x4000;
+/* no authentication, loopback unless asked otherwise */
+static constexpr char gdb_def_bind[] = "127.0.0.1";
+
+struct gdb_server
+{
+	gdb_server(bdm_ops *b) : bdm(b) {}
+	~gdb_server();
+
+	int run(const string &bind, int port);
+
+private:
+	int serve_client();
+	int get_packet(string &pkt);
+	int put_packet(const string &pkt);
+	int read_byte();
+	bool interrupted();
+	int handle(const string &pkt);
+
+	string stop_reply(int signal);
+	string read_regs();
+	string write_regs(const string &args);
+	string read_reg(const string &args);
+	string write_reg(const string &args);
+	string read_mem(const string &args);
+	string write_mem(const string &args, bool binary);
+	string breakpoint(const string &args, bool insert);
+	string query(const string &pkt);
+	string resume(const string &args, bool step);
+
+	bdm_ops *bdm;
+	int lfd {-1};
+	int fd {-1};
+	bool no_ack {};
+	uint32_t bp_addr {};
+	bool bp_set {};
+	uint32_t wp_addr {};
+	bool wp_set {};
+
+	unsigned char rx[gdb_packet_size];
+	int rx_len {};
+	int rx_pos {};
+};
+
+#endif /* gdb_server_hh */
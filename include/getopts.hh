@@ -14,6 +14,27 @@ struct opts {
 	}
 	bool verbose;
 	string server_path;
+	int gdb_port {};
+	/* listen address of the servers, empty for their default */
+	string bind;
+	string daemon_path;
+	string connect_path;
+	string script_path;
+	string commands;
+	string gang_elf;
+	int serve_port {};
+	string remote;
+	int tftp_port {};
+	string tftp_bind;
+	string sim;
+	bool iss {};
+	bool auto_speed {};
+	bool attach {};
+	/* program the evaluation board bars of the part */
+	bool board_map {};
+	string record;
+	string replay;
+	string stats_path;
 	vector<string> nonopts {};
 };
 
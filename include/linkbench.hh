@@ -0,0 +1,46 @@
+#ifndef linkbench_hh
+#define linkbench_hh
+
+#include "bdm.hh"
+#include "stats.hh"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::vector;
+
+/*
+ * Bdm link characterization: round trip latency per command class,
+ * then write and read bandwidth per block size, on a scratch area at
+ * the start of the internal sram, restored at the end.
+ */
+struct linkbench {
+	linkbench(bdm_ops *b) : bdm(b) {}
+
+	int run(int iterations, const string &out);
+
+private:
+	struct bw_result {
+		uint32_t size;
+		histogram wr;
+		histogram rd;
+		bool verified;
+	};
+
+	template <typename F> void time(histogram &h, int count, F fn);
+	void latency(int iterations);
+	int bandwidth(int iterations);
+	void report();
+	int write_json(const string &path, int iterations);
+
+	bdm_ops *bdm;
+	uint32_t base {};
+	map<string, histogram> lat;
+	map<uint32_t, bw_result> bw;
+};
+
+#endif /* linkbench_hh */
@@ -0,0 +1,45 @@
+#ifndef monitor_hh
+#define monitor_hh
+
+#include "bdm.hh"
+#include "elf.hh"
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+enum mon_type {
+	mt_unsigned,
+	mt_signed,
+	mt_float,
+};
+
+struct monitor_var {
+	string name;
+	int type;
+};
+
+struct monitor
+{
+	monitor(bdm_ops *b, const elf *e) : bdm(b), img(e) {}
+
+	int add(const string &spec);
+	int run(int rate, const string &path, int seconds,
+		const std::function<bool()> &cancel);
+
+private:
+	int parse_type(const string &type, int &size, int &t);
+	void write_sample(FILE *f, long long us);
+
+	bdm_ops *bdm;
+	const elf *img;
+
+	vector<monitor_var> vars;
+	vector<mem_access> acc;
+};
+
+#endif /* monitor_hh */
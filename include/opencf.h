@@ -0,0 +1,69 @@
+#ifndef opencf_h
+#define opencf_h
+
+/*
+ * libopencf, C api to a bdm pod, for tools and test harnesses that
+ * keep the pod open across many operations.
+ *
+ * All calls return 0 on success, nonzero on any error, exceptions
+ * included. Buffers stay with the caller and are only accessed during
+ * the call, data goes through the pod packets. Messages go to stderr,
+ * or to the callback given to opencf_set_log.
+ */
+
+#include <stdint.h>
+
+#ifdef __GNUC__
+#define OPENCF_API __attribute__((visibility("default")))
+#else
+#define OPENCF_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct opencf_pod opencf_pod;
+
+/* d0-d7, a0-a7, sr, pc, vbr */
+#define OPENCF_NUM_REGS	19
+
+/* log levels */
+#define OPENCF_LOG_ERR	0
+#define OPENCF_LOG_WRN	1
+#define OPENCF_LOG_INFO	2
+#define OPENCF_LOG_DBG	3
+
+typedef void (*opencf_log_fn)(int level, const char *msg, void *ctx);
+
+/* NULL restores stderr */
+OPENCF_API void opencf_set_log(opencf_log_fn fn, void *ctx);
+
+OPENCF_API opencf_pod *opencf_open(void);
+OPENCF_API void opencf_close(opencf_pod *pod);
+
+OPENCF_API int opencf_reset(opencf_pod *pod);
+OPENCF_API int opencf_go(opencf_pod *pod);
+OPENCF_API int opencf_halt(opencf_pod *pod);
+OPENCF_API int opencf_wait_halted(opencf_pod *pod, int timeout_ms);
+
+/* size is 1, 2 or 4 */
+OPENCF_API int opencf_read_mem(opencf_pod *pod, uint32_t addr, int size,
+			       uint32_t *value);
+OPENCF_API int opencf_write_mem(opencf_pod *pod, uint32_t addr, int size,
+				uint32_t value);
+OPENCF_API int opencf_read_block(opencf_pod *pod, uint32_t addr,
+				 void *buf, uint32_t size);
+OPENCF_API int opencf_write_block(opencf_pod *pod, uint32_t addr,
+				  const void *buf, uint32_t size);
+
+OPENCF_API int opencf_read_regs(opencf_pod *pod, uint32_t *regs);
+OPENCF_API int opencf_write_reg(opencf_pod *pod, int reg, uint32_t value);
+
+OPENCF_API int opencf_load_elf(opencf_pod *pod, const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* opencf_h */
@@ -2,6 +2,10 @@
 #define parser_hh
 
 #include "bdm.hh"
+#include "elf.hh"
+#include "semihost.hh"
+#include "periph.hh"
+#include <functional>
 #include <string>
 #include <map>
 #include <vector>
@@ -17,39 +21,88 @@ protected:
 	map<string, string> mcmd_help;
 };
 
+/*
+ * Pre-parsed script command.
+ */
+struct script_cmd
+{
+	string cmd;
+	vector<string> args;
+	int line;
+};
+
 struct parser : public parser_help
 {
 	parser(bdm_ops *b);
 	~parser();
 
 	int run();
+	int execute(const string &line);
+	int run_script(const string &path);
+	int run_batch(const string &text);
+	/*
+	 * Daemon clients have no keyboard, stdin is not theirs, commands
+	 * waiting for a key stop when stop returns true instead.
+	 */
+	void no_keyboard(const std::function<bool()> &stop) {
+		keys = false;
+		no_key_stop = stop;
+	}
 
 private:
 	void prompt();
 	void get_input_line(string &line);
-	void process_line(string &line);
+	int process_line(string &line);
+	int dispatch(const string &cmd);
+	int compile(const script_cmd &c, bdm_xfer &x, int &print);
+	int flush_batch(vector<bdm_xfer> &xfers, vector<int> &prints);
 	void repeat_last_cmd();
 	void get_mem_values(uint32_t &addr, uint32_t &val);
 	int get_key_pressed();
+	int wait_semihosting();
+	bool key_hit();
+	int poll_key();
 	void dump_set(stringstream &ss, int reg, char pre);
 
 	int cmd_dump_cpu_regs();
 	int cmd_exit();
+	int cmd_finish();
 	int cmd_go();
 	int cmd_halt();
 	int cmd_help();
 	int cmd_load();
+	int cmd_monitor();
+	int cmd_next();
+	int cmd_periph();
+	int cmd_profile();
 	int cmd_read();
+	int cmd_rtt();
+	int cmd_semihosting();
+	int cmd_linkbench();
+	int cmd_speed();
+	int cmd_map();
+	int cmd_stats();
 	int cmd_step();
+	int cmd_symbols();
 	int cmd_write();
 
 private:
 	bdm_ops *bdm;
+	elf img;
+	semihost sh;
+	periph_db periphs;
+	bool semihosting {};
 	string last{};
 	unsigned int line_pos{};
 	vector<string> args;
 	deque<string> commands;
 	struct termios oldt, newt;
+	bool interactive {};
+	/* exit or quit seen, the session returns */
+	bool quit {};
+	/* stdin polled for a key stopping long commands */
+	bool keys {};
+	std::function<bool()> no_key_stop;
 
 	typedef int(parser::*cmd)();
 	map<string, cmd> mcmd;
@@ -0,0 +1,63 @@
+#ifndef parts_hh
+#define parts_hh
+
+#include "bdm.hh"
+
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+/* slower types last */
+enum region_type {
+	rt_sram,
+	rt_external,
+	rt_flash,
+	rt_ipsbar,
+};
+
+/*
+ * A memory region of a part, width is the widest access it takes in
+ * one bus cycle, in bytes.
+ */
+struct cf_region {
+	const char *name;
+	uint32_t base;
+	uint32_t size;
+	int type;
+	int width;
+	bool cacheable;
+};
+
+/* d0 magic, version and mac/div/emac, d1 sram size */
+static constexpr uint32_t CF_D0_PART_MASK = 0xfff0e000;
+static constexpr uint32_t CF_D1_PART_MASK = 0x000000f0;
+
+/*
+ * A ColdFire part, found by the masked bits of its d0/d1 reset values.
+ * The setup registers are written on attach, zero ones are left as
+ * they are. The bars and the external regions are the ones of the
+ * evaluation board.
+ */
+struct cf_cpu {
+	uint32_t d0_rst;
+	uint32_t d1_rst;
+	const char *name;
+	uint32_t rambar;
+	uint32_t flashbar;
+	uint32_t cacr;
+	uint32_t acr0;
+	uint32_t acr1;
+	vector<cf_region> regions;
+
+	int setup(bdm_ops *bdm, bool board) const;
+	const cf_region *region(uint32_t addr) const;
+	/* flash region FLASHBAR maps on the evaluation board, if any */
+	const cf_region *onchip_flash() const;
+	/* fastest on-chip sram region holding size bytes */
+	const cf_region *fastest(uint32_t size) const;
+};
+
+const cf_cpu *find_part(uint32_t d0, uint32_t d1);
+
+#endif /* parts_hh */
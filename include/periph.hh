@@ -0,0 +1,84 @@
+#ifndef periph_hh
+#define periph_hh
+
+#include "bdm.hh"
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::vector;
+
+/*
+ * Peripheral descriptions, one item per line, # comments:
+ *
+ *   peripheral name base [description]
+ *   register   name offset size [nr]
+ *   field      name msb[:lsb]
+ *
+ * Registers belong to the last peripheral, fields to the last
+ * register, size is 1, 2 or 4, nr marks registers with read side
+ * effects, never read. Peripheral names are not case sensitive.
+ */
+
+struct periph_field {
+	string name;
+	uint8_t msb;
+	uint8_t lsb;
+};
+
+struct periph_reg {
+	string name;
+	uint32_t offset;
+	int size;
+	bool noread;
+	/* read as a dump, continuing the previous register */
+	bool dump;
+	uint32_t field;
+	uint32_t fields;
+};
+
+struct periph_block {
+	string name;
+	string desc;
+	uint32_t base;
+	uint32_t reg;
+	uint32_t regs;
+	/* bdm reads of a whole block, in one batch */
+	uint32_t reads;
+};
+
+/*
+ * All the descriptions loaded, flat tables indexed by the peripheral
+ * name, each peripheral a range of registers and each register a
+ * range of fields.
+ */
+struct periph_db {
+	int load(const string &path);
+	bool empty() const { return blocks.empty(); }
+	const periph_block *find(const string &name) const;
+	void list() const;
+
+	/* readable registers in one batch, values by register */
+	int read(bdm_ops *bdm, const periph_block &p,
+		 vector<uint32_t> &values) const;
+	/* changed registers highlighted if prev is not empty */
+	void show(const periph_block &p, const vector<uint32_t> &values,
+		  const vector<uint32_t> &prev) const;
+	int watch(bdm_ops *bdm, const periph_block &p, int rate,
+		  const std::function<bool()> &cancel) const;
+
+private:
+	void finish();
+
+	vector<periph_block> blocks;
+	vector<periph_reg> regs;
+	vector<periph_field> fields;
+	map<string, uint32_t> index;
+};
+
+#endif /* periph_hh */
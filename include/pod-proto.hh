@@ -0,0 +1,73 @@
+#ifndef pod_proto_hh
+#define pod_proto_hh
+
+#include <cstdint>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/*
+ * Pod sharing protocol, over tcp, all fields in network order.
+ *
+ * Each request and reply starts with a pod_hdr, followed by len
+ * payload bytes. Requests are pipelined, replies come back in order
+ * and carry the request id and a status.
+ *
+ * PP_XFER  req: count * { u16 len, len bdm bytes }
+ *          rep: count * PP_REPLY_LEN bytes
+ * PP_BLOCK req: u32 address, data
+ * PP_RESET req: u8 state
+ * PP_GO    rep: u32 csr read after go
+ */
+enum pod_proto_ops {
+	PP_INFO = 1,
+	PP_XFER,
+	PP_BLOCK,
+	PP_RESET,
+	PP_GO,
+	PP_HALT,
+};
+
+struct pod_hdr {
+	uint32_t id;
+	uint16_t op;
+	int16_t status;
+	uint32_t len;
+} __attribute__((packed));
+
+/* bdm replies are at most a long, ending the reply buffer */
+static constexpr int PP_REPLY_LEN = 8;
+static constexpr uint32_t PP_MAX_PAYLOAD = 0x10000;
+
+static inline int pp_read(int fd, void *buff, int len)
+{
+	char *p = (char *)buff;
+	int n;
+
+	while (len) {
+		n = read(fd, p, len);
+		if (n <= 0)
+			return 1;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static inline int pp_write(int fd, const void *buff, int len)
+{
+	const char *p = (const char *)buff;
+	int n;
+
+	while (len) {
+		n = send(fd, p, len, MSG_NOSIGNAL);
+		if (n <= 0)
+			return 1;
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+#endif /* pod_proto_hh */
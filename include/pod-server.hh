@@ -0,0 +1,36 @@
+#ifndef pod_server_hh
+#define pod_server_hh
+
+#include "driver-core.hh"
+#include "pod-proto.hh"
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+/* no authentication, loopback unless asked otherwise */
+static constexpr char pod_def_bind[] = "127.0.0.1";
+
+/*
+ * Exposes the local pod driver over tcp, one client at a time.
+ */
+struct pod_server
+{
+	pod_server(driver *d) : drv(d) {}
+	~pod_server();
+
+	int run(const string &bind, int port);
+
+private:
+	int serve_client();
+	int handle(pod_hdr &hdr, vector<uint8_t> &req, vector<uint8_t> &rep);
+	int xfer(vector<uint8_t> &req, vector<uint8_t> &rep);
+
+	driver *drv;
+	int lfd {-1};
+	int fd {-1};
+};
+
+#endif /* pod_server_hh */
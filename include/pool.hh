@@ -0,0 +1,41 @@
+#ifndef pool_hh
+#define pool_hh
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*
+ * Thread safe free list of T, grown on demand. Objects go back to
+ * the heap only with the pool.
+ */
+template <typename T>
+struct object_pool {
+	T *get() {
+		std::lock_guard<std::mutex> l(mtx);
+		T *p;
+
+		if (free.empty()) {
+			all.emplace_back(new T());
+			return all.back().get();
+		}
+
+		p = free.back();
+		free.pop_back();
+
+		return p;
+	}
+
+	void put(T *p) {
+		std::lock_guard<std::mutex> l(mtx);
+
+		free.push_back(p);
+	}
+
+private:
+	std::mutex mtx;
+	std::vector<std::unique_ptr<T>> all;
+	std::vector<T *> free;
+};
+
+#endif /* pool_hh */
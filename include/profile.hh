@@ -0,0 +1,50 @@
+#ifndef profile_hh
+#define profile_hh
+
+#include "bdm.hh"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+/*
+ * What a session learned about a target, for the next one on the
+ * same pod and cpu: identification, memory map setup and bdm clock.
+ */
+struct target_profile {
+	/* setup in one batch */
+	int apply(bdm_ops *bdm) const;
+	/* current setup of a halted core */
+	int capture(bdm_ops *bdm);
+
+	string serial;
+	uint32_t d0_rst {};
+	uint32_t d1_rst {};
+	uint32_t rambar {};
+	uint32_t flashbar {};
+	/* bdm clock divider, 0 for the pod default */
+	int clock {};
+	string cpu;
+};
+
+/*
+ * Profiles on disk, one line each, keyed by pod serial and the d0/d1
+ * reset values.
+ */
+struct profile_cache {
+	profile_cache();
+
+	/* fills p if its key is known */
+	bool find(target_profile &p);
+	void store(const target_profile &p);
+
+private:
+	vector<target_profile> read();
+
+	string path;
+};
+
+#endif /* profile_hh */
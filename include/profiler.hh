@@ -0,0 +1,41 @@
+#ifndef profiler_hh
+#define profiler_hh
+
+#include "bdm.hh"
+#include "elf.hh"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::vector;
+
+struct profiler
+{
+	profiler(bdm_ops *b, const elf *e) : bdm(b), img(e) {}
+
+	int run(int seconds, int rate, int depth,
+		const std::function<bool()> &cancel);
+	void report();
+	int write_folded(const string &path);
+
+private:
+	bool sample(int depth);
+	string symbolize(uint32_t addr);
+
+	bdm_ops *bdm;
+	const elf *img;
+
+	map<string, int> functions;
+	map<string, int> stacks;
+	vector<uint32_t> frames;
+	int samples {};
+	int64_t probe_ns {};
+	int64_t probe_max_ns {};
+	int64_t elapsed_ns {};
+};
+
+#endif /* profiler_hh */
@@ -0,0 +1,75 @@
+#ifndef recorder_hh
+#define recorder_hh
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+using std::string;
+
+static constexpr char REC_MAGIC[8] = "OCFREC1";
+static constexpr size_t REC_RING_SIZE = 1 << 20;
+
+enum rec_dir {
+	REC_OUT,
+	REC_IN,
+	/* frames lost before the next one, a 4 byte count */
+	REC_DROP,
+};
+
+/*
+ * Capture file: REC_MAGIC, then a header per usb frame, network
+ * order, followed by the frame with its trailing zeros stripped.
+ * Frames dropped on a full ring leave a REC_DROP record in their
+ * place.
+ */
+struct rec_hdr {
+	/* from the previous frame */
+	uint32_t delta_us;
+	uint16_t size;
+	uint16_t len;
+	uint8_t dir;
+} __attribute__((packed));
+
+/*
+ * Pod traffic recorder. Frames go to a lock-free ring from the pod
+ * thread, a writer thread drains it to the file, a full ring drops
+ * frames instead of stalling the pod, and counts them in a marker.
+ */
+struct recorder {
+	static recorder &get() {
+		static recorder r;
+		return r;
+	}
+
+	int open(const string &path);
+	void close();
+	bool active() const { return on.load(std::memory_order_relaxed); }
+	/* single producer */
+	void frame(int dir, const uint8_t *data, int size);
+
+private:
+	void put(size_t pos, const void *data, size_t len);
+	void drop_marker(uint8_t *rec);
+	void flush();
+	void writer();
+
+	FILE *out {};
+	string path;
+	std::thread thr;
+	std::atomic<bool> on {};
+	std::atomic<bool> stop {};
+	uint8_t ring[REC_RING_SIZE];
+	std::atomic<size_t> head {0};
+	std::atomic<size_t> tail {0};
+	std::chrono::steady_clock::time_point last;
+	uint64_t frames {};
+	uint64_t dropped {};
+	/* dropped since the last frame written */
+	uint32_t pending {};
+};
+
+#endif /* recorder_hh */
@@ -0,0 +1,80 @@
+#ifndef rtt_hh
+#define rtt_hh
+
+#include "bdm.hh"
+#include "elf.hh"
+
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+/*
+ * Target resident log channels, SEGGER RTT compatible layout, all
+ * fields are big endian (target native).
+ *
+ * Control block, 24 + 24 * (max_up + max_down) bytes
+ *   0x00  char     id[16]      "SEGGER RTT", 0 padded
+ *   0x10  uint32_t max_up      number of up (target to host) rings
+ *   0x14  uint32_t max_down    number of down (host to target) rings
+ *   0x18  ring     up[max_up]
+ *         ring     down[max_down]
+ *
+ * Ring, 24 bytes
+ *   0x00  uint32_t name        pointer to a C string, or 0
+ *   0x04  uint32_t buffer      pointer to the data area
+ *   0x08  uint32_t size        data area size
+ *   0x0c  uint32_t wr          write offset, owned by the producer
+ *   0x10  uint32_t rd          read offset, owned by the consumer
+ *   0x14  uint32_t flags       unused by opencf
+ *
+ * A ring is empty when wr == rd and full when (wr + 1) % size == rd.
+ * Up rings: the target copies data, then updates wr, opencf reads data
+ * then updates rd. Down rings work the other way round. The target
+ * must write id last, so that a scan never finds a partially
+ * initialized block.
+ */
+
+static constexpr char rtt_id[] = "SEGGER RTT";
+static constexpr char rtt_symbol[] = "_SEGGER_RTT";
+static constexpr int rtt_hdr_size = 24;
+static constexpr int rtt_ring_size = 24;
+static constexpr int rtt_max_rings = 16;
+
+struct rtt_ring {
+	uint32_t name;
+	uint32_t buffer;
+	uint32_t size;
+	uint32_t wr;
+	uint32_t rd;
+	uint32_t flags;
+};
+
+struct rtt
+{
+	rtt(bdm_ops *b, const elf *e) : bdm(b), img(e) {}
+
+	int locate(const string &where);
+	int scan(uint32_t start, uint32_t size);
+	int run(const string &path, const std::function<int()> &get_key);
+
+private:
+	int read_rings();
+	int poll_up(int ch, FILE *log, int &fill);
+	int write_down(int ch, const char *data, int size);
+	uint32_t ring_addr(bool is_up, int ch);
+
+	bdm_ops *bdm;
+	const elf *img;
+
+	uint32_t cb {};
+	uint32_t max_up {};
+	uint32_t max_down {};
+	vector<rtt_ring> up;
+	vector<rtt_ring> down;
+};
+
+#endif /* rtt_hh */
@@ -0,0 +1,70 @@
+#ifndef semihost_hh
+#define semihost_hh
+
+#include "bdm.hh"
+
+#include <cstdint>
+#include <map>
+
+using std::map;
+
+/*
+ * m68k/ColdFire semihosting, as libgloss and qemu: d0 is the
+ * request, d1 points to the argument block, the trap sequence is
+ *
+ *         nop
+ *         halt
+ *         .long 0x4e7bf000
+ *
+ * longword aligned, the core halts with pc after the halt.
+ */
+enum hosted_requests {
+	HOSTED_EXIT = 0,
+	HOSTED_INIT_SIM = 1,
+	HOSTED_OPEN = 2,
+	HOSTED_CLOSE = 3,
+	HOSTED_READ = 4,
+	HOSTED_WRITE = 5,
+	HOSTED_LSEEK = 6,
+	HOSTED_RENAME = 7,
+	HOSTED_UNLINK = 8,
+	HOSTED_STAT = 9,
+	HOSTED_FSTAT = 10,
+	HOSTED_GETTIMEOFDAY = 11,
+	HOSTED_ISATTY = 12,
+	HOSTED_SYSTEM = 13,
+};
+
+enum sh_result {
+	sh_none,
+	sh_resumed,
+	sh_exit,
+};
+
+struct semihost
+{
+	semihost(bdm_ops *b);
+	~semihost();
+
+	int service();
+	int exit_code() { return code; }
+
+private:
+	bool is_trap(uint32_t pc);
+	void ret(uint32_t args, uint32_t value, int err);
+	int do_request(uint32_t nr, uint32_t args);
+	int do_open(uint32_t *arg, int &err);
+	int do_read(uint32_t *arg, int &err);
+	int do_write(uint32_t *arg, int &err);
+	int64_t do_lseek(uint32_t *arg, int &err);
+	int do_gettimeofday(uint32_t *arg, int &err);
+	int host_fd(uint32_t fd);
+	uint32_t target_errno(int err);
+
+	bdm_ops *bdm;
+	map<uint32_t, int> fds;
+	uint32_t next_fd {3};
+	int code {};
+};
+
+#endif /* semihost_hh */
@@ -0,0 +1,48 @@
+#ifndef speed_hh
+#define speed_hh
+
+#include "bdm.hh"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+/* scratch bytes written per pattern */
+static constexpr int SPEED_SCRATCH = 256;
+/* pattern rounds a divider must pass */
+static constexpr int SPEED_ROUNDS = 3;
+/* cpu registers used when there is no sram scratch, d2-a5 */
+static constexpr int SPEED_REG_FIRST = 2;
+static constexpr int SPEED_REG_LAST = 13;
+
+/*
+ * Bdm clock tuning. Dividers are tried from the slowest, each one
+ * must pass rounds of write/readback patterns on a sram scratch area,
+ * or on cpu registers when there is none. The fastest passing one is
+ * kept, a step slower if a faster one failed, and cached per pod
+ * serial. Communication errors then slow the clock down.
+ */
+struct speed_tuner {
+	speed_tuner(bdm_ops *b) : bdm(b), drv(b->get_driver()) {}
+
+	/* cached, a divider stored for this pod is reused if it passes */
+	int tune(bool cached, uint32_t scratch = 0);
+	int set(int div);
+	void show();
+
+private:
+	int probe(int rounds);
+	int probe_sram(int pattern, int round);
+	int probe_regs(int pattern, int round);
+	int load_cache(const string &serial);
+	void store_cache(const string &serial, int div);
+
+	bdm_ops *bdm;
+	driver *drv;
+	uint32_t base {};
+};
+
+#endif /* speed_hh */
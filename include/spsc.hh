@@ -0,0 +1,49 @@
+#ifndef spsc_hh
+#define spsc_hh
+
+#include <atomic>
+#include <cstddef>
+
+/*
+ * Lock-free single producer, single consumer ring, one slot is
+ * kept free to tell full from empty.
+ */
+template <typename T, size_t N>
+struct spsc_queue {
+	bool push(const T &v) {
+		size_t h = head.load(std::memory_order_relaxed);
+		size_t next = (h + 1) % N;
+
+		if (next == tail.load(std::memory_order_acquire))
+			return false;
+
+		ring[h] = v;
+		head.store(next, std::memory_order_release);
+
+		return true;
+	}
+
+	bool pop(T &v) {
+		size_t t = tail.load(std::memory_order_relaxed);
+
+		if (t == head.load(std::memory_order_acquire))
+			return false;
+
+		v = ring[t];
+		tail.store((t + 1) % N, std::memory_order_release);
+
+		return true;
+	}
+
+	bool empty() const {
+		return head.load(std::memory_order_acquire) ==
+			tail.load(std::memory_order_acquire);
+	}
+
+private:
+	T ring[N];
+	std::atomic<size_t> head {0};
+	std::atomic<size_t> tail {0};
+};
+
+#endif /* spsc_hh */
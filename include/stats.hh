@@ -0,0 +1,91 @@
+#ifndef stats_hh
+#define stats_hh
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+using std::map;
+using std::string;
+
+/*
+ * Log-linear buckets, exact below 2^(HIST_SUB_BITS + 1) ns, then 2^5
+ * sub-buckets per power of two, ~3% precision over the whole range.
+ */
+static constexpr int HIST_SUB_BITS = 5;
+static constexpr int HIST_BUCKETS = (65 - HIST_SUB_BITS) << HIST_SUB_BITS;
+
+struct histogram {
+	void record(uint64_t ns, uint64_t size = 0);
+	/* highest value equivalent to the p-th percentile */
+	uint64_t percentile(double p) const;
+	void reset();
+
+	std::atomic<uint64_t> count {};
+	std::atomic<uint64_t> sum_ns {};
+	std::atomic<uint64_t> max_ns {};
+	std::atomic<uint64_t> bytes {};
+	std::atomic<uint32_t> buckets[HIST_BUCKETS] {};
+};
+
+/*
+ * Session timing, collected only when enabled, by --stats file or
+ * the stats command.
+ */
+struct stats {
+	static stats &get() {
+		static stats s;
+		return s;
+	}
+
+	static bool enabled() {
+		return get().on.load(std::memory_order_relaxed);
+	}
+
+	void enable(bool state) { on = state; }
+	histogram &hist(const string &name);
+	/* pod exchanges per bdm command */
+	histogram &bdm_cmd(uint16_t op);
+	void reset();
+	void report();
+	/* json if path ends by .json, prometheus text otherwise */
+	int dump(const string &path);
+
+private:
+	std::mutex mtx;
+	map<string, histogram> hists;
+	std::atomic<histogram *> cmds[0x1000] {};
+	std::atomic<bool> on {};
+};
+
+/*
+ * Scope timer, the clock is not read when stats are disabled.
+ */
+struct stat_timer {
+	stat_timer(histogram &h) : stat_timer(&h) {}
+	stat_timer(histogram *h) {
+		if (h && stats::enabled()) {
+			hist = h;
+			start = std::chrono::steady_clock::now();
+		}
+	}
+	~stat_timer() {
+		if (hist)
+			hist->record(std::chrono::duration_cast<
+				std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() -
+				start).count(), size);
+	}
+
+	/* bytes moved, for throughput */
+	uint64_t size {};
+
+private:
+	histogram *hist {};
+	std::chrono::steady_clock::time_point start;
+};
+
+#endif /* stats_hh */
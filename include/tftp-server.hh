@@ -0,0 +1,64 @@
+#ifndef tftp_server_hh
+#define tftp_server_hh
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <netinet/in.h>
+
+using std::string;
+
+/*
+ * Read only tftp server, rfc 1350, with blksize (rfc 2348), tsize
+ * (rfc 2349) and windowsize (rfc 7440) options. Files are mmapped
+ * and sent from the mapping, each transfer runs on its own thread.
+ */
+static constexpr int tftp_def_blksize = 512;
+static constexpr int tftp_max_blksize = 65464;
+static constexpr int tftp_retries = 5;
+/* boards on the lan fetch from it */
+static constexpr char tftp_def_bind[] = "0.0.0.0";
+
+/* rfc 2347 option names */
+enum tftp_option {
+	TFTP_OPT_BLKSIZE = 1 << 0,
+	TFTP_OPT_WINDOWSIZE = 1 << 1,
+	TFTP_OPT_TIMEOUT = 1 << 2,
+	TFTP_OPT_TSIZE = 1 << 3,
+};
+
+struct tftp_xfer {
+	struct sockaddr_in peer;
+	string file;
+	int blksize;
+	int window;
+	int timeout;
+	/* accepted options, the only ones in the oack */
+	int options;
+};
+
+struct tftp_server
+{
+	tftp_server(const string &path) : root(path) {}
+	~tftp_server();
+
+	int start(const string &bind, int port);
+	void stop();
+
+private:
+	void serve();
+	void request(const char *pkt, int len, struct sockaddr_in &peer);
+	void transfer(tftp_xfer x);
+	int send_file(int fd, tftp_xfer &x, const uint8_t *data, size_t size);
+	int wait_ack(int fd, int timeout, uint16_t &block);
+	void send_error(int fd, struct sockaddr_in *peer, int code,
+			const char *msg);
+
+	string root;
+	int sfd {-1};
+	std::thread th;
+	std::atomic<bool> quit {};
+	std::atomic<int> active {};
+};
+
+#endif /* tftp_server_hh */
@@ -14,6 +14,17 @@
 #define ANSI_BOLD		"\x1b[1m"
 
 namespace trace {
+enum log_level {
+	ll_err,
+	ll_wrn,
+	ll_info,
+	ll_dbg,
+};
+
+/* plain messages by level, replacing the colored stdout output */
+typedef void (*log_sink)(int level, const char *msg, void *ctx);
+
+void set_sink(log_sink fn, void *ctx);
 void log(const char *color, const char *format, va_list args);
 void log_ansi(const char *code, const char *format, ...);
 void log_imp(const char *format, ...);
@@ -9,7 +9,8 @@ using namespace std;
 namespace utils {
 uint16_t ntohs(uint16_t val);
 uint32_t ntohl(uint32_t val);
-unsigned int str_to_bin(string &str);
+unsigned int str_to_bin(const string &str);
+string cache_path(const string &name);
 }
 
 #endif /* utils_hh */
@@ -21,11 +21,25 @@
 #include "bdm.hh"
 #include "utils.hh"
 #include "driver-core.hh"
+#include "stats.hh"
+#include "trace.hh"
 
+#include <chrono>
 #include <cstring>
+#include <memory>
 #include <unistd.h>
+#include <vector>
+#include <algorithm>
 
+using namespace trace;
 using namespace utils;
+using namespace std::chrono;
+
+static constexpr int halt_poll_us = 10000;
+static constexpr int ready_poll_us = 1000;
+static constexpr int reset_timeout_ms = 1000;
+/* pc reads of a core not known to be halted */
+static constexpr int state_samples = 4;
 
 bdm_ops::bdm_ops(driver *current_driver) : drv(current_driver)
 {
@@ -33,11 +47,104 @@ bdm_ops::bdm_ops(driver *current_driver) : drv(current_driver)
 
 void bdm_ops::reset(bool state)
 {
+	static histogram &h = stats::get().hist("bdm.reset");
+	stat_timer t(h);
+
 	drv->send_reset(state);
 }
 
+/*
+ * Poll CSR until any of the mask bits is set, or until the bdm
+ * answers for a null mask. The last CSR read is returned, also on
+ * timeout.
+ */
+uint32_t bdm_ops::poll_csr(uint32_t mask, int timeout_ms)
+{
+	steady_clock::time_point end = steady_clock::now() +
+				       milliseconds(timeout_ms);
+	uint32_t csr;
+
+	for (;;) {
+		csr = read_dm_reg(BDM_REG_CSR);
+		if (csr != 0xffffffff && (!mask || (csr & mask)))
+			return csr;
+
+		if (steady_clock::now() > end)
+			return csr;
+
+		usleep(ready_poll_us);
+	}
+}
+
+/*
+ * Reset pulse, the usb exchanges are longer than the minimum reset
+ * assertion. The core then halts out of reset, as soon as it does
+ * the CSR is returned, 0xffffffff if the bdm never answers.
+ */
+uint32_t bdm_ops::reset_target()
+{
+	uint32_t csr;
+
+	reset(true);
+	reset(false);
+
+	csr = poll_csr(CSR_HALT | CSR_BPKT, reset_timeout_ms);
+	if (csr != 0xffffffff && !(csr & (CSR_HALT | CSR_BPKT)))
+		log_wrn("core not halted out of reset, csr %08x", csr);
+
+	state = st_halted;
+
+	return csr;
+}
+
+/*
+ * State of a core found as it is, without reset: a halt latched in
+ * csr, or a pc not moving across some reads, is taken as halted.
+ * A core spinning on a single instruction looks halted too, unless
+ * the pod refuses the pc read as not ready.
+ */
+int bdm_ops::sense_state(uint32_t csr)
+{
+	bdm_xfer x;
+	uint32_t pc;
+	int i, err;
+
+	state = st_halted;
+
+	if (((csr >> CSR_BSTAT_SHIFT) & 0xf) == CSR_BSTAT_L1_HIT ||
+	    (csr & (CSR_HALT | CSR_BPKT | CSR_TRG)))
+		return state;
+
+	/*
+	 * pc is only readable halted, a refused read is a running core.
+	 * Pods not reporting the bdm status, pemu ones, are sampled for
+	 * a moving pc.
+	 */
+	fill_ctrl_read(x, crt_pc);
+	err = xfer_batch(&x, 1);
+	if (err == xr_refused) {
+		state = st_running;
+		return state;
+	}
+	if (err)
+		return state;
+
+	pc = ntohl(*(uint32_t *)x.buff);
+	for (i = 0; i < state_samples; ++i) {
+		usleep(ready_poll_us);
+		if (read_ctrl_reg(crt_pc) != pc) {
+			state = st_running;
+			break;
+		}
+	}
+
+	return state;
+}
+
 void bdm_ops::go()
 {
+	static histogram &h = stats::get().hist("bdm.go");
+	stat_timer t(h);
 	int value;
 
 	value = read_dm_reg(BDM_REG_CSR);
@@ -46,169 +153,478 @@ void bdm_ops::go()
 	value |= (CSR_IPI | CSR_EMULATION);
 	write_dm_reg(BDM_REG_CSR, value);
 
+	stop_csr = 0;
 	drv->send_go();
+	go_csr = drv->get_go_csr();
+	state = st_running;
 }
 
 void bdm_ops::halt()
 {
+	static histogram &h = stats::get().hist("bdm.halt");
+	stat_timer t(h);
+
 	drv->send_halt();
 	state = st_halted;
 }
 
-uint32_t bdm_ops::read_dm_reg(uint8_t reg)
+/*
+ * Pooled storage of a queued command, back to the pool when its
+ * holder goes, once the pod is done with it. Results not taken do
+ * not leak the storage.
+ */
+struct pooled_xfer {
+	pooled_xfer(object_pool<bdm_xfer> &p, bdm_xfer *b) : pool(p), x(b) {}
+	~pooled_xfer() {
+		if (done.valid())
+			done.wait();
+		pool.put(x);
+	}
+
+	object_pool<bdm_xfer> &pool;
+	bdm_xfer *x;
+	std::future<int> done;
+};
+
+/*
+ * Queue one command on pooled storage, the reply is decoded when the
+ * result is taken, with the driver status.
+ */
+std::future<bdm_reply> bdm_ops::submit(bdm_xfer *x)
 {
-	memset(buff, 0, 2);
+	auto slot = std::make_unique<pooled_xfer>(pool, x);
 
-	*(uint16_t *)&buff[0] = ntohs(CMD_BDMCF_RDMREG | reg);
+	slot->done = drv->xfer_bdm_async(x);
 
-	drv->xfer_bdm_data(buff, 2);
+	return std::async(std::launch::deferred,
+		[s = std::move(slot)] {
+			bdm_reply r;
 
-	return ntohl(*(uint32_t *)buff);
+			r.status = s->done.get();
+			r.value = ntohl(*(uint32_t *)s->x->buff);
+
+			return r;
+		});
 }
 
-uint32_t bdm_ops::write_dm_reg(uint8_t reg, uint32_t value)
+std::future<bdm_reply> bdm_ops::read_dm_reg_async(uint8_t reg)
 {
-	memset(buff, 0, 6);
+	bdm_xfer *x = pool.get();
 
-	*(uint16_t *)&buff[0] = ntohs(CMD_BDMCF_WDMREG | reg);
-	*(uint32_t *)&buff[2] = ntohl(value);
+	fill_dm_read(*x, reg);
 
-	drv->xfer_bdm_data(buff, 6);
+	return submit(x);
+}
+
+std::future<bdm_reply> bdm_ops::write_dm_reg_async(uint8_t reg,
+						  uint32_t value)
+{
+	bdm_xfer *x = pool.get();
+
+	fill_dm_write(*x, reg, value);
 
-	return ntohl(*(uint32_t *)buff);
+	return submit(x);
 }
 
-uint32_t bdm_ops::read_ad_reg(uint8_t reg)
+std::future<bdm_reply> bdm_ops::read_ad_reg_async(uint8_t reg)
 {
-	memset(buff, 0, 2);
+	bdm_xfer *x = pool.get();
+
+	fill_ad_read(*x, reg);
 
-	*(uint16_t *)&buff[0] = ntohs(CMD_BDMCF_RDAREG | reg);
+	return submit(x);
+}
 
-	drv->xfer_bdm_data(buff, 2);
+std::future<bdm_reply> bdm_ops::write_ad_reg_async(uint8_t reg,
+						  uint32_t value)
+{
+	bdm_xfer *x = pool.get();
 
-	return ntohl(*(uint32_t *)buff);
+	fill_ad_write(*x, reg, value);
+
+	return submit(x);
 }
 
-uint32_t bdm_ops::write_ad_reg(uint8_t reg, uint32_t value)
+std::future<bdm_reply> bdm_ops::read_mem_async(uint32_t address, int size)
 {
-	memset(buff, 0, 6);
+	bdm_xfer *x = pool.get();
+
+	fill_mem_read(*x, address, size);
+
+	return submit(x);
+}
 
-	*(uint16_t *)&buff[0] = ntohs(CMD_BDMCF_WDAREG | reg);
-	*(uint32_t *)&buff[2] = ntohl(value);
+std::future<bdm_reply> bdm_ops::write_mem_async(uint32_t address, int size,
+					       uint32_t value)
+{
+	bdm_xfer *x = pool.get();
 
-	drv->xfer_bdm_data(buff, 6);
+	fill_mem_write(*x, address, size, value);
 
-	return ntohl(*(uint32_t *)buff);;
+	return submit(x);
 }
 
-uint32_t bdm_ops::read_mem_byte(uint32_t address)
+std::future<bdm_reply> bdm_ops::read_ctrl_reg_async(cr_type type)
 {
-	memset(buff, 0, 6);
+	bdm_xfer *x = pool.get();
+
+	fill_ctrl_read(*x, type);
 
-	*(uint16_t *)&buff[0] = ntohs(CMD_BDMCF_RD_MEM_B);
-	*(uint32_t *)&buff[2] = ntohl(address);
+	return submit(x);
+}
+
+std::future<bdm_reply> bdm_ops::write_ctrl_reg_async(cr_type type,
+						    uint32_t value)
+{
+	bdm_xfer *x = pool.get();
 
-	drv->xfer_bdm_data(buff, 6);
+	fill_ctrl_write(*x, type, value);
 
-	return ntohl(*(uint32_t *)buff);
+	return submit(x);
 }
 
-uint32_t bdm_ops::read_mem_word(uint32_t address)
+uint32_t bdm_ops::read_dm_reg(uint8_t reg)
+{
+	static histogram &h = stats::get().hist("bdm.read_dm_reg");
+	stat_timer t(h);
+
+	return read_dm_reg_async(reg).get().value;
+}
+
+uint32_t bdm_ops::write_dm_reg(uint8_t reg, uint32_t value)
+{
+	static histogram &h = stats::get().hist("bdm.write_dm_reg");
+	stat_timer t(h);
+
+	return write_dm_reg_async(reg, value).get().status;
+}
+
+uint32_t bdm_ops::read_ad_reg(uint8_t reg)
+{
+	static histogram &h = stats::get().hist("bdm.read_ad_reg");
+	stat_timer t(h);
+
+	return read_ad_reg_async(reg).get().value;
+}
+
+uint32_t bdm_ops::write_ad_reg(uint8_t reg, uint32_t value)
+{
+	static histogram &h = stats::get().hist("bdm.write_ad_reg");
+	stat_timer t(h);
+
+	return write_ad_reg_async(reg, value).get().status;
+}
+
+uint32_t bdm_ops::read_mem_byte(uint32_t address)
 {
-	memset(buff, 0, 6);
+	static histogram &h = stats::get().hist("bdm.read_mem_byte");
+	stat_timer t(h);
 
-	*(uint16_t *)&buff[0] = ntohs(CMD_BDMCF_RD_MEM_W);
-	*(uint32_t *)&buff[2] = ntohl(address);
+	return read_mem_async(address, 1).get().value;
+}
 
-	drv->xfer_bdm_data(buff, 6);
+uint32_t bdm_ops::read_mem_word(uint32_t address)
+{
+	static histogram &h = stats::get().hist("bdm.read_mem_word");
+	stat_timer t(h);
 
-	return ntohl(*(uint32_t *)buff);
+	return read_mem_async(address, 2).get().value;
 }
 
 uint32_t bdm_ops::read_mem_long(uint32_t address)
 {
-	memset(buff, 0, 6);
+	static histogram &h = stats::get().hist("bdm.read_mem_long");
+	stat_timer t(h);
 
-	*(uint16_t *)&buff[0] = ntohs(CMD_BDMCF_RD_MEM_L);
-	*(uint32_t *)&buff[2] = ntohl(address);
+	return read_mem_async(address, 4).get().value;
+}
 
-	drv->xfer_bdm_data(buff, 6);
+void bdm_ops::fill_dm_read(bdm_xfer &x, uint8_t reg)
+{
+	memset(x.buff, 0, 2);
+	*(uint16_t *)&x.buff[0] = ntohs(CMD_BDMCF_RDMREG | reg);
+	x.len = 2;
+}
 
-	return ntohl(*(uint32_t *)buff);
+void bdm_ops::fill_dm_write(bdm_xfer &x, uint8_t reg, uint32_t value)
+{
+	memset(x.buff, 0, 6);
+	*(uint16_t *)&x.buff[0] = ntohs(CMD_BDMCF_WDMREG | reg);
+	*(uint32_t *)&x.buff[2] = ntohl(value);
+	x.len = 6;
 }
 
-uint32_t bdm_ops::write_mem_byte(uint32_t address, uint8_t value)
+void bdm_ops::fill_mem_read(bdm_xfer &x, uint32_t address, int size)
+{
+	uint16_t cmd;
+
+	switch (size) {
+	case 1:
+		cmd = CMD_BDMCF_RD_MEM_B;
+		break;
+	case 2:
+		cmd = CMD_BDMCF_RD_MEM_W;
+		break;
+	default:
+		cmd = CMD_BDMCF_RD_MEM_L;
+		break;
+	}
+
+	memset(x.buff, 0, 6);
+	*(uint16_t *)&x.buff[0] = ntohs(cmd);
+	*(uint32_t *)&x.buff[2] = ntohl(address);
+	x.len = 6;
+}
+
+/*
+ * Next location after a read or dump of the same size, address
+ * incremented by the debug module.
+ */
+void bdm_ops::fill_mem_dump(bdm_xfer &x, int size)
+{
+	uint16_t cmd;
+
+	switch (size) {
+	case 1:
+		cmd = CMD_BDMCF_DUMP_B;
+		break;
+	case 2:
+		cmd = CMD_BDMCF_DUMP_W;
+		break;
+	default:
+		cmd = CMD_BDMCF_DUMP_L;
+		break;
+	}
+
+	memset(x.buff, 0, 2);
+	*(uint16_t *)&x.buff[0] = ntohs(cmd);
+	x.len = 2;
+}
+
+/*
+ * Write, long values are 32 bit, byte and word values 16 bit,
+ * 10 bytes are always sent.
+ */
+void bdm_ops::fill_mem_write(bdm_xfer &x, uint32_t address, int size,
+			     uint32_t value)
+{
+	memset(x.buff, 0, 10);
+
+	switch (size) {
+	case 1:
+		*(uint16_t *)&x.buff[0] = ntohs(CMD_BDMCF_WR_MEM_B);
+		*(uint16_t *)&x.buff[6] = ntohs(value & 0xff);
+		break;
+	case 2:
+		*(uint16_t *)&x.buff[0] = ntohs(CMD_BDMCF_WR_MEM_W);
+		*(uint16_t *)&x.buff[6] = ntohs(value);
+		break;
+	default:
+		*(uint16_t *)&x.buff[0] = ntohs(CMD_BDMCF_WR_MEM_L);
+		*(uint32_t *)&x.buff[6] = ntohl(value);
+		break;
+	}
+
+	*(uint32_t *)&x.buff[2] = ntohl(address);
+	x.len = 10;
+}
+
+void bdm_ops::fill_ad_read(bdm_xfer &x, uint8_t reg)
+{
+	memset(x.buff, 0, 2);
+	*(uint16_t *)&x.buff[0] = ntohs(CMD_BDMCF_RDAREG | reg);
+	x.len = 2;
+}
+
+void bdm_ops::fill_ad_write(bdm_xfer &x, uint8_t reg, uint32_t value)
+{
+	memset(x.buff, 0, 6);
+	*(uint16_t *)&x.buff[0] = ntohs(CMD_BDMCF_WDAREG | reg);
+	*(uint32_t *)&x.buff[2] = ntohl(value);
+	x.len = 6;
+}
+
+void bdm_ops::fill_ctrl_read(bdm_xfer &x, cr_type type)
+{
+	memset(x.buff, 0, 6);
+	*(uint16_t *)&x.buff[0] = ntohs(CMD_BDMCF_RCREG);
+	*(uint32_t *)&x.buff[2] = ntohl(type);
+	x.len = 6;
+}
+
+void bdm_ops::fill_ctrl_write(bdm_xfer &x, cr_type type, uint32_t value)
 {
-	memset(buff, 0, 10);
+	memset(x.buff, 0, 10);
+	*(uint16_t *)&x.buff[0] = ntohs(CMD_BDMCF_WCREG);
+	*(uint32_t *)&x.buff[2] = ntohl(type);
+	*(uint32_t *)&x.buff[6] = ntohl(value);
+	x.len = 10;
+}
 
-	*(uint16_t *)&buff[0] = ntohs(CMD_BDMCF_WR_MEM_B);
-	*(uint32_t *)&buff[2] = ntohl(address);
+int bdm_ops::xfer_batch(bdm_xfer *xfers, int count)
+{
+	static histogram &h = stats::get().hist("bdm.xfer_batch");
+	stat_timer t(h);
 
-	/* heh, pemu wants a 16 bit value here, and 10 total to send */
-	*(uint16_t *)&buff[6] = ntohs(value);
+	return drv->xfer_bdm_batch(xfers, count);
+}
 
-	drv->xfer_bdm_data(buff, 10);
+/*
+ * Read a set of unrelated locations, handed to the driver as
+ * one batch. Values are returned right aligned.
+ */
+int bdm_ops::read_mem_batch(mem_access *acc, int count)
+{
+	static histogram &h = stats::get().hist("bdm.read_mem_batch");
+	stat_timer t(h);
+	std::vector<bdm_xfer> xfers(count);
+	uint32_t rval;
+	int i;
+
+	for (i = 0; i < count; ++i)
+		fill_mem_read(xfers[i], acc[i].addr, acc[i].size);
+
+	if (drv->xfer_bdm_batch(xfers.data(), count))
+		return -1;
+
+	for (i = 0; i < count; ++i) {
+		rval = ntohl(*(uint32_t *)xfers[i].buff);
+
+		switch (acc[i].size) {
+		case 1:
+			acc[i].value = (rval >> 16) & 0xff;
+			break;
+		case 2:
+			acc[i].value = (rval >> 16) & 0xffff;
+			break;
+		default:
+			acc[i].value = rval;
+			break;
+		}
+	}
 
 	return 0;
 }
 
-uint32_t bdm_ops::write_mem_word(uint32_t address, uint16_t value)
+/*
+ * Bulk read, a READ followed by DUMPs (address auto-incremented by
+ * the debug module), unaligned head and tail are read by bytes.
+ */
+int bdm_ops::read_block(uint32_t address, uint8_t *data, uint32_t size)
 {
-	memset(buff, 0, 10);
+	static histogram &h = stats::get().hist("bdm.read_block");
+	stat_timer t(h);
+	std::vector<bdm_xfer> xfers;
+	uint32_t rval;
+	int i, longs;
+
+	t.size = size;
+
+	while (size && (address & 3)) {
+		*data++ = (read_mem_byte(address++) >> 16) & 0xff;
+		size--;
+	}
+
+	xfers.resize(std::min<uint32_t>(size / 4, max_dump_batch));
 
-	*(uint16_t *)&buff[0] = ntohs(CMD_BDMCF_WR_MEM_W);
-	*(uint32_t *)&buff[2] = ntohl(address);
+	while (size >= 4) {
+		longs = std::min<uint32_t>(size / 4, max_dump_batch);
 
-	/* heh, pemu wants a 16 bit value here, and 10 total to send */
-	*(uint16_t *)&buff[6] = ntohs(value);
+		fill_mem_read(xfers[0], address, 4);
+		for (i = 1; i < longs; ++i)
+			fill_mem_dump(xfers[i], 4);
 
-	drv->xfer_bdm_data(buff, 10);
+		if (drv->xfer_bdm_batch(xfers.data(), longs))
+			return -1;
+
+		for (i = 0; i < longs; ++i) {
+			rval = ntohl(*(uint32_t *)xfers[i].buff);
+			*data++ = rval >> 24;
+			*data++ = rval >> 16;
+			*data++ = rval >> 8;
+			*data++ = rval;
+		}
+
+		address += longs * 4;
+		size -= longs * 4;
+	}
+
+	while (size--)
+		*data++ = (read_mem_byte(address++) >> 16) & 0xff;
 
 	return 0;
 }
 
-uint32_t bdm_ops::write_mem_long(uint32_t address, uint32_t value)
+/*
+ * d0-d7, a0-a7, sr, pc and vbr (coldfire.hh order) as one batch.
+ */
+int bdm_ops::read_all_regs(uint32_t *regs)
 {
-	memset(buff, 0, 10);
+	static histogram &h = stats::get().hist("bdm.read_all_regs");
+	stat_timer t(h);
+	static const cr_type ctrl[] = { crt_sr, crt_pc, crt_vbr };
+	bdm_xfer xfers[CF_NUM_REGS];
+	int i;
 
-	*(uint16_t *)&buff[0] = ntohs(CMD_BDMCF_WR_MEM_L);
-	*(uint32_t *)&buff[2] = ntohl(address);
+	for (i = 0; i < CF_PS; ++i)
+		fill_ad_read(xfers[i], i);
 
-	/* heh, pemu wants a 16 bit value here, and 10 total to send */
-	*(uint16_t *)&buff[6] = ntohl(value);
+	for (; i < CF_NUM_REGS; ++i)
+		fill_ctrl_read(xfers[i], ctrl[i - CF_PS]);
 
-	drv->xfer_bdm_data(buff, 10);
+	if (drv->xfer_bdm_batch(xfers, CF_NUM_REGS))
+		return -1;
+
+	for (i = 0; i < CF_NUM_REGS; ++i)
+		regs[i] = ntohl(*(uint32_t *)xfers[i].buff);
 
 	return 0;
 }
 
-uint32_t bdm_ops::read_ctrl_reg(cr_type type)
+uint32_t bdm_ops::write_mem_byte(uint32_t address, uint8_t value)
 {
-	memset(buff, 0, 6);
+	static histogram &h = stats::get().hist("bdm.write_mem_byte");
+	stat_timer t(h);
 
-	*(uint16_t *)&buff[0] = ntohs(CMD_BDMCF_RCREG);
-	*(uint32_t *)&buff[2] = ntohl(type);
+	return write_mem_async(address, 1, value).get().status;
+}
 
-	drv->xfer_bdm_data(buff, 6);
+uint32_t bdm_ops::write_mem_word(uint32_t address, uint16_t value)
+{
+	static histogram &h = stats::get().hist("bdm.write_mem_word");
+	stat_timer t(h);
 
-	return ntohl(*(uint32_t *)buff);
+	return write_mem_async(address, 2, value).get().status;
 }
 
-uint32_t bdm_ops::write_ctrl_reg(cr_type type, uint32_t value)
+uint32_t bdm_ops::write_mem_long(uint32_t address, uint32_t value)
 {
-	memset(buff, 0, 10);
+	static histogram &h = stats::get().hist("bdm.write_mem_long");
+	stat_timer t(h);
 
-	*(uint16_t *)&buff[0] = ntohs(CMD_BDMCF_WCREG);
-	*(uint32_t *)&buff[2] = ntohl(type);
-	*(uint32_t *)&buff[6] = ntohl(value);
+	return write_mem_async(address, 4, value).get().status;
+}
 
-	drv->xfer_bdm_data(buff, 10);
+uint32_t bdm_ops::read_ctrl_reg(cr_type type)
+{
+	static histogram &h = stats::get().hist("bdm.read_ctrl_reg");
+	stat_timer t(h);
 
-	return 0;
+	return read_ctrl_reg_async(type).get().value;
+}
+
+uint32_t bdm_ops::write_ctrl_reg(cr_type type, uint32_t value)
+{
+	static histogram &h = stats::get().hist("bdm.write_ctrl_reg");
+	stat_timer t(h);
+
+	return write_ctrl_reg_async(type, value).get().status;
 }
 
 uint32_t bdm_ops::step()
 {
+	static histogram &h = stats::get().hist("bdm.step");
+	stat_timer t(h);
 	int value;
 	uint32_t rval;
 
@@ -224,6 +640,7 @@ uint32_t bdm_ops::step()
 		state = st_step;
 		/* FALLTROUGH */
 	case st_step:
+		stop_csr = 0;
 		drv->send_go();
 		rval = read_ctrl_reg(crt_pc);
 		break;
@@ -236,6 +653,186 @@ uint32_t bdm_ops::step()
 	return rval;
 }
 
+/*
+ * Length of a JSR/BSR at pc, 0 if opcode is not a subroutine call.
+ */
+int bdm_ops::call_insn_len(uint16_t opcode)
+{
+	if ((opcode & 0xff00) == 0x6100) {
+		/* bsr.b, bsr.w, bsr.l */
+		switch (opcode & 0xff) {
+		case 0x00:
+			return 4;
+		case 0xff:
+			return 6;
+		default:
+			return 2;
+		}
+	}
+
+	if ((opcode & 0xffc0) == 0x4e80) {
+		/* jsr <ea> */
+		switch ((opcode >> 3) & 7) {
+		case 2:
+			return 2;
+		case 5:
+		case 6:
+			return 4;
+		case 7:
+			return ((opcode & 7) == 1) ? 6 : 4;
+		default:
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Level 1 trigger, pc and address conditions are enabled
+ * independently, the core halts on the first one met.
+ */
+void bdm_ops::write_tdr()
+{
+	if (tdr)
+		write_dm_reg(BDM_REG_TDR, TDR_TRC_HALT | TDR_L1EBL | tdr);
+	else
+		write_dm_reg(BDM_REG_TDR, 0);
+}
+
+int bdm_ops::set_pc_breakpoint(uint32_t address)
+{
+	write_dm_reg(BDM_REG_PBR, address);
+	/* all pc bits compared */
+	write_dm_reg(BDM_REG_PBMR, 0);
+
+	tdr |= TDR_L1EPC;
+	write_tdr();
+
+	return 0;
+}
+
+void bdm_ops::clear_pc_breakpoint()
+{
+	tdr &= ~TDR_L1EPC;
+	write_tdr();
+}
+
+/*
+ * Inclusive address range breakpoint, on reads, writes or both.
+ */
+int bdm_ops::set_watchpoint(uint32_t address, uint32_t size, int type)
+{
+	uint32_t aatr = AATR_IGNORE;
+
+	if (!size)
+		return -1;
+
+	if (type == wt_read)
+		aatr |= AATR_R;
+	else if (type == wt_access)
+		aatr |= AATR_RM;
+
+	write_dm_reg(BDM_REG_ABLR, address);
+	write_dm_reg(BDM_REG_ABHR, address + size - 1);
+	write_dm_reg(BDM_REG_AATR, aatr);
+
+	tdr |= TDR_L1EAR;
+	write_tdr();
+
+	return 0;
+}
+
+void bdm_ops::clear_watchpoint()
+{
+	tdr &= ~TDR_L1EAR;
+	write_tdr();
+}
+
+void bdm_ops::clear_breakpoints()
+{
+	tdr = 0;
+	write_tdr();
+}
+
+/*
+ * One CSR read, true if the core stopped since go. Status bits
+ * cleared by the CSR read the pod issues right after go are taken
+ * from that read.
+ */
+bool bdm_ops::poll_halted()
+{
+	uint32_t csr;
+
+	csr = read_dm_reg(BDM_REG_CSR) | go_csr;
+	go_csr = 0;
+
+	if (((csr >> CSR_BSTAT_SHIFT) & 0xf) == CSR_BSTAT_L1_HIT ||
+	    (csr & (CSR_HALT | CSR_BPKT | CSR_TRG))) {
+		state = st_halted;
+		stop_csr = csr;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Poll CSR until the core stops.
+ */
+int bdm_ops::wait_halted(const std::function<bool()> &cancel)
+{
+	for (;;) {
+		if (poll_halted())
+			return 0;
+
+		if (cancel && cancel())
+			return 1;
+
+		usleep(halt_poll_us);
+	}
+}
+
+/*
+ * Run at full speed up to address, a temporary pc breakpoint is used,
+ * so the pod traffic does not depend on the code executed meanwhile.
+ */
+uint32_t bdm_ops::run_to(uint32_t address, const std::function<bool()> &cancel)
+{
+	if (state == st_running)
+		return -1;
+
+	set_pc_breakpoint(address);
+	go();
+	state = st_running;
+
+	if (wait_halted(cancel))
+		halt();
+
+	clear_pc_breakpoint();
+
+	return read_ctrl_reg(crt_pc);
+}
+
+/*
+ * Step over subroutine calls.
+ */
+uint32_t bdm_ops::next(const std::function<bool()> &cancel)
+{
+	uint32_t pc;
+	int len;
+
+	if (state == st_running)
+		return -1;
+
+	pc = read_ctrl_reg(crt_pc);
+	len = call_insn_len(read_mem_word(pc) >> 16);
+	if (!len)
+		return step();
+
+	return run_to(pc + len, cancel);
+}
+
 /*
  * Write a memory buffer to a specific location
  *
@@ -245,5 +842,70 @@ uint32_t bdm_ops::step()
  */
 int bdm_ops::load_segment(uint8_t *data, uint32_t dest, uint32_t size)
 {
+	static histogram &h = stats::get().hist("bdm.load_segment");
+	stat_timer t(h);
+
+	t.size = size;
+
 	return drv->send_big_block(data, dest, size);
 }
+
+/*
+ * Segment load read back at once and compared per chunk, only the
+ * differing chunks are written again, at most verify_retries times.
+ */
+int bdm_ops::load_verified(uint8_t *data, uint32_t dest, uint32_t size)
+{
+	static histogram &h = stats::get().hist("bdm.load_verified");
+	stat_timer t(h);
+	std::vector<uint8_t> buf(size);
+	std::vector<uint32_t> bad, next;
+	uint32_t ofs, len;
+	bool read;
+	int retry;
+
+	t.size = size;
+
+	if (load_segment(data, dest, size))
+		return -1;
+
+	/* the whole segment at first, in as few batches as possible */
+	read = !read_block(dest, buf.data(), size);
+
+	for (ofs = 0; ofs < size; ofs += verify_chunk) {
+		len = std::min(verify_chunk, size - ofs);
+		if (!read || memcmp(buf.data() + ofs, data + ofs, len))
+			bad.push_back(ofs);
+	}
+
+	for (retry = 0; !bad.empty() && retry < verify_retries; ++retry) {
+		log_wrn("%zu chunks at %08x differ, writing them again",
+			bad.size(), dest + bad[0]);
+
+		next.clear();
+		for (uint32_t o : bad) {
+			len = std::min(verify_chunk, size - o);
+			if (load_segment(data + o, dest + o, len))
+				return -1;
+			if (read_block(dest + o, buf.data(), len) ||
+			    memcmp(buf.data(), data + o, len))
+				next.push_back(o);
+		}
+		bad.swap(next);
+	}
+
+	if (bad.empty())
+		return 0;
+
+	log_err("verify failed, chunk at %08x", dest + bad[0]);
+
+	return -1;
+}
+
+/*
+ * Progress of segment loads, returning false aborts the load.
+ */
+void bdm_ops::set_progress(const std::function<bool(int)> &fn)
+{
+	drv->set_chunk_hook(fn);
+}
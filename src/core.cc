@@ -22,17 +22,29 @@
 #include "bdm.hh"
 #include "coldfire.hh"
 #include "parser.hh"
+#include "gdb-server.hh"
+#include "daemon.hh"
+#include "gang.hh"
+#include "pod-server.hh"
+#include "tftp-server.hh"
+#include "speed.hh"
+#include "profile.hh"
+#include "getopts.hh"
 #include "trace.hh"
 
-#include <unistd.h>
 #include <cstring>
 #include <cmath>
 
 using namespace trace;
 
 static constexpr uint32_t test_pattern = 0x12345678;
+static constexpr int ready_timeout_ms = 1000;
 
-core::core() : bdm(0)
+core::core() : drv(0), bdm(0)
+{
+}
+
+core::core(driver *d) : drv(d), bdm(0)
 {
 }
 
@@ -47,13 +59,12 @@ int core::get_cpu_info()
 	cpu_info cpu;
 	char isa[3] = {0};
 	char sram_size[16] = {"0"};
+	char desc[80];
 
 	memset(&cpu, 0, sizeof(cpu));
 
-	cpu.d0.reg = bdm->read_ad_reg(CF_D0);
-	cpu.d1.reg = bdm->read_ad_reg(CF_D1);
-
-	log_dbg("%s() d0 %08x, d1 %08x", __func__, cpu.d0.reg, cpu.d1.reg);
+	cpu.d0.reg = profile.d0_rst;
+	cpu.d1.reg = profile.d1_rst;
 
 	if (cpu.d0.f.magic != 0xcf) {
 		/*
@@ -66,7 +77,8 @@ int core::get_cpu_info()
 		log_dbg("%s() d0 %08x", __func__, cpu.d0.reg);
 
 		if (cpu.d0.reg == test_pattern) {
-			log_imp("found: coldfire, older V2/v3");
+			profile.cpu = "coldfire, older V2/v3";
+			log_imp("found: %s", profile.cpu.c_str());
 			return 0;
 		}
 
@@ -82,7 +94,7 @@ int core::get_cpu_info()
 	else
 		sprintf(sram_size, "%dK", (int)pow(2, cpu.d1.f.sz_sram1) / 4);
 
-	log_imp("found: %s, v.%d, rev.%d, %sisa %s, sram %sB",
+	snprintf(desc, sizeof(desc), "%s, v.%d, rev.%d, %sisa %s, sram %sB",
 		 (cpu.d0.f.magic == 0xcf ? "coldfire" : "unknown"),
 		 cpu.d0.f.version,
 		 cpu.d0.f.revision,
@@ -90,26 +102,99 @@ int core::get_cpu_info()
 		 isa,
 		 sram_size);
 
+	profile.cpu = desc;
+	log_imp("found: %s", desc);
+
 	return 0;
 }
 
+/*
+ * A target already seen on this pod skips the cpu info decoding, its
+ * last setup is applied at once.
+ */
+int core::identify()
+{
+	std::future<bdm_reply> d0 = bdm->read_ad_reg_async(CF_D0);
+	std::future<bdm_reply> d1 = bdm->read_ad_reg_async(CF_D1);
+	profile_cache cache;
+
+	profile.serial = drv->get_serial();
+	profile.d0_rst = d0.get().value;
+	profile.d1_rst = d1.get().value;
+
+	log_dbg("%s() d0 %08x, d1 %08x", __func__, profile.d0_rst,
+		profile.d1_rst);
+
+	known = profile.serial.size() && cache.find(profile);
+	if (known)
+		log_imp("found: %s, profiled", profile.cpu.c_str());
+	else if (get_cpu_info())
+		return -1;
+
+	setup_part();
+
+	return known ? profile.apply(bdm) : 0;
+}
+
+/*
+ * Memory map and cache setup of a part in the database, so loads go
+ * to enabled memories. The profile setup, if any, is applied after.
+ */
+void core::setup_part()
+{
+	const cf_cpu *part = find_part(profile.d0_rst, profile.d1_rst);
+
+	bdm->set_part(part);
+	if (!part) {
+		log_dbg("%s() part not in the database", __func__);
+		return;
+	}
+
+	log_info("part %s", part->name);
+	part->setup(bdm, opts::get().board_map);
+}
+
+/*
+ * Setup of a halted core kept for the next session.
+ */
+void core::save_profile()
+{
+	if (opts::get().attach || profile.serial.empty() ||
+	    bdm->get_state() == st_running)
+		return;
+
+	if (profile.capture(bdm))
+		return;
+
+	profile_cache().store(profile);
+}
+
+/*
+ * With --attach the core is left as it is, cpu info comes from the
+ * reset values of d0 and d1, so it is not read.
+ */
 int core::examine()
 {
 	uint32_t csr;
 
-	bdm->reset(true);
-	usleep(100000);
-	bdm->reset(false);
-	usleep(100000);
-
-	csr = bdm->read_dm_reg(BDM_REG_CSR);
+	if (opts::get().attach)
+		csr = bdm->poll_csr(0, ready_timeout_ms);
+	else
+		csr = bdm->reset_target();
 
 	log_dbg("%s() bdm reg csr %08x", __func__, csr);
 
 	if (csr == 0xffffffff)
 		return -1;
 
-	return get_cpu_info();
+	if (opts::get().attach) {
+		log_imp("attached, core %s",
+			bdm->sense_state(csr) == st_running ?
+			"running" : "halted");
+		return 0;
+	}
+
+	return identify();
 }
 
 int core::get_programmer_info()
@@ -117,17 +202,13 @@ int core::get_programmer_info()
 	return drv->get_programmer_info();
 }
 
-int core::run()
+/*
+ * Programmer and cpu detection, on an already probed pod.
+ */
+int core::attach()
 {
 	int err;
 
-	log_dbg("%s() core running", __func__);
-
-	if (dc.init())
-		return 1;
-
-	drv = dc.get_current_driver();
-
 	bdm = new bdm_ops(drv);
 	if (!bdm) {
 		log_err("cannot create bdm, exiting");
@@ -149,7 +230,90 @@ int core::run()
 		return 1;
 	}
 
+	/* not fatal, the pod default clock is kept */
+	if (opts::get().auto_speed && !(known && profile.clock)) {
+		if (drv->get_bdm_clocks().empty())
+			log_wrn("pod without known clock dividers, "
+				"--auto-speed ignored");
+		else if (bdm->get_state() == st_running)
+			log_wrn("core running, bdm clock not tuned");
+		else
+			speed_tuner(bdm).tune(true);
+	}
+
+	return 0;
+}
+
+int core::run()
+{
+	tftp_server tftp(opts::get().server_path);
+	int err;
+
+	log_dbg("%s() core running", __func__);
+
+	if (opts::get().tftp_port &&
+	    tftp.start(opts::get().tftp_bind.size() ?
+		       opts::get().tftp_bind : tftp_def_bind,
+		       opts::get().tftp_port))
+		return 1;
+
+	if (opts::get().gang_elf.size()) {
+		gang g(dc);
+
+		return g.run(opts::get().gang_elf);
+	}
+
+	if (dc.init())
+		return 1;
+
+	drv = dc.get_current_driver();
+
+	if (opts::get().serve_port) {
+		pod_server ps(drv);
+
+		return ps.run(opts::get().bind.size() ?
+			      opts::get().bind : pod_def_bind,
+			      opts::get().serve_port);
+	}
+
+	if (attach())
+		return 1;
+
+	/*
+	 * Stored once identified, whatever ends the session, then again
+	 * for bars or clock changed by it.
+	 */
+	save_profile();
+
+	err = session();
+	save_profile();
+
+	return err;
+}
+
+int core::session()
+{
+	if (opts::get().gdb_port) {
+		gdb_server gs(bdm);
+
+		return gs.run(opts::get().bind.size() ?
+			      opts::get().bind : gdb_def_bind,
+			      opts::get().gdb_port);
+	}
+
 	parser p(bdm);
 
+	if (opts::get().script_path.size())
+		return p.run_script(opts::get().script_path);
+
+	if (opts::get().commands.size())
+		return p.run_batch(opts::get().commands);
+
+	if (opts::get().daemon_path.size()) {
+		daemon_server d(&p);
+
+		return d.run(opts::get().daemon_path);
+	}
+
 	return p.run();
 }
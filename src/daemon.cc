@@ -0,0 +1,266 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "daemon.hh"
+#include "trace.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace trace;
+
+static constexpr int max_line = 4096;
+
+daemon_server::~daemon_server()
+{
+	for (auto &c : clients)
+		close(c.fd);
+
+	if (lfd >= 0) {
+		close(lfd);
+		unlink(sock_path.c_str());
+	}
+}
+
+static volatile sig_atomic_t terminated;
+
+static void on_terminate(int)
+{
+	terminated = 1;
+}
+
+/*
+ * Long commands stop on a signal, or when the client hangs up or
+ * sends more while waiting.
+ */
+bool daemon_server::stopped()
+{
+	struct pollfd pfd = { serving, POLLIN, 0 };
+
+	if (terminated)
+		return true;
+
+	return serving >= 0 && poll(&pfd, 1, 0) > 0;
+}
+
+/*
+ * Commands write to stdout, which is redirected to the client
+ * for the time of the command.
+ */
+int daemon_server::serve_line(int fd, const string &line)
+{
+	char eot[16];
+	int saved, rval;
+
+	if (line == "exit" || line == "quit")
+		return -1;
+
+	fflush(stdout);
+	cout.flush();
+
+	saved = dup(STDOUT_FILENO);
+	dup2(fd, STDOUT_FILENO);
+
+	serving = fd;
+	rval = prs->execute(line);
+	serving = -1;
+
+	fflush(stdout);
+	cout.flush();
+
+	dup2(saved, STDOUT_FILENO);
+	close(saved);
+
+	snprintf(eot, sizeof(eot), "%c%d\n", daemon_eot, rval);
+	if (send(fd, eot, strlen(eot), MSG_NOSIGNAL) < 0)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Returns -1 when the client is gone.
+ */
+int daemon_server::read_client(daemon_client &c)
+{
+	char buf[max_line];
+	size_t pos;
+	int rd;
+
+	rd = recv(c.fd, buf, sizeof(buf), 0);
+	if (rd <= 0)
+		return -1;
+
+	c.in.append(buf, rd);
+
+	while ((pos = c.in.find('\n')) != string::npos) {
+		string line = c.in.substr(0, pos);
+
+		c.in.erase(0, pos + 1);
+
+		if (serve_line(c.fd, line))
+			return -1;
+	}
+
+	if (c.in.size() > max_line)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Single thread, requests are served one at a time, so they are
+ * serialized on the target, while idle clients do not block others.
+ * SIGTERM and SIGINT return, so captures and stats are written.
+ */
+int daemon_server::run(const string &path)
+{
+	struct sockaddr_un addr;
+	vector<struct pollfd> pfds;
+	struct sigaction sa {};
+	unsigned int i;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	/* no SA_RESTART, poll returns on the signal */
+	sa.sa_handler = on_terminate;
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+
+	lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (lfd < 0) {
+		log_err("cannot create socket");
+		return 1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+	unlink(path.c_str());
+
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(lfd, 16)) {
+		log_err("cannot listen on %s", path.c_str());
+		close(lfd);
+		lfd = -1;
+		return 1;
+	}
+
+	sock_path = path;
+
+	log_info("daemon ready on %s", path.c_str());
+
+	while (!terminated) {
+		pfds.clear();
+		pfds.push_back({ lfd, POLLIN, 0 });
+		for (auto &c : clients)
+			pfds.push_back({ c.fd, POLLIN, 0 });
+
+		if (poll(pfds.data(), pfds.size(), -1) < 0)
+			continue;
+
+		/* clients first, their index matches pfds - 1 */
+		for (i = clients.size(); i > 0; --i) {
+			if (!pfds[i].revents)
+				continue;
+
+			if (read_client(clients[i - 1])) {
+				close(clients[i - 1].fd);
+				clients.erase(clients.begin() + i - 1);
+			}
+		}
+
+		if (pfds[0].revents & POLLIN) {
+			int fd = accept(lfd, NULL, NULL);
+
+			if (fd >= 0)
+				clients.push_back({ fd, "" });
+		}
+	}
+
+	log_info("daemon stopped");
+
+	return 0;
+}
+
+/*
+ * Client side, no pod access. Prints the command output and
+ * returns the command exit code.
+ */
+int daemon_server::client(const string &path, const string &line)
+{
+	struct sockaddr_un addr;
+	char buf[max_line];
+	string req = line + "\n", tail;
+	int fd, rd, rval = 1;
+	char *eot;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return 1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		log_err("cannot connect to %s", path.c_str());
+		close(fd);
+		return 1;
+	}
+
+	if (send(fd, req.data(), req.size(), MSG_NOSIGNAL) < 0) {
+		close(fd);
+		return 1;
+	}
+
+	while ((rd = recv(fd, buf, sizeof(buf) - 1, 0)) > 0) {
+		buf[rd] = 0;
+
+		eot = (char *)memchr(buf, daemon_eot, rd);
+		if (!eot) {
+			fwrite(buf, 1, rd, stdout);
+			continue;
+		}
+
+		fwrite(buf, 1, eot - buf, stdout);
+		tail.append(eot + 1, rd - (eot - buf) - 1);
+
+		/* exit code line may be split */
+		while (tail.find('\n') == string::npos &&
+		       (rd = recv(fd, buf, sizeof(buf), 0)) > 0)
+			tail.append(buf, rd);
+
+		rval = atoi(tail.c_str());
+		break;
+	}
+
+	fflush(stdout);
+	close(fd);
+
+	return rval;
+}
@@ -0,0 +1,199 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "driver-async.hh"
+#include "trace.hh"
+
+using namespace trace;
+
+driver_async::driver_async(driver *d) : inner(d)
+{
+	/*
+	 * Urgent requests run between the exchanges of a batch or a big
+	 * block in progress, a single exchange is not interrupted.
+	 */
+	inner->set_yield_hook([this] {
+		async_req *r;
+
+		while (urgent.pop(r))
+			execute(r);
+	});
+	inner->set_chunk_hook([this](int size) {
+		return on_chunk ? on_chunk(size) : true;
+	});
+
+	io = std::thread(&driver_async::io_loop, this);
+}
+
+driver_async::~driver_async()
+{
+	{
+		std::lock_guard<std::mutex> l(mtx);
+		quit = true;
+	}
+	cv_work.notify_one();
+	io.join();
+
+	delete inner;
+}
+
+void driver_async::execute(async_req *r)
+{
+	r->result.set_value(r->fn());
+	reqs.put(r);
+}
+
+void driver_async::io_loop()
+{
+	async_req *r;
+
+	for (;;) {
+		if (urgent.pop(r) || normal.pop(r)) {
+			execute(r);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> l(mtx);
+
+		cv_work.wait(l, [this] {
+			return quit || !urgent.empty() || !normal.empty();
+		});
+
+		if (quit)
+			break;
+	}
+}
+
+/*
+ * Queue a request, completed by the i/o thread in queue order.
+ */
+std::future<int> driver_async::submit(const std::function<int()> &fn,
+				      bool prio)
+{
+	async_req *r = reqs.get();
+	std::future<int> f;
+	auto &q = prio ? urgent : normal;
+
+	r->fn = fn;
+	r->result = std::promise<int>();
+	f = r->result.get_future();
+
+	{
+		std::lock_guard<std::mutex> l(producer);
+
+		while (!q.push(r))
+			std::this_thread::yield();
+	}
+
+	{
+		/* the i/o thread checks the queues holding it */
+		std::lock_guard<std::mutex> l(mtx);
+	}
+	cv_work.notify_one();
+
+	return f;
+}
+
+int driver_async::call(const std::function<int()> &fn, bool prio)
+{
+	return submit(fn, prio).get();
+}
+
+int driver_async::probe()
+{
+	return call([this] { return inner->probe(); });
+}
+
+int driver_async::get_programmer_info()
+{
+	return call([this] { return inner->get_programmer_info(); });
+}
+
+int driver_async::xfer_bdm_data(char *io_buff, int len)
+{
+	return call([=] { return inner->xfer_bdm_data(io_buff, len); });
+}
+
+int driver_async::xfer_bdm_batch(bdm_xfer *xfers, int count)
+{
+	return call([=] { return inner->xfer_bdm_batch(xfers, count); });
+}
+
+std::future<int> driver_async::xfer_bdm_async(bdm_xfer *xfer)
+{
+	return submit([=] {
+		return inner->xfer_bdm_data(xfer->buff, xfer->len);
+	});
+}
+
+int driver_async::send_big_block(uint8_t *data, uint32_t dest_addr,
+				 int size)
+{
+	return call([=] {
+		return inner->send_big_block(data, dest_addr, size);
+	});
+}
+
+void driver_async::send_reset(bool state)
+{
+	call([=] { inner->send_reset(state); return 0; }, true);
+}
+
+void driver_async::send_go()
+{
+	call([this] {
+		inner->send_go();
+		go_csr = inner->get_go_csr();
+		return 0;
+	});
+}
+
+void driver_async::send_halt()
+{
+	call([this] { inner->send_halt(); return 0; }, true);
+}
+
+vector<int> driver_async::get_bdm_clocks()
+{
+	vector<int> divs;
+
+	call([&] { divs = inner->get_bdm_clocks(); return 0; });
+
+	return divs;
+}
+
+int driver_async::get_bdm_clock()
+{
+	return call([this] { return inner->get_bdm_clock(); });
+}
+
+int driver_async::set_bdm_clock(int div, bool fallback)
+{
+	return call([=] { return inner->set_bdm_clock(div, fallback); });
+}
+
+string driver_async::get_serial()
+{
+	string serial;
+
+	call([&] { serial = inner->get_serial(); return 0; });
+
+	return serial;
+}
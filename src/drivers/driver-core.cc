@@ -19,7 +19,14 @@
  */
 
 #include "driver-core.hh"
+#include "driver-async.hh"
 #include "driver-pemu.hh"
+#include "driver-remote.hh"
+#include "driver-replay.hh"
+#include "driver-iss.hh"
+#include "driver-sim.hh"
+#include "getopts.hh"
+#include "recorder.hh"
 #include "trace.hh"
 
 using namespace trace;
@@ -37,16 +44,56 @@ static struct usb_ids ids[] = {
 	0
 };
 
+/*
+ * Default batch, one pod transaction per command. Drivers able to
+ * queue several bdm commands in one transaction override this.
+ */
+int driver::xfer_bdm_batch(bdm_xfer *xfers, int count)
+{
+	int i, err;
+
+	for (i = 0; i < count; ++i) {
+		if (i && on_yield)
+			on_yield();
+		err = xfer_bdm_data(xfers[i].buff, xfers[i].len);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/*
+ * Default async transfer, completed before returning. Drivers with
+ * their own i/o thread queue it instead.
+ */
+std::future<int> driver::xfer_bdm_async(bdm_xfer *xfer)
+{
+	std::promise<int> p;
+
+	p.set_value(xfer_bdm_data(xfer->buff, xfer->len));
+
+	return p.get_future();
+}
+
 template <typename T> driver *driver_core::create_driver(libusb_device *device)
 { return new T(device); }
 
 driver_core::driver_core() : ctx(0)
 {
 	md["driver_pemu"] = &driver_core::create_driver<driver_pemu>;
+	md["driver_remote"] = &driver_core::create_driver<driver_remote>;
+	md["driver_sim"] = &driver_core::create_driver<driver_sim>;
+	md["driver_iss"] = &driver_core::create_driver<driver_iss>;
+	md["driver_replay"] = &driver_core::create_driver<driver_replay>;
 }
 
 driver_core::~driver_core()
 {
+	delete drv;
+
+	recorder::get().close();
+
 	if (ctx)
 		libusb_exit(ctx);
 }
@@ -90,26 +137,110 @@ exit_detect:
 	return rval;
 }
 
-int driver_core::init()
+driver *driver_core::create(const string &class_name, libusb_device *device)
+{
+	if (md.find(class_name) == md.end())
+		return NULL;
+
+	return (this->*md[class_name])(device);
+}
+
+/*
+ * All supported pods, with their serial number.
+ */
+int driver_core::enumerate_pods(vector<pod_info> &pods)
+{
+	libusb_device **list;
+	libusb_device_handle *h;
+	unsigned char serial[64];
+	int dev_count, i, n;
+
+	dev_count = libusb_get_device_list(ctx, &list);
+
+	for (i = 0; i < dev_count; i++) {
+		struct libusb_device* device = list[i];
+		struct libusb_device_descriptor desc;
+
+		libusb_get_device_descriptor(device, &desc);
+
+		for (n = 0; ids[n].id_vendor; n++) {
+			if (desc.idVendor != ids[n].id_vendor ||
+			    desc.idProduct != ids[n].id_product ||
+			    md.find(ids[n].class_name) == md.end())
+				continue;
+
+			serial[0] = 0;
+			if (libusb_open(device, &h) == 0) {
+				if (libusb_get_string_descriptor_ascii(h,
+					desc.iSerialNumber, serial,
+					sizeof(serial)) < 0)
+					serial[0] = 0;
+				libusb_close(h);
+			}
+
+			pods.push_back({ libusb_ref_device(device),
+					 ids[n].class_name, ids[n].name,
+					 (char *)serial });
+		}
+	}
+
+	libusb_free_device_list(list, 1);
+
+	return pods.size();
+}
+
+int driver_core::init_context()
 {
 	int err;
 
+	if (ctx)
+		return 0;
+
 	err = libusb_init(&ctx);
 	if (err) {
-		log_err("cannot initialize libusb, error %s", err);
+		log_err("cannot initialize libusb, error %d", err);
 		return err;
 	}
 
-	/*
-	 * First stage is detecting usb pod,
-	 * based on it, we select the driver dynamicallt.
-	 */
-	log_info("detecting programmer ...");
+	return 0;
+}
 
-	err = detect_usb_pod();
-	if (err) {
-		log_err("no usb device found, exiting");
-		return err;
+int driver_core::init()
+{
+	int err;
+
+	if (opts::get().remote.size()) {
+		drv = create("driver_remote", NULL);
+
+		return drv->probe();
+	}
+
+	if (opts::get().record.size() &&
+	    recorder::get().open(opts::get().record))
+		return 1;
+
+	if (opts::get().replay.size()) {
+		drv = create("driver_replay", NULL);
+	} else if (opts::get().iss) {
+		drv = create("driver_iss", NULL);
+	} else if (opts::get().sim.size()) {
+		drv = create("driver_sim", NULL);
+	} else {
+		err = init_context();
+		if (err)
+			return err;
+
+		/*
+		 * First stage is detecting usb pod,
+		 * based on it, we select the driver dynamicallt.
+		 */
+		log_info("detecting programmer ...");
+
+		err = detect_usb_pod();
+		if (err) {
+			log_err("no usb device found, exiting");
+			return err;
+		}
 	}
 
 	err = drv->probe();
@@ -118,6 +249,9 @@ int driver_core::init()
 		return err;
 	}
 
+	/* from now on, pod traffic runs on its own thread */
+	drv = new driver_async(drv);
+
 	return 0;
 }
 
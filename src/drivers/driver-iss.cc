@@ -0,0 +1,1262 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "driver-iss.hh"
+#include "bdm.hh"
+#include "coldfire.hh"
+#include "trace.hh"
+
+#include <array>
+
+using namespace trace;
+
+/* instructions per slice, the i/o side is checked every 1024 */
+static constexpr int ISS_SLICE = 1 << 20;
+
+static constexpr uint32_t SR_C = (1 << 0);
+static constexpr uint32_t SR_V = (1 << 1);
+static constexpr uint32_t SR_Z = (1 << 2);
+static constexpr uint32_t SR_N = (1 << 3);
+static constexpr uint32_t SR_X = (1 << 4);
+static constexpr uint32_t SR_S = (1 << 13);
+static constexpr uint32_t SR_T = (1 << 15);
+
+static constexpr uint32_t CRT_OTHER_A7 = 0x800;
+
+enum vectors {
+	VEC_ILLEGAL = 4,
+	VEC_DIVZ = 5,
+	VEC_PRIV = 8,
+	VEC_LINEA = 10,
+	VEC_LINEF = 11,
+	VEC_TRAP = 32,
+};
+
+enum iss_ops : uint8_t {
+	I_ILLEGAL,
+	I_LINEA,
+	I_LINEF,
+	I_ORI,
+	I_ANDI,
+	I_SUBI,
+	I_ADDI,
+	I_EORI,
+	I_CMPI,
+	I_BIT_S,
+	I_BIT_D,
+	I_BITREV,
+	I_BYTEREV,
+	I_FF1,
+	I_MOVE,
+	I_MOVEA,
+	I_NEGX,
+	I_MOVE_FROM_SR,
+	I_STLDSR,
+	I_LEA,
+	I_CLR,
+	I_MOVE_FROM_CCR,
+	I_NEG,
+	I_MOVE_TO_CCR,
+	I_NOT,
+	I_MOVE_TO_SR,
+	I_SWAP,
+	I_PEA,
+	I_EXT,
+	I_MOVEM,
+	I_TST,
+	I_TAS,
+	I_HALT,
+	I_PULSE,
+	I_MULL,
+	I_DIVL,
+	I_TRAP,
+	I_LINK,
+	I_UNLK,
+	I_MOVE_USP,
+	I_NOP,
+	I_STOP,
+	I_RTE,
+	I_RTS,
+	I_MOVEC,
+	I_JSR,
+	I_JMP,
+	I_ADDQ,
+	I_SUBQ,
+	I_SCC,
+	I_TPF,
+	I_BCC,
+	I_MOVEQ,
+	I_OR,
+	I_AND,
+	I_EOR,
+	I_SUB,
+	I_ADD,
+	I_CMP,
+	I_SUBX,
+	I_ADDX,
+	I_SUBA,
+	I_ADDA,
+	I_CMPA,
+	I_DIVW,
+	I_MULW,
+	I_SHIFT,
+	I_CPUSH,
+	I_WDEBUG,
+};
+
+static const int op_size[4] = { 1, 2, 4, 0 };
+
+static constexpr uint8_t decode_0(uint16_t op, int mode)
+{
+	switch (op & 0xfff8) {
+	case 0x00c0:
+		return I_BITREV;
+	case 0x02c0:
+		return I_BYTEREV;
+	case 0x04c0:
+		return I_FF1;
+	case 0x0080:
+		return I_ORI;
+	case 0x0280:
+		return I_ANDI;
+	case 0x0480:
+		return I_SUBI;
+	case 0x0680:
+		return I_ADDI;
+	case 0x0a80:
+		return I_EORI;
+	case 0x0c00:
+	case 0x0c40:
+	case 0x0c80:
+		return I_CMPI;
+	}
+
+	if (mode == 1)
+		return I_ILLEGAL;
+	if ((op & 0xff00) == 0x0800)
+		return I_BIT_S;
+	if (op & 0x0100)
+		return I_BIT_D;
+
+	return I_ILLEGAL;
+}
+
+static constexpr uint8_t decode_4(uint16_t op, int mode)
+{
+	switch (op) {
+	case 0x40e7:
+		return I_STLDSR;
+	case 0x4ac8:
+		return I_HALT;
+	case 0x4acc:
+		return I_PULSE;
+	case 0x4afc:
+		return I_ILLEGAL;
+	case 0x4e71:
+		return I_NOP;
+	case 0x4e72:
+		return I_STOP;
+	case 0x4e73:
+		return I_RTE;
+	case 0x4e75:
+		return I_RTS;
+	case 0x4e7b:
+		return I_MOVEC;
+	}
+
+	switch (op & 0xfff8) {
+	case 0x4080:
+		return I_NEGX;
+	case 0x40c0:
+		return I_MOVE_FROM_SR;
+	case 0x42c0:
+		return I_MOVE_FROM_CCR;
+	case 0x4480:
+		return I_NEG;
+	case 0x4680:
+		return I_NOT;
+	case 0x4840:
+		return I_SWAP;
+	case 0x4880:
+	case 0x48c0:
+	case 0x49c0:
+		return I_EXT;
+	case 0x4e50:
+		return I_LINK;
+	case 0x4e58:
+		return I_UNLK;
+	case 0x4e60:
+	case 0x4e68:
+		return I_MOVE_USP;
+	}
+
+	if ((op & 0xfff0) == 0x4e40)
+		return I_TRAP;
+	if ((op & 0xf1c0) == 0x41c0 && mode >= 2)
+		return I_LEA;
+
+	switch (op & 0xffc0) {
+	case 0x44c0:
+		return I_MOVE_TO_CCR;
+	case 0x46c0:
+		return I_MOVE_TO_SR;
+	case 0x4840:
+		return mode >= 2 ? I_PEA : I_ILLEGAL;
+	case 0x48c0:
+	case 0x4cc0:
+		return (mode == 2 || mode == 5) ? I_MOVEM : I_ILLEGAL;
+	case 0x4ac0:
+		return mode >= 2 ? I_TAS : I_ILLEGAL;
+	case 0x4c00:
+		return I_MULL;
+	case 0x4c40:
+		return I_DIVL;
+	case 0x4e80:
+		return I_JSR;
+	case 0x4ec0:
+		return I_JMP;
+	}
+
+	if ((op & 0xc0) != 0xc0) {
+		if ((op & 0xff00) == 0x4200)
+			return I_CLR;
+		if ((op & 0xff00) == 0x4a00)
+			return I_TST;
+	}
+
+	return I_ILLEGAL;
+}
+
+/*
+ * Coldfire has a few opmodes per line, the rest is illegal.
+ */
+static constexpr uint8_t decode_alu(uint16_t op, int mode, uint8_t ea_dn,
+				    uint8_t dn_ea, uint8_t x, uint8_t a)
+{
+	switch ((op >> 6) & 7) {
+	case 0:
+	case 1:
+	case 2:
+		return ea_dn;
+	case 3:
+	case 7:
+		return a;
+	case 6:
+		if (mode == 0 && x != I_ILLEGAL)
+			return x;
+		/* fallthrough */
+	default:
+		if (mode >= 2 || (mode == 0 && dn_ea == I_EOR))
+			return dn_ea;
+		return I_ILLEGAL;
+	}
+}
+
+static constexpr uint8_t decode(uint16_t op)
+{
+	int mode = (op >> 3) & 7;
+
+	switch (op >> 12) {
+	case 0x0:
+		return decode_0(op, mode);
+	case 0x1:
+		return ((op >> 6) & 7) == 1 ? I_ILLEGAL : I_MOVE;
+	case 0x2:
+	case 0x3:
+		return ((op >> 6) & 7) == 1 ? I_MOVEA : I_MOVE;
+	case 0x4:
+		return decode_4(op, mode);
+	case 0x5:
+		if (op >= 0x51fa && op <= 0x51fc)
+			return I_TPF;
+		if ((op & 0xc0) == 0xc0)
+			return mode == 0 ? I_SCC : I_ILLEGAL;
+		if ((op & 0xc0) != 0x80)
+			return I_ILLEGAL;
+		return (op & 0x100) ? I_SUBQ : I_ADDQ;
+	case 0x6:
+		return I_BCC;
+	case 0x7:
+		return (op & 0x100) ? I_ILLEGAL : I_MOVEQ;
+	case 0x8:
+		return decode_alu(op, mode, I_OR, I_OR, I_ILLEGAL, I_DIVW);
+	case 0x9:
+		return decode_alu(op, mode, I_SUB, I_SUB, I_SUBX, I_SUBA);
+	case 0xa:
+		return I_LINEA;
+	case 0xb:
+		return decode_alu(op, mode, I_CMP, I_EOR, I_ILLEGAL, I_CMPA);
+	case 0xc:
+		return decode_alu(op, mode, I_AND, I_AND, I_ILLEGAL, I_MULW);
+	case 0xd:
+		return decode_alu(op, mode, I_ADD, I_ADD, I_ADDX, I_ADDA);
+	case 0xe:
+		/* register shifts, long only */
+		if ((op & 0xd0) == 0x80)
+			return I_SHIFT;
+		return I_ILLEGAL;
+	default:
+		if ((op & 0xff20) == 0xf420)
+			return I_CPUSH;
+		if ((op & 0xffc0) == 0xfbc0)
+			return I_WDEBUG;
+		return I_LINEF;
+	}
+}
+
+static constexpr std::array<uint8_t, 0x10000> make_table()
+{
+	std::array<uint8_t, 0x10000> t {};
+
+	for (int i = 0; i < 0x10000; ++i)
+		t[i] = decode(i);
+
+	return t;
+}
+
+static constexpr std::array<uint8_t, 0x10000> op_table = make_table();
+
+static inline uint32_t msk(int size)
+{
+	return size == 4 ? 0xffffffff : (1u << (size * 8)) - 1;
+}
+
+static inline uint32_t msb(int size)
+{
+	return 1u << (size * 8 - 1);
+}
+
+static inline uint32_t be(const uint8_t *p, int size)
+{
+	switch (size) {
+	case 1:
+		return p[0];
+	case 2:
+		return (p[0] << 8) | p[1];
+	default:
+		return ((uint32_t)p[0] << 24) | (p[1] << 16) |
+			(p[2] << 8) | p[3];
+	}
+}
+
+driver_iss::driver_iss(libusb_device *device) : driver_sim(device)
+{
+}
+
+driver_iss::~driver_iss()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		quit = true;
+	}
+	cv.notify_one();
+
+	if (cpu.joinable())
+		cpu.join();
+
+	log_info("iss: %llu instructions executed",
+		 (unsigned long long)insns);
+}
+
+int driver_iss::probe()
+{
+	int err = driver_sim::probe();
+
+	if (err)
+		return err;
+
+	log_info("coldfire isa_a/a+ interpreter");
+
+	cpu = std::thread(&driver_iss::cpu_loop, this);
+
+	return 0;
+}
+
+/*
+ * The modeled usb time is spent out of the lock, so the core keeps
+ * running meanwhile, then the slice in progress yields to the packet.
+ */
+int driver_iss::send_and_recv(int tx_count, int rx_count)
+{
+	int err;
+
+	model(tx_count + rx_count);
+
+	if (link_fault())
+		return 1;
+
+	waiting++;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+
+		waiting--;
+		err = process(rx_count);
+	}
+	cv.notify_one();
+
+	if (!err && link_fault())
+		garble();
+
+	return err;
+}
+
+/*
+ * Called with the lock held, on go. A step executes here, a run is
+ * left to the cpu thread.
+ */
+void driver_iss::run(bool step)
+{
+	stopped = false;
+	/* a breakpoint at the resume pc does not hit again */
+	skip_bp = true;
+
+	if (step) {
+		execute(1);
+		halt_core(CSR_HALT);
+	}
+}
+
+void driver_iss::cpu_loop()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+
+	while (!quit) {
+		if (!running || stopped) {
+			cv.wait(lock);
+			continue;
+		}
+
+		execute(ISS_SLICE);
+
+		if (waiting) {
+			lock.unlock();
+			while (waiting)
+				std::this_thread::yield();
+			lock.lock();
+		}
+	}
+}
+
+inline uint16_t driver_iss::fetch16()
+{
+	uint8_t *p = page(pc, false);
+	uint32_t ofs = pc & (SIM_PAGE_SIZE - 1);
+	uint16_t value;
+
+	if (p && ofs <= SIM_PAGE_SIZE - 2)
+		value = be(p + ofs, 2);
+	else
+		value = mem_read(pc, 2);
+
+	pc += 2;
+
+	return value;
+}
+
+inline uint32_t driver_iss::fetch32()
+{
+	uint32_t value = fetch16() << 16;
+
+	return value | fetch16();
+}
+
+inline void driver_iss::watch(uint32_t addr, bool read)
+{
+	uint32_t aatr = dm[BDM_REG_AATR];
+
+	if (addr < dm[BDM_REG_ABLR] || addr > dm[BDM_REG_ABHR])
+		return;
+
+	if ((aatr & AATR_RM) || !!(aatr & AATR_R) == read)
+		wp_hit = true;
+}
+
+inline uint32_t driver_iss::rd(uint32_t addr, int size)
+{
+	uint8_t *p = page(addr, false);
+	uint32_t ofs = addr & (SIM_PAGE_SIZE - 1);
+
+	if (wp_on)
+		watch(addr, true);
+
+	if (p && ofs <= SIM_PAGE_SIZE - size)
+		return be(p + ofs, size);
+
+	return mem_read(addr, size);
+}
+
+inline void driver_iss::wr(uint32_t addr, int size, uint32_t value)
+{
+	uint8_t *p = page(addr, true);
+	uint32_t ofs = addr & (SIM_PAGE_SIZE - 1);
+	int i;
+
+	if (wp_on)
+		watch(addr, false);
+
+	if (ofs > SIM_PAGE_SIZE - size) {
+		mem_write(addr, size, value);
+		return;
+	}
+
+	for (i = size - 1, p += ofs; i >= 0; --i, value >>= 8)
+		p[i] = value;
+}
+
+inline void driver_iss::push(uint32_t value)
+{
+	ad[CF_SP] -= 4;
+	wr(ad[CF_SP], 4, value);
+}
+
+inline uint32_t driver_iss::pop()
+{
+	uint32_t value = rd(ad[CF_SP], 4);
+
+	ad[CF_SP] += 4;
+
+	return value;
+}
+
+/*
+ * (d8,base,Xi*scale), the extension word follows the opcode.
+ */
+inline uint32_t driver_iss::index(uint32_t base)
+{
+	uint16_t ext = fetch16();
+	uint32_t xi = ad[ext >> 12];
+
+	if (!(ext & 0x800))
+		xi = (int16_t)xi;
+
+	return base + (xi << ((ext >> 9) & 3)) + (int8_t)ext;
+}
+
+inline uint32_t driver_iss::ea_addr(int mode, int reg, int size)
+{
+	uint32_t *an = &ad[8 + reg];
+	uint32_t addr;
+	int inc = (size == 1 && reg == 7) ? 2 : size;
+
+	switch (mode) {
+	case 2:
+		return *an;
+	case 3:
+		addr = *an;
+		*an += inc;
+		return addr;
+	case 4:
+		*an -= inc;
+		return *an;
+	case 5:
+		return *an + (int16_t)fetch16();
+	case 6:
+		return index(*an);
+	default:
+		switch (reg) {
+		case 0:
+			return (int16_t)fetch16();
+		case 1:
+			return fetch32();
+		case 2:
+			addr = pc;
+			return addr + (int16_t)fetch16();
+		default:
+			return index(pc);
+		}
+	}
+}
+
+inline driver_iss::ea_t driver_iss::ea(int mode, int reg, int size)
+{
+	switch (mode) {
+	case 0:
+		return { &ad[reg], 0 };
+	case 1:
+		return { &ad[8 + reg], 0 };
+	case 7:
+		if (reg == 4) {
+			imm = size == 4 ? fetch32() : fetch16();
+			return { &imm, 0 };
+		}
+		/* fallthrough */
+	default:
+		return { NULL, ea_addr(mode, reg, size) };
+	}
+}
+
+inline uint32_t driver_iss::get(const ea_t &e, int size)
+{
+	if (e.reg)
+		return *e.reg & msk(size);
+
+	return rd(e.addr, size);
+}
+
+inline void driver_iss::put(const ea_t &e, int size, uint32_t value)
+{
+	if (e.reg)
+		*e.reg = (*e.reg & ~msk(size)) | (value & msk(size));
+	else
+		wr(e.addr, size, value);
+}
+
+inline bool driver_iss::cond(int cc)
+{
+	bool c = sr & SR_C, v = sr & SR_V, z = sr & SR_Z, n = sr & SR_N;
+
+	switch (cc) {
+	case 0:
+		return true;
+	case 1:
+		return false;
+	case 2:
+		return !c && !z;
+	case 3:
+		return c || z;
+	case 4:
+		return !c;
+	case 5:
+		return c;
+	case 6:
+		return !z;
+	case 7:
+		return z;
+	case 8:
+		return !v;
+	case 9:
+		return v;
+	case 10:
+		return !n;
+	case 11:
+		return n;
+	case 12:
+		return n == v;
+	case 13:
+		return n != v;
+	case 14:
+		return !z && n == v;
+	default:
+		return z || n != v;
+	}
+}
+
+inline void driver_iss::flags_logic(uint32_t r, int size)
+{
+	sr &= ~(SR_N | SR_Z | SR_V | SR_C);
+
+	if (r & msb(size))
+		sr |= SR_N;
+	if (!(r & msk(size)))
+		sr |= SR_Z;
+}
+
+inline void driver_iss::flags_add(uint32_t s, uint32_t d, uint32_t r,
+				  int size)
+{
+	uint32_t m = msb(size);
+
+	flags_logic(r, size);
+
+	if (((s & d) | (~r & (s | d))) & m)
+		sr |= SR_C | SR_X;
+	else
+		sr &= ~SR_X;
+	if (~(s ^ d) & (r ^ d) & m)
+		sr |= SR_V;
+}
+
+inline void driver_iss::flags_sub(uint32_t s, uint32_t d, uint32_t r,
+				  int size, bool x)
+{
+	uint32_t m = msb(size);
+
+	flags_logic(r, size);
+
+	if (((s & ~d) | (r & ~d) | (s & r)) & m) {
+		sr |= SR_C;
+		if (x)
+			sr |= SR_X;
+	} else if (x) {
+		sr &= ~SR_X;
+	}
+	if ((s ^ d) & (r ^ d) & m)
+		sr |= SR_V;
+}
+
+/*
+ * Coldfire frame: format/vector/sr long, then the pc. No vector set
+ * means nobody handles it, the core halts at the fault.
+ */
+void driver_iss::exception(int vec, uint32_t fault_pc)
+{
+	uint32_t sp = ad[CF_SP];
+	uint32_t handler = rd(vbr + vec * 4, 4);
+
+	if (!handler) {
+		log_dbg("iss: vector %d at %08x not set, halting",
+			vec, fault_pc);
+		pc = fault_pc;
+		halt_core(CSR_HALT);
+		return;
+	}
+
+	ad[CF_SP] = sp & ~3;
+	push(fault_pc);
+	push(((4 + (sp & 3)) << 28) | (vec << 18) | sr);
+
+	sr = (sr | SR_S) & ~SR_T;
+	pc = handler;
+}
+
+/*
+ * Up to count instructions, until halted or a packet is waiting.
+ */
+int driver_iss::execute(int count)
+{
+	static constexpr uint32_t HIT = (CSR_BSTAT_L1_HIT << CSR_BSTAT_SHIFT) |
+					CSR_TRG;
+	uint32_t *d = ad, *a = ad + 8;
+	uint32_t op, insn_pc, s, t, r, z;
+	int done, mode, reg, size, n, i;
+	uint16_t ext;
+	int64_t q;
+	ea_t e;
+
+	pc = ctrl[crt_pc];
+	sr = ctrl[crt_sr] & 0xffff;
+	vbr = ctrl[crt_vbr];
+	bp_on = (dm[BDM_REG_TDR] & (TDR_L1EBL | TDR_L1EPC)) ==
+		(TDR_L1EBL | TDR_L1EPC);
+	wp_on = (dm[BDM_REG_TDR] & (TDR_L1EBL | TDR_L1EAR)) ==
+		(TDR_L1EBL | TDR_L1EAR);
+
+	for (done = 0; done < count && running && !stopped; ++done) {
+		if (!(done & 0x3ff) && done && waiting)
+			break;
+
+		if (bp_on && !skip_bp &&
+		    !((pc ^ dm[BDM_REG_PBR]) & ~dm[BDM_REG_PBMR])) {
+			halt_core(HIT);
+			break;
+		}
+		skip_bp = false;
+
+		insn_pc = pc;
+		op = fetch16();
+		mode = (op >> 3) & 7;
+		reg = op & 7;
+		n = (op >> 9) & 7;
+
+		switch (op_table[op]) {
+		case I_ILLEGAL:
+			exception(VEC_ILLEGAL, insn_pc);
+			break;
+		case I_LINEA:
+			exception(VEC_LINEA, insn_pc);
+			break;
+		case I_LINEF:
+			exception(VEC_LINEF, insn_pc);
+			break;
+		case I_ORI:
+			r = d[reg] |= fetch32();
+			flags_logic(r, 4);
+			break;
+		case I_ANDI:
+			r = d[reg] &= fetch32();
+			flags_logic(r, 4);
+			break;
+		case I_EORI:
+			r = d[reg] ^= fetch32();
+			flags_logic(r, 4);
+			break;
+		case I_SUBI:
+			s = fetch32();
+			t = d[reg];
+			r = d[reg] = t - s;
+			flags_sub(s, t, r, 4, true);
+			break;
+		case I_ADDI:
+			s = fetch32();
+			t = d[reg];
+			r = d[reg] = t + s;
+			flags_add(s, t, r, 4);
+			break;
+		case I_CMPI:
+			size = op_size[(op >> 6) & 3];
+			s = size == 4 ? fetch32() : fetch16() & msk(size);
+			t = d[reg] & msk(size);
+			flags_sub(s, t, t - s, size, false);
+			break;
+		case I_BIT_S:
+		case I_BIT_D:
+			i = op_table[op] == I_BIT_S ? fetch16() : d[n];
+			size = mode ? 1 : 4;
+			s = 1u << (i & (size * 8 - 1));
+			e = ea(mode, reg, size);
+			t = get(e, size);
+			sr = (t & s) ? sr & ~SR_Z : sr | SR_Z;
+			switch ((op >> 6) & 3) {
+			case 1:
+				put(e, size, t ^ s);
+				break;
+			case 2:
+				put(e, size, t & ~s);
+				break;
+			case 3:
+				put(e, size, t | s);
+				break;
+			}
+			break;
+		case I_BITREV:
+			t = d[reg];
+			t = ((t >> 1) & 0x55555555) | ((t & 0x55555555) << 1);
+			t = ((t >> 2) & 0x33333333) | ((t & 0x33333333) << 2);
+			t = ((t >> 4) & 0x0f0f0f0f) | ((t & 0x0f0f0f0f) << 4);
+			d[reg] = __builtin_bswap32(t);
+			break;
+		case I_BYTEREV:
+			d[reg] = __builtin_bswap32(d[reg]);
+			break;
+		case I_FF1:
+			t = d[reg];
+			flags_logic(t, 4);
+			d[reg] = t ? __builtin_clz(t) : 32;
+			break;
+		case I_MOVE:
+			size = (op >> 12) == 1 ? 1 : (op >> 12) == 3 ? 2 : 4;
+			r = get(ea(mode, reg, size), size);
+			put(ea((op >> 6) & 7, n, size), size, r);
+			flags_logic(r, size);
+			break;
+		case I_MOVEA:
+			size = (op >> 12) == 3 ? 2 : 4;
+			r = get(ea(mode, reg, size), size);
+			a[n] = size == 2 ? (int16_t)r : r;
+			break;
+		case I_NEGX:
+		case I_SUBX:
+		case I_ADDX:
+			s = d[reg];
+			t = op_table[op] == I_NEGX ? 0 : d[n];
+			z = sr & SR_Z;
+			if (op_table[op] == I_ADDX) {
+				r = t + s + !!(sr & SR_X);
+				flags_add(s, t, r, 4);
+			} else {
+				r = t - s - !!(sr & SR_X);
+				flags_sub(s, t, r, 4, true);
+			}
+			if (!r)
+				sr = (sr & ~SR_Z) | z;
+			d[op_table[op] == I_NEGX ? reg : n] = r;
+			break;
+		case I_MOVE_FROM_SR:
+			if (!(sr & SR_S)) {
+				exception(VEC_PRIV, insn_pc);
+				break;
+			}
+			d[reg] = (d[reg] & 0xffff0000) | sr;
+			break;
+		case I_STLDSR:
+			if (!(sr & SR_S)) {
+				exception(VEC_PRIV, insn_pc);
+				break;
+			}
+			if (fetch16() != 0x46fc) {
+				exception(VEC_ILLEGAL, insn_pc);
+				break;
+			}
+			s = fetch16();
+			push(sr);
+			sr = s;
+			break;
+		case I_LEA:
+			a[n] = ea_addr(mode, reg, 4);
+			break;
+		case I_CLR:
+			size = op_size[(op >> 6) & 3];
+			put(ea(mode, reg, size), size, 0);
+			sr = (sr & ~(SR_N | SR_V | SR_C)) | SR_Z;
+			break;
+		case I_MOVE_FROM_CCR:
+			d[reg] = (d[reg] & 0xffff0000) | (sr & 0x1f);
+			break;
+		case I_NEG:
+			t = d[reg];
+			r = d[reg] = 0 - t;
+			flags_sub(t, 0, r, 4, true);
+			break;
+		case I_MOVE_TO_CCR:
+			s = get(ea(mode, reg, 2), 2);
+			sr = (sr & 0xff00) | (s & 0x1f);
+			break;
+		case I_NOT:
+			r = d[reg] = ~d[reg];
+			flags_logic(r, 4);
+			break;
+		case I_MOVE_TO_SR:
+			if (!(sr & SR_S)) {
+				exception(VEC_PRIV, insn_pc);
+				break;
+			}
+			sr = get(ea(mode, reg, 2), 2);
+			break;
+		case I_SWAP:
+			r = d[reg] = (d[reg] << 16) | (d[reg] >> 16);
+			flags_logic(r, 4);
+			break;
+		case I_PEA:
+			push(ea_addr(mode, reg, 4));
+			break;
+		case I_EXT:
+			switch ((op >> 6) & 7) {
+			case 2:
+				r = (int8_t)d[reg];
+				d[reg] = (d[reg] & 0xffff0000) | (r & 0xffff);
+				flags_logic(r, 2);
+				break;
+			case 3:
+				r = d[reg] = (int16_t)d[reg];
+				flags_logic(r, 4);
+				break;
+			default:
+				r = d[reg] = (int8_t)d[reg];
+				flags_logic(r, 4);
+				break;
+			}
+			break;
+		case I_MOVEM:
+			ext = fetch16();
+			t = mode == 2 ? a[reg] : a[reg] + (int16_t)fetch16();
+			for (i = 0; i < 16; ++i) {
+				if (!(ext & (1 << i)))
+					continue;
+				if (op & 0x400)
+					ad[i] = rd(t, 4);
+				else
+					wr(t, 4, ad[i]);
+				t += 4;
+			}
+			break;
+		case I_TST:
+			size = op_size[(op >> 6) & 3];
+			flags_logic(get(ea(mode, reg, size), size), size);
+			break;
+		case I_TAS:
+			e = ea(mode, reg, 1);
+			r = get(e, 1);
+			flags_logic(r, 1);
+			put(e, 1, r | 0x80);
+			break;
+		case I_HALT:
+			if (!(sr & SR_S)) {
+				exception(VEC_PRIV, insn_pc);
+				break;
+			}
+			/* pc at the next instruction, as semihosting expects */
+			halt_core(CSR_HALT);
+			break;
+		case I_PULSE:
+		case I_NOP:
+			break;
+		case I_MULL:
+			ext = fetch16();
+			s = get(ea(mode, reg, 4), 4);
+			r = d[(ext >> 12) & 7] *= s;
+			flags_logic(r, 4);
+			break;
+		case I_DIVL:
+			ext = fetch16();
+			s = get(ea(mode, reg, 4), 4);
+			if (!s) {
+				exception(VEC_DIVZ, pc);
+				break;
+			}
+			t = d[(ext >> 12) & 7];
+			if (ext & 0x800) {
+				q = (int64_t)(int32_t)t / (int32_t)s;
+				if (q > INT32_MAX) {
+					sr = (sr & ~SR_C) | SR_V;
+					break;
+				}
+				r = (ext & 7) == ((ext >> 12) & 7) ? q :
+					(int64_t)(int32_t)t % (int32_t)s;
+			} else {
+				q = t / s;
+				r = (ext & 7) == ((ext >> 12) & 7) ? q : t % s;
+			}
+			/* divs/divu to dq, rems/remu to dr */
+			d[ext & 7] = r;
+			flags_logic(q, 4);
+			break;
+		case I_TRAP:
+			exception(VEC_TRAP + (op & 0xf), pc);
+			break;
+		case I_LINK:
+			push(a[reg]);
+			a[reg] = a[7];
+			a[7] += (int16_t)fetch16();
+			break;
+		case I_UNLK:
+			a[7] = a[reg];
+			a[reg] = pop();
+			break;
+		case I_MOVE_USP:
+			if (!(sr & SR_S)) {
+				exception(VEC_PRIV, insn_pc);
+				break;
+			}
+			if (op & 8)
+				a[reg] = ctrl[CRT_OTHER_A7];
+			else
+				ctrl[CRT_OTHER_A7] = a[reg];
+			break;
+		case I_STOP:
+			if (!(sr & SR_S)) {
+				exception(VEC_PRIV, insn_pc);
+				break;
+			}
+			sr = fetch16();
+			stopped = true;
+			break;
+		case I_RTE:
+			if (!(sr & SR_S)) {
+				exception(VEC_PRIV, insn_pc);
+				break;
+			}
+			t = pop();
+			pc = pop();
+			a[7] += (t >> 28) & 3;
+			sr = t & 0xffff;
+			break;
+		case I_RTS:
+			pc = pop();
+			break;
+		case I_MOVEC:
+			if (!(sr & SR_S)) {
+				exception(VEC_PRIV, insn_pc);
+				break;
+			}
+			ext = fetch16();
+			ctrl[ext & 0xfff] = ad[ext >> 12];
+			if ((ext & 0xfff) == crt_vbr)
+				vbr = ad[ext >> 12];
+			break;
+		case I_JSR:
+			t = ea_addr(mode, reg, 4);
+			push(pc);
+			pc = t;
+			break;
+		case I_JMP:
+			pc = ea_addr(mode, reg, 4);
+			break;
+		case I_ADDQ:
+		case I_SUBQ:
+			s = n ? n : 8;
+			if (mode == 1) {
+				a[reg] += op_table[op] == I_ADDQ ? s : -s;
+				break;
+			}
+			e = ea(mode, reg, 4);
+			t = get(e, 4);
+			if (op_table[op] == I_ADDQ) {
+				r = t + s;
+				flags_add(s, t, r, 4);
+			} else {
+				r = t - s;
+				flags_sub(s, t, r, 4, true);
+			}
+			put(e, 4, r);
+			break;
+		case I_SCC:
+			d[reg] = (d[reg] & ~0xff) |
+				 (cond((op >> 8) & 0xf) ? 0xff : 0);
+			break;
+		case I_TPF:
+			/* tpf.w, tpf.l, tpf */
+			pc += (op & 7) == 4 ? 0 : ((op & 7) - 1) * 2;
+			break;
+		case I_BCC:
+			t = pc;
+			i = (int8_t)op;
+			if (i == 0)
+				i = (int16_t)fetch16();
+			else if (i == -1)
+				i = fetch32();
+			switch ((op >> 8) & 0xf) {
+			case 1:
+				push(pc);
+				/* fallthrough */
+			case 0:
+				pc = t + i;
+				break;
+			default:
+				if (cond((op >> 8) & 0xf))
+					pc = t + i;
+				break;
+			}
+			break;
+		case I_MOVEQ:
+			r = d[n] = (int8_t)op;
+			flags_logic(r, 4);
+			break;
+		case I_OR:
+		case I_AND:
+		case I_EOR:
+		case I_SUB:
+		case I_ADD:
+		case I_CMP:
+			size = op_size[(op >> 6) & 3];
+			e = ea(mode, reg, size);
+			if (op & 0x100) {
+				s = d[n] & msk(size);
+				t = get(e, size);
+			} else {
+				s = get(e, size);
+				t = d[n] & msk(size);
+				e.reg = &d[n];
+			}
+			switch (op_table[op]) {
+			case I_OR:
+				r = t | s;
+				flags_logic(r, size);
+				break;
+			case I_AND:
+				r = t & s;
+				flags_logic(r, size);
+				break;
+			case I_EOR:
+				r = t ^ s;
+				flags_logic(r, size);
+				break;
+			case I_ADD:
+				r = t + s;
+				flags_add(s, t, r, size);
+				break;
+			case I_SUB:
+				r = t - s;
+				flags_sub(s, t, r, size, true);
+				break;
+			default:
+				flags_sub(s, t, t - s, size, false);
+				break;
+			}
+			if (op_table[op] != I_CMP)
+				put(e, size, r);
+			break;
+		case I_SUBA:
+		case I_ADDA:
+		case I_CMPA:
+			size = (op & 0x100) ? 4 : 2;
+			s = get(ea(mode, reg, size), size);
+			if (size == 2)
+				s = (int16_t)s;
+			if (op_table[op] == I_ADDA)
+				a[n] += s;
+			else if (op_table[op] == I_SUBA)
+				a[n] -= s;
+			else
+				flags_sub(s, a[n], a[n] - s, 4, false);
+			break;
+		case I_DIVW:
+			s = get(ea(mode, reg, 2), 2);
+			if (!s) {
+				exception(VEC_DIVZ, pc);
+				break;
+			}
+			t = d[n];
+			if (op & 0x100) {
+				q = (int64_t)(int32_t)t / (int16_t)s;
+				r = (int64_t)(int32_t)t % (int16_t)s;
+				if (q < INT16_MIN || q > INT16_MAX) {
+					sr = (sr & ~SR_C) | SR_V;
+					break;
+				}
+			} else {
+				q = t / s;
+				r = t % s;
+				if (q > 0xffff) {
+					sr = (sr & ~SR_C) | SR_V;
+					break;
+				}
+			}
+			d[n] = (r << 16) | (q & 0xffff);
+			flags_logic(q, 2);
+			break;
+		case I_MULW:
+			s = get(ea(mode, reg, 2), 2);
+			if (op & 0x100)
+				r = d[n] = (int16_t)d[n] * (int16_t)s;
+			else
+				r = d[n] = (d[n] & 0xffff) * s;
+			flags_logic(r, 4);
+			break;
+		case I_SHIFT:
+			i = (op & 0x20) ? d[n] & 63 : (n ? n : 8);
+			t = d[reg];
+			if (!i) {
+				flags_logic(t, 4);
+				break;
+			}
+			if (op & 0x100) {
+				z = i <= 32 ? (t >> (32 - i)) & 1 : 0;
+				r = i < 32 ? t << i : 0;
+			} else if (op & 8) {
+				z = i <= 32 ? (t >> (i - 1)) & 1 : 0;
+				r = i < 32 ? t >> i : 0;
+			} else {
+				z = i <= 32 ? ((int32_t)t >> (i - 1)) & 1 :
+					t >> 31;
+				r = (int32_t)t >> (i < 32 ? i : 31);
+			}
+			d[reg] = r;
+			flags_logic(r, 4);
+			if (z)
+				sr |= SR_X | SR_C;
+			else
+				sr &= ~SR_X;
+			break;
+		case I_CPUSH:
+		case I_WDEBUG:
+			if (!(sr & SR_S)) {
+				exception(VEC_PRIV, insn_pc);
+				break;
+			}
+			/* no caches, no debug module commands from code */
+			if (op_table[op] == I_WDEBUG) {
+				ea_addr(mode, reg, 4);
+				fetch16();
+			}
+			break;
+		}
+
+		if (wp_hit) {
+			wp_hit = false;
+			halt_core(HIT);
+		}
+	}
+
+	ctrl[crt_pc] = pc;
+	ctrl[crt_sr] = sr;
+	insns += done;
+
+	return done;
+}
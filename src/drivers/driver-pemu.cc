@@ -19,6 +19,8 @@
  */
 
 #include "driver-pemu.hh"
+#include "recorder.hh"
+#include "stats.hh"
 #include "utils.hh"
 #include "trace.hh"
 #include "bdm-defs.hh"
@@ -29,39 +31,9 @@
 using namespace trace;
 using namespace utils;
 
-static constexpr unsigned char REP_VERSION_INFO[] = {0x99, 0x66, 0x00, 0x64};
-
-static constexpr int OFS_BDM_PREFIX = 5;
-static constexpr int OFS_BDM = 6;
-static constexpr int PEMU_CMD_REPLY_LEN = 4;
-static constexpr int PEMU_STD_PKT_SIZE = 256;
-static constexpr int PEMU_MAX_PKT_SIZE = 1280;
-static constexpr int PEMU_MAX_BIG_BLOCK	= 0x4a8;
-
-enum pemu_prefixes {
-	CMD_PEMU_RESET = 0x01,
-	CMD_PEMU_GO = 0x02,
-	CMD_PEMU_GET_VERSION_STR = 0x0b,
-	CMD_PEMU_BDM_MEM_R = 0x11,
-	CMD_PEMU_BDM_REG_R = 0x13,
-	CMD_PEMU_BDM_SCR_W = 0x14,
-	CMD_PEMU_BDM_MEM_W = 0x15,
-	CMD_PEMU_BDM_REG_W = 0x16,
-	CMD_PEMU_GET_ALL_CPU_REGS = 0x18,
-	CMD_PEMU_W_MEM_BLOCK = 0x19,
-};
-
-enum pemu_pkt_types {
-	PEMU_PT_GENERIC = 0xaa55,
-	PEMU_PT_CMD = 0xab56,
-	PEMU_PT_WBLOCK = 0xbc67,
-};
-
-enum pemu_cmd_type {
-	CMD_TYPE_GENERIC = 0x01,
-	CMD_TYPE_IFACE = 0x04,
-	CMD_TYPE_DATA = 0x07,
-};
+static constexpr unsigned int PEMU_USB_TIMEOUT = 1000;
+static constexpr int PEMU_USB_RETRIES = 3;
+static constexpr int PEMU_CHUNK_RETRIES = 3;
 
 /*
  * pemu sends pre-commands based on bdm command to be sent
@@ -90,28 +62,57 @@ driver_pemu::driver_pemu(libusb_device *device)
 		tuple(CMD_PEMU_BDM_MEM_W, CMD_TYPE_DATA);
 	bdm_prefixes[CMD_BDMCF_WR_MEM_L] =
 		tuple(CMD_PEMU_BDM_MEM_W, CMD_TYPE_DATA);
+	bdm_prefixes[CMD_BDMCF_DUMP_B] =
+		tuple(CMD_PEMU_BDM_MEM_R, CMD_TYPE_DATA);
+	bdm_prefixes[CMD_BDMCF_DUMP_W] =
+		tuple(CMD_PEMU_BDM_MEM_R, CMD_TYPE_DATA);
+	bdm_prefixes[CMD_BDMCF_DUMP_L] =
+		tuple(CMD_PEMU_BDM_MEM_R, CMD_TYPE_DATA);
+	bdm_prefixes[CMD_BDMCF_FILL_B] =
+		tuple(CMD_PEMU_BDM_MEM_W, CMD_TYPE_DATA);
+	bdm_prefixes[CMD_BDMCF_FILL_W] =
+		tuple(CMD_PEMU_BDM_MEM_W, CMD_TYPE_DATA);
+	bdm_prefixes[CMD_BDMCF_FILL_L] =
+		tuple(CMD_PEMU_BDM_MEM_W, CMD_TYPE_DATA);
 	bdm_prefixes[CMD_BDMCF_RCREG] =
 		tuple(CMD_PEMU_BDM_MEM_R, CMD_TYPE_DATA);
 	bdm_prefixes[CMD_BDMCF_WCREG] =
 		tuple(CMD_PEMU_BDM_SCR_W, CMD_TYPE_DATA);
 }
 
+/*
+ * Bulk transfer with timeout, retried only if nothing was moved,
+ * so a wedged pod can't hang us forever.
+ */
+int driver_pemu::bulk_xfer(unsigned int endpoint, unsigned char *buff,
+			   int count)
+{
+	int rval, retry, transferred;
+
+	for (retry = 0; retry < PEMU_USB_RETRIES; ++retry) {
+		rval = libusb_bulk_transfer(handle, endpoint, buff, count,
+					    &transferred, PEMU_USB_TIMEOUT);
+		if (rval != LIBUSB_ERROR_TIMEOUT || transferred)
+			break;
+
+		log_wrn("pemu timeout, retrying");
+	}
+
+	if (rval || transferred != count)
+		return 1;
+
+	return 0;
+}
+
 int driver_pemu::send_and_recv(int tx_count, int rx_count)
 {
-	int rval;
-	int transferred;
-
-	rval = libusb_bulk_transfer(handle, endpoint_out | LIBUSB_ENDPOINT_OUT,
-				    obuf, tx_count, &transferred, 0);
-	if (rval || transferred != tx_count) {
-		log_err("pemu communication error: can't write, %d %d",
-			rval, tx_count);
+	if (bulk_xfer(endpoint_out | LIBUSB_ENDPOINT_OUT, obuf, tx_count)) {
+		log_err("pemu communication error: can't write, %d",
+			tx_count);
 		return 1;
 	}
 
-	rval = libusb_bulk_transfer(handle, endpoint_in | LIBUSB_ENDPOINT_IN,
-				    ibuf, rx_count, &transferred, 0);
-	if (rval || transferred != rx_count) {
+	if (bulk_xfer(endpoint_in | LIBUSB_ENDPOINT_IN, ibuf, rx_count)) {
 		log_err("pemu communication error: can't read");
 		return 1;
 	}
@@ -119,6 +120,63 @@ int driver_pemu::send_and_recv(int tx_count, int rx_count)
 	return 0;
 }
 
+/*
+ * A packet exchange, frames are captured when recording.
+ */
+int driver_pemu::exchange(int tx_count, int rx_count)
+{
+	static histogram &h = stats::get().hist("pemu.usb");
+	stat_timer t(h);
+	int err;
+
+	if (!recorder::get().active())
+		return send_and_recv(tx_count, rx_count);
+
+	recorder::get().frame(REC_OUT, obuf, tx_count);
+	err = send_and_recv(tx_count, rx_count);
+	if (!err)
+		recorder::get().frame(REC_IN, ibuf, rx_count);
+
+	return err;
+}
+
+/*
+ * Next slower bdm clock after a failed exchange, the packet in obuf
+ * is kept for the retry.
+ */
+bool driver_pemu::slow_down(int tx_count)
+{
+	vector<int> divs = get_bdm_clocks();
+	vector<unsigned char> pkt(obuf, obuf + tx_count);
+
+	for (int div : divs) {
+		if (div <= clock_div)
+			continue;
+
+		if (set_bdm_clock(div, true))
+			return false;
+
+		memcpy(obuf, pkt.data(), tx_count);
+		log_wrn("pemu communication error, bdm clock slowed to /%d",
+			div);
+
+		return true;
+	}
+
+	return false;
+}
+
+int driver_pemu::transfer(int tx_count, int rx_count)
+{
+	int err;
+
+	err = exchange(tx_count, rx_count);
+	while (err && clock_fallback && slow_down(tx_count))
+		err = exchange(tx_count, rx_count);
+
+	return err;
+}
+
 int driver_pemu::extract_info(unsigned char *offset, int pos, char *res)
 {
 	int p = 0;
@@ -159,7 +217,7 @@ int driver_pemu::send_generic(uint8_t cmd_type, uint16_t len)
 	*(uint16_t *)&obuf[2] = ntohs(len + 1);
 	obuf[4] = cmd_type;
 
-	if (send_and_recv(PEMU_STD_PKT_SIZE, PEMU_STD_PKT_SIZE) != 0)
+	if (transfer(PEMU_STD_PKT_SIZE, PEMU_STD_PKT_SIZE) != 0)
 		return 1;
 
 	return 0;
@@ -173,6 +231,7 @@ int driver_pemu::send_generic(uint8_t cmd_type, uint16_t len)
 int driver_pemu::xfer_bdm_data(char *io_buff, int size)
 {
 	int midx = ntohs(*(uint16_t *)io_buff) & 0xfff0;
+	stat_timer t(stats::enabled() ? &stats::get().bdm_cmd(midx) : NULL);
 
 	if (bdm_prefixes.find(midx) == bdm_prefixes.end()) {
 		log_err("bdm prefix not found");
@@ -182,7 +241,9 @@ int driver_pemu::xfer_bdm_data(char *io_buff, int size)
 	obuf[OFS_BDM_PREFIX] = std::get<0>(bdm_prefixes[midx]);
 
 	memcpy(&obuf[OFS_BDM], io_buff, size);
-	send_generic(std::get<1>(bdm_prefixes[midx]), size);
+	if (send_generic(std::get<1>(bdm_prefixes[midx]), size))
+		return 1;
+
 	memcpy(io_buff, &ibuf[OFS_BDM_PREFIX],
 		PEMU_STD_PKT_SIZE - OFS_BDM_PREFIX);
 
@@ -204,9 +265,44 @@ int driver_pemu::write_mem_byte(uint32_t dest_addr, uint8_t byte)
 	return send_generic(CMD_TYPE_DATA, 11);
 }
 
+/*
+ * One big block chunk, the packet is built again for each retry.
+ * Only a failed exchange is known, what the pod wrote is checked by
+ * load --verify reading it back.
+ */
+int driver_pemu::send_chunk(uint8_t *data, uint32_t dest_addr, int size)
+{
+	int retry;
+
+	for (retry = 0; retry <= PEMU_CHUNK_RETRIES; ++retry) {
+		*(uint16_t *)&obuf[0] = ntohs(PEMU_PT_WBLOCK);
+		obuf[4] = CMD_TYPE_DATA;
+		obuf[5] = CMD_PEMU_W_MEM_BLOCK;
+		*(uint16_t *)&obuf[2] = ntohs(size + 8);
+		*(uint16_t *)&obuf[6] = ntohs(size);
+		*(uint32_t *)&obuf[8] = ntohl(dest_addr);
+
+		memcpy(&obuf[12], data, size);
+
+		/* pemu wants a padded packet */
+		if (transfer(PEMU_MAX_PKT_SIZE, PEMU_STD_PKT_SIZE) == 0)
+			return 0;
+
+		log_wrn("pemu: block at %08x not acknowledged, retrying",
+			dest_addr);
+	}
+
+	return 1;
+}
+
 int driver_pemu::send_big_block(uint8_t *data, uint32_t dest_addr, int size)
 {
+	static histogram &h = stats::get().hist("pemu.big_block");
+	stat_timer t(h);
 	uint16_t to_send, remainder;
+	int retry;
+
+	t.size = size;
 
 	remainder = size % 4;
 
@@ -216,27 +312,36 @@ int driver_pemu::send_big_block(uint8_t *data, uint32_t dest_addr, int size)
 		else
 			to_send = size - remainder;
 
-		*(uint16_t *)&obuf[0] = ntohs(PEMU_PT_WBLOCK);
-		obuf[4] = CMD_TYPE_DATA;
-		obuf[5] = CMD_PEMU_W_MEM_BLOCK;
-		*(uint16_t *)&obuf[2] = ntohs(to_send + 8);
-		*(uint16_t *)&obuf[6] = ntohs(to_send);
-		*(uint32_t *)&obuf[8] = ntohl(dest_addr);
-
-		memcpy(&obuf[12], data, to_send);
-
-		/* pemu wants a padded packet */
-		send_and_recv(PEMU_MAX_PKT_SIZE, PEMU_STD_PKT_SIZE);
+		if (send_chunk(data, dest_addr, to_send)) {
+			log_err("pemu: block write failed at %08x",
+				dest_addr);
+			return 1;
+		}
 
 		size -= to_send;
 		data += to_send;
 		dest_addr += to_send;
+
+		if (on_yield)
+			on_yield();
+
+		if (on_chunk && !on_chunk(to_send)) {
+			log_wrn("block write aborted");
+			return 1;
+		}
 	}
 
 	while (remainder--) {
-		if (write_mem_byte(dest_addr++, *data++)) {
-			log_err("error writing teminder byte.");
+		for (retry = 0; write_mem_byte(dest_addr, *data); ++retry) {
+			if (retry == PEMU_CHUNK_RETRIES) {
+				log_err("error writing teminder byte.");
+				return 1;
+			}
 		}
+		dest_addr++;
+		data++;
+		if (on_chunk && !on_chunk(1))
+			return 1;
 	}
 
 	return 0;
@@ -267,6 +372,9 @@ void driver_pemu::send_go()
 	*(uint16_t *)&obuf[OFS_BDM] = ntohs(CMD_BDMCF_RDMREG);
 
 	send_generic(CMD_TYPE_DATA, 3);
+
+	/* reading CSR clears halt status bits, keep them */
+	go_csr = ntohl(*(uint32_t *)&ibuf[OFS_BDM_PREFIX]);
 }
 
 int driver_pemu::get_programmer_info()
@@ -283,7 +391,7 @@ int driver_pemu::get_programmer_info()
 	obuf[4] = CMD_TYPE_GENERIC;
 	obuf[5] = CMD_PEMU_GET_VERSION_STR;
 
-	err = send_and_recv(PEMU_STD_PKT_SIZE, PEMU_STD_PKT_SIZE);
+	err = transfer(PEMU_STD_PKT_SIZE, PEMU_STD_PKT_SIZE);
 	if (err)
 		return err;
 
@@ -305,6 +413,25 @@ int driver_pemu::get_programmer_info()
 	return 0;
 }
 
+string driver_pemu::get_serial()
+{
+	struct libusb_device_descriptor desc;
+	unsigned char serial[64];
+
+	if (!dev || libusb_get_device_descriptor(dev, &desc) ||
+	    libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber,
+					       serial, sizeof(serial)) < 0)
+		return "";
+
+	return (char *)serial;
+}
+
+driver_pemu::~driver_pemu()
+{
+	if (handle)
+		libusb_close(handle);
+}
+
 int driver_pemu::probe()
 {
 	int err;
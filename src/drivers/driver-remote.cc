@@ -0,0 +1,308 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "driver-remote.hh"
+#include "getopts.hh"
+#include "trace.hh"
+
+#include <cstring>
+#include <deque>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+using namespace trace;
+
+driver_remote::driver_remote(libusb_device *device)
+{
+	dev = device;
+}
+
+driver_remote::~driver_remote()
+{
+	if (fd >= 0) {
+		closing = true;
+		shutdown(fd, SHUT_RDWR);
+		if (rx.joinable())
+			rx.join();
+		close(fd);
+	}
+}
+
+void driver_remote::fail_pending()
+{
+	std::lock_guard<std::mutex> l(mtx);
+
+	dead = true;
+
+	for (auto &p : pending) {
+		p.second->result.set_value(-1);
+		delete p.second;
+	}
+	pending.clear();
+}
+
+void driver_remote::rx_loop()
+{
+	vector<uint8_t> payload;
+	remote_req *r;
+	pod_hdr hdr;
+	int i;
+
+	for (;;) {
+		if (pp_read(fd, &hdr, sizeof(hdr)))
+			break;
+
+		hdr.id = ntohl(hdr.id);
+		hdr.len = ntohl(hdr.len);
+
+		if (hdr.len > PP_MAX_PAYLOAD)
+			break;
+
+		payload.resize(hdr.len);
+		if (pp_read(fd, payload.data(), hdr.len))
+			break;
+
+		{
+			std::lock_guard<std::mutex> l(mtx);
+			auto it = pending.find(hdr.id);
+
+			if (it == pending.end())
+				continue;
+			r = it->second;
+			pending.erase(it);
+		}
+
+		for (i = 0; i < r->count &&
+		     (uint32_t)(i + 1) * PP_REPLY_LEN <= hdr.len; ++i)
+			memcpy(r->xfers[i].buff, &payload[i * PP_REPLY_LEN],
+			       PP_REPLY_LEN);
+
+		if (ntohs(hdr.op) == PP_GO && hdr.len >= 4)
+			go_csr = ntohl(*(uint32_t *)payload.data());
+
+		r->result.set_value((int16_t)ntohs(hdr.status));
+		delete r;
+	}
+
+	if (!closing)
+		log_err("pod server connection lost");
+	fail_pending();
+}
+
+std::future<int> driver_remote::submit(uint16_t op,
+				       const vector<uint8_t> &payload,
+				       bdm_xfer *xfers, int count)
+{
+	remote_req *r = new remote_req;
+	std::future<int> f = r->result.get_future();
+	pod_hdr hdr;
+	bool err;
+
+	r->xfers = xfers;
+	r->count = count;
+
+	std::lock_guard<std::mutex> t(tx);
+
+	{
+		std::lock_guard<std::mutex> l(mtx);
+
+		if (dead) {
+			r->result.set_value(-1);
+			delete r;
+			return f;
+		}
+
+		hdr.id = htonl(next_id);
+		pending[next_id++] = r;
+	}
+
+	hdr.op = htons(op);
+	hdr.status = 0;
+	hdr.len = htonl(payload.size());
+
+	err = pp_write(fd, &hdr, sizeof(hdr)) ||
+	      pp_write(fd, payload.data(), payload.size());
+	if (err)
+		shutdown(fd, SHUT_RDWR);
+
+	return f;
+}
+
+std::future<int> driver_remote::submit_xfers(bdm_xfer *xfers, int count)
+{
+	vector<uint8_t> payload;
+	uint16_t len;
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		len = htons(xfers[i].len);
+		payload.insert(payload.end(), (uint8_t *)&len,
+			       (uint8_t *)&len + 2);
+		payload.insert(payload.end(), xfers[i].buff,
+			       xfers[i].buff + xfers[i].len);
+	}
+
+	return submit(PP_XFER, payload, xfers, count);
+}
+
+int driver_remote::probe()
+{
+	struct addrinfo hints {}, *res, *ai;
+	string host, port;
+	size_t colon;
+	int one = 1;
+
+	host = opts::get().remote;
+	colon = host.rfind(':');
+	if (colon == string::npos) {
+		log_err("remote pod must be host:port");
+		return -1;
+	}
+	port = host.substr(colon + 1);
+	host.erase(colon);
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res)) {
+		log_err("cannot resolve %s", host.c_str());
+		return -1;
+	}
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+
+	if (fd < 0) {
+		log_err("cannot connect to pod server %s",
+			opts::get().remote.c_str());
+		return -1;
+	}
+
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	rx = std::thread(&driver_remote::rx_loop, this);
+
+	return 0;
+}
+
+int driver_remote::get_programmer_info()
+{
+	int err = submit(PP_INFO, {}).get();
+
+	if (!err)
+		log_info("remote pod %s", opts::get().remote.c_str());
+
+	return err;
+}
+
+int driver_remote::xfer_bdm_data(char *io_buff, int len)
+{
+	bdm_xfer x;
+	int err;
+
+	memcpy(x.buff, io_buff, len);
+	x.len = len;
+
+	err = submit_xfers(&x, 1).get();
+	memcpy(io_buff, x.buff, PP_REPLY_LEN);
+
+	return err;
+}
+
+int driver_remote::xfer_bdm_batch(bdm_xfer *xfers, int count)
+{
+	return submit_xfers(xfers, count).get();
+}
+
+std::future<int> driver_remote::xfer_bdm_async(bdm_xfer *xfer)
+{
+	return submit_xfers(xfer, 1);
+}
+
+/*
+ * Chunks are kept in flight up to a window, progress is reported as
+ * they complete.
+ */
+int driver_remote::send_big_block(uint8_t *data, uint32_t dest_addr,
+				  int size)
+{
+	std::deque<std::pair<std::future<int>, int>> inflight;
+	vector<uint8_t> payload;
+	uint32_t addr;
+	bool abort = false;
+	int err = 0, chunk;
+
+	while (size && !abort) {
+		chunk = size > REMOTE_CHUNK ? REMOTE_CHUNK : size;
+		addr = htonl(dest_addr);
+
+		payload.assign((uint8_t *)&addr, (uint8_t *)&addr + 4);
+		payload.insert(payload.end(), data, data + chunk);
+		inflight.emplace_back(submit(PP_BLOCK, payload), chunk);
+
+		data += chunk;
+		dest_addr += chunk;
+		size -= chunk;
+
+		if (inflight.size() < REMOTE_WINDOW)
+			continue;
+
+		err |= inflight.front().first.get();
+		if (on_yield)
+			on_yield();
+		if (on_chunk && !on_chunk(inflight.front().second))
+			abort = true;
+		inflight.pop_front();
+	}
+
+	for (auto &f : inflight) {
+		err |= f.first.get();
+		if (!abort && on_chunk && !on_chunk(f.second))
+			abort = true;
+	}
+
+	return (err || abort) ? 1 : 0;
+}
+
+void driver_remote::send_reset(bool state)
+{
+	submit(PP_RESET, { (uint8_t)state }).get();
+}
+
+void driver_remote::send_go()
+{
+	submit(PP_GO, {}).get();
+}
+
+void driver_remote::send_halt()
+{
+	submit(PP_HALT, {}).get();
+}
@@ -0,0 +1,160 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "driver-replay.hh"
+#include "getopts.hh"
+#include "trace.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <arpa/inet.h>
+
+using namespace trace;
+using namespace std::chrono;
+
+driver_replay::driver_replay(libusb_device *device) : driver_pemu(device)
+{
+}
+
+driver_replay::~driver_replay()
+{
+	log_info("replay: %llu frames, %llu differing from the capture",
+		 (unsigned long long)frames, (unsigned long long)diverged);
+}
+
+int driver_replay::probe()
+{
+	string file = opts::get().replay;
+	size_t colon = file.rfind(':');
+	char *end;
+
+	if (colon != string::npos) {
+		double s = strtod(file.c_str() + colon + 1, &end);
+
+		if (*end == 0 && end != file.c_str() + colon + 1) {
+			speed = s;
+			file.erase(colon);
+		}
+	}
+
+	std::ifstream in(file, std::ios::binary);
+	if (!in) {
+		log_err("can't open capture %s", file.c_str());
+		return 1;
+	}
+
+	capture.assign(std::istreambuf_iterator<char>(in),
+		       std::istreambuf_iterator<char>());
+
+	if (capture.size() < sizeof(REC_MAGIC) ||
+	    memcmp(capture.data(), REC_MAGIC, sizeof(REC_MAGIC))) {
+		log_err("%s is not a capture", file.c_str());
+		return 1;
+	}
+
+	pos = sizeof(REC_MAGIC);
+	start = steady_clock::now();
+
+	if (speed > 0)
+		log_info("replaying %s, %zu bytes, speed x%g", file.c_str(),
+			 capture.size(), speed);
+	else
+		log_info("replaying %s, %zu bytes, unpaced", file.c_str(),
+			 capture.size());
+
+	return 0;
+}
+
+const rec_hdr *driver_replay::next(const uint8_t **data)
+{
+	const rec_hdr *hdr = (const rec_hdr *)(capture.data() + pos);
+
+	if (capture.size() - pos < sizeof(rec_hdr) ||
+	    capture.size() - pos - sizeof(rec_hdr) < ntohs(hdr->len))
+		return NULL;
+
+	*data = &capture[pos + sizeof(rec_hdr)];
+	pos += sizeof(rec_hdr) + ntohs(hdr->len);
+	capture_us += ntohl(hdr->delta_us);
+
+	return hdr;
+}
+
+/*
+ * An out frame not followed by its reply is a failed exchange in the
+ * capture, and fails here too.
+ */
+int driver_replay::send_and_recv(int tx_count, int rx_count)
+{
+	const uint8_t *data;
+	const rec_hdr *hdr;
+	int len;
+
+	hdr = next(&data);
+	if (hdr && hdr->dir == REC_DROP) {
+		log_err("replay: %u frames lost by the recorder at frame "
+			"%llu, the capture ends here",
+			ntohl(*(const uint32_t *)data),
+			(unsigned long long)frames);
+		return 1;
+	}
+
+	if (!hdr || hdr->dir != REC_OUT) {
+		log_err("replay: end of capture at frame %llu",
+			(unsigned long long)frames);
+		return 1;
+	}
+
+	len = std::min<int>(ntohs(hdr->len), tx_count);
+	if (ntohs(hdr->size) != tx_count || memcmp(obuf, data, len)) {
+		if (!diverged++) {
+			log_wrn("replay: frame %llu differs from the capture",
+				(unsigned long long)frames);
+			if (opts::get().verbose) {
+				log_buffer(data, std::min(len, 32));
+				log_buffer(obuf, std::min(tx_count, 32));
+			}
+		}
+	}
+	frames++;
+
+	if (pos < capture.size() &&
+	    ((const rec_hdr *)(capture.data() + pos))->dir != REC_IN)
+		return 1;
+
+	hdr = next(&data);
+	if (!hdr) {
+		log_err("replay: truncated capture");
+		return 1;
+	}
+
+	if (speed > 0)
+		std::this_thread::sleep_until(start +
+			microseconds((uint64_t)(capture_us / speed)));
+
+	memset(ibuf, 0, rx_count);
+	memcpy(ibuf, data, std::min<int>(ntohs(hdr->len), rx_count));
+	frames++;
+
+	return 0;
+}
@@ -0,0 +1,427 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "driver-sim.hh"
+#include "bdm.hh"
+#include "getopts.hh"
+#include "trace.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <thread>
+#include <arpa/inet.h>
+
+using namespace trace;
+using namespace std::chrono;
+
+/* MCF5282 like: v2, isa a, mac, div, 64K sram */
+static constexpr uint32_t SIM_RESET_D0 = 0xcf21c000;
+static constexpr uint32_t SIM_RESET_D1 = 0x00000080;
+/* bstat, fof, trg, halt, bkpt: read only, cleared by reads */
+static constexpr uint32_t SIM_CSR_STATUS = 0xff000000;
+
+static constexpr char SIM_VERSION_STR[] = "P&E,sim,opencf,0,0,0,9.60,";
+
+static inline uint16_t get16(const uint8_t *p)
+{
+	return ntohs(*(uint16_t *)p);
+}
+
+static inline uint32_t get32(const uint8_t *p)
+{
+	return ntohl(*(uint32_t *)p);
+}
+
+driver_sim::driver_sim(libusb_device *device) : driver_pemu(device),
+	pages(1 << (32 - SIM_PAGE_SHIFT))
+{
+}
+
+driver_sim::~driver_sim()
+{
+	log_info("sim: %llu transactions, %llu bytes, %llu ms modeled",
+		 (unsigned long long)xacts, (unsigned long long)bytes,
+		 (unsigned long long)model_us / 1000);
+}
+
+int driver_sim::probe()
+{
+	const string &spec = opts::get().sim;
+	size_t colon = spec.find(':');
+
+	latency_us = atoi(spec.c_str());
+	if (colon != string::npos) {
+		kbytes_s = atoi(spec.c_str() + colon + 1);
+		colon = spec.find(':', colon + 1);
+		if (colon != string::npos)
+			min_div = atoi(spec.c_str() + colon + 1);
+	}
+
+	clock_div = SIM_DEFAULT_CLOCK;
+
+	log_info("simulated pod, latency %dus, bandwidth %s", latency_us,
+		 kbytes_s ? (std::to_string(kbytes_s) + "KB/s").c_str() :
+		 "unlimited");
+	if (min_div)
+		log_info("simulated pod, link unreliable below bdm clock /%d",
+			 min_div);
+
+	reset_core();
+
+	return 0;
+}
+
+vector<int> driver_sim::get_bdm_clocks()
+{
+	return vector<int>(std::begin(SIM_CLOCKS), std::end(SIM_CLOCKS));
+}
+
+int driver_sim::set_bdm_clock(int div, bool fallback)
+{
+	vector<int> divs = get_bdm_clocks();
+
+	if (std::find(divs.begin(), divs.end(), div) == divs.end())
+		return 1;
+
+	clock_div = div;
+	clock_fallback = fallback;
+
+	return 0;
+}
+
+/*
+ * Big endian, unwritten memory reads as 0.
+ */
+uint32_t driver_sim::mem_read(uint32_t addr, int size)
+{
+	uint32_t value = 0;
+	uint8_t *p;
+	int i;
+
+	for (i = 0; i < size; ++i, ++addr) {
+		p = page(addr, false);
+		value = (value << 8) |
+			(p ? p[addr & (SIM_PAGE_SIZE - 1)] : 0);
+	}
+
+	return value;
+}
+
+void driver_sim::mem_write(uint32_t addr, int size, uint32_t value)
+{
+	int i;
+
+	for (i = size - 1; i >= 0; --i, value >>= 8)
+		page(addr + i, true)[(addr + i) & (SIM_PAGE_SIZE - 1)] = value;
+}
+
+void driver_sim::halt_core(uint32_t status)
+{
+	running = false;
+	csr_status |= status;
+}
+
+void driver_sim::reset_core()
+{
+	memset(ad, 0, sizeof(ad));
+	memset(dm, 0, sizeof(dm));
+	ctrl.clear();
+
+	ad[CF_D0] = SIM_RESET_D0;
+	ad[CF_D1] = SIM_RESET_D1;
+	ad[CF_SP] = mem_read(0, 4);
+	ctrl[crt_sr] = 0x2700;
+	ctrl[crt_pc] = mem_read(4, 4);
+
+	halt_core(CSR_HALT);
+}
+
+/*
+ * No instruction model here, a step completes at once and a run
+ * goes on until halted.
+ */
+void driver_sim::run(bool step)
+{
+	if (step)
+		halt_core(CSR_HALT);
+}
+
+/*
+ * d0-a7 are also mapped in the control register space.
+ */
+uint32_t *driver_sim::ctrl_reg(uint32_t reg)
+{
+	if ((reg & 0xef0) == 0x080)
+		return &ad[reg & 0xf];
+
+	return &ctrl[reg];
+}
+
+void driver_sim::reset_line(uint8_t state)
+{
+	if (state == 0xf0) {
+		in_reset = true;
+		running = false;
+		return;
+	}
+
+	if (in_reset)
+		reset_core();
+	else if (running)
+		halt_core(CSR_HALT);
+
+	in_reset = false;
+}
+
+/*
+ * Bdm command at cmd, reply as the pod returns it: byte and word
+ * values in the upper half of the first long. Cpu registers need a
+ * halted core, a running one answers not ready, status 1.
+ */
+int driver_sim::bdm_command(const uint8_t *cmd, uint8_t *reply)
+{
+	uint16_t op = get16(cmd);
+	uint32_t value = 0, reg = op & 0xf;
+	int size;
+
+	switch (op & 0xfff0) {
+	case CMD_BDMCF_RDAREG:
+	case CMD_BDMCF_WDAREG:
+	case CMD_BDMCF_RCREG:
+	case CMD_BDMCF_WCREG:
+		if (running) {
+			*(uint32_t *)reply = 0;
+			return 1;
+		}
+		break;
+	}
+
+	switch (op & 0xffc0) {
+	case CMD_BDMCF_RD_MEM_B:
+	case CMD_BDMCF_WR_MEM_B:
+	case CMD_BDMCF_DUMP_B:
+	case CMD_BDMCF_FILL_B:
+		size = 1;
+		break;
+	case CMD_BDMCF_RD_MEM_W:
+	case CMD_BDMCF_WR_MEM_W:
+	case CMD_BDMCF_DUMP_W:
+	case CMD_BDMCF_FILL_W:
+		size = 2;
+		break;
+	default:
+		size = 4;
+		break;
+	}
+
+	switch (op & 0xfff0) {
+	case CMD_BDMCF_RDMREG:
+		value = dm[reg];
+		if (reg == BDM_REG_CSR) {
+			value |= csr_status;
+			csr_status = 0;
+		}
+		break;
+	case CMD_BDMCF_WDMREG:
+		dm[reg] = get32(&cmd[2]);
+		if (reg == BDM_REG_CSR)
+			dm[reg] &= ~SIM_CSR_STATUS;
+		break;
+	case CMD_BDMCF_RDAREG:
+		value = ad[reg];
+		break;
+	case CMD_BDMCF_WDAREG:
+		ad[reg] = get32(&cmd[2]);
+		break;
+	case CMD_BDMCF_RCREG:
+		value = *ctrl_reg(get32(&cmd[2]));
+		break;
+	case CMD_BDMCF_WCREG:
+		*ctrl_reg(get32(&cmd[2])) = get32(&cmd[6]);
+		break;
+	case CMD_BDMCF_RD_MEM_B:
+	case CMD_BDMCF_RD_MEM_W:
+	case CMD_BDMCF_RD_MEM_L:
+		dump_addr = get32(&cmd[2]);
+		value = mem_read(dump_addr, size) << (size < 4 ? 16 : 0);
+		break;
+	case CMD_BDMCF_DUMP_B:
+	case CMD_BDMCF_DUMP_W:
+	case CMD_BDMCF_DUMP_L:
+		dump_addr += size;
+		value = mem_read(dump_addr, size) << (size < 4 ? 16 : 0);
+		break;
+	case CMD_BDMCF_WR_MEM_B:
+	case CMD_BDMCF_WR_MEM_W:
+	case CMD_BDMCF_WR_MEM_L:
+		dump_addr = get32(&cmd[2]);
+		mem_write(dump_addr, size,
+			  size < 4 ? get16(&cmd[6]) : get32(&cmd[6]));
+		break;
+	case CMD_BDMCF_FILL_B:
+	case CMD_BDMCF_FILL_W:
+	case CMD_BDMCF_FILL_L:
+		dump_addr += size;
+		mem_write(dump_addr, size,
+			  size < 4 ? get16(&cmd[2]) : get32(&cmd[2]));
+		break;
+	default:
+		log_dbg("sim: unhandled bdm command %04x", op);
+		break;
+	}
+
+	*(uint32_t *)reply = htonl(value);
+
+	return 0;
+}
+
+/*
+ * The pemu reply has no room for the bdm response status, the sim
+ * knows it and reports not ready commands as refused.
+ */
+int driver_sim::xfer_bdm_data(char *io_buff, int size)
+{
+	refused = false;
+
+	if (driver_pemu::xfer_bdm_data(io_buff, size))
+		return xr_link;
+
+	return refused ? xr_refused : xr_ok;
+}
+
+/*
+ * Transaction cost, the caller is kept busy as the usb one would.
+ */
+void driver_sim::model(int size)
+{
+	steady_clock::time_point now = steady_clock::now();
+	uint64_t cost;
+
+	xacts++;
+	bytes += size;
+
+	if (!latency_us && !kbytes_s)
+		return;
+
+	cost = latency_us;
+	if (kbytes_s)
+		cost += (uint64_t)size * 1000000 * clock_div /
+			(kbytes_s * 1024ull * SIM_DEFAULT_CLOCK);
+
+	model_us += cost;
+
+	if (busy_until < now)
+		busy_until = now;
+	busy_until += microseconds(cost);
+
+	std::this_thread::sleep_until(busy_until);
+}
+
+/*
+ * Too fast a bdm clock, exchanges go wrong more often the further
+ * the divider is below min_div, 1 in 4096 at one below.
+ */
+bool driver_sim::link_fault()
+{
+	int below = min_div - clock_div;
+
+	if (below <= 0)
+		return false;
+
+	noise ^= noise << 13;
+	noise ^= noise >> 17;
+	noise ^= noise << 5;
+
+	return (int)((noise >> 8) & 0xfff) < below * below;
+}
+
+void driver_sim::garble()
+{
+	ibuf[OFS_BDM_PREFIX + (noise & 3)] ^= 1 << ((noise >> 2) & 7);
+}
+
+/*
+ * A faulty exchange either never reaches the core, or comes back
+ * with a flipped bit.
+ */
+int driver_sim::send_and_recv(int tx_count, int rx_count)
+{
+	int err;
+
+	model(tx_count + rx_count);
+
+	if (link_fault())
+		return 1;
+
+	err = process(rx_count);
+	if (!err && link_fault())
+		garble();
+
+	return err;
+}
+
+/*
+ * Decode the packet in obuf, reply in ibuf.
+ */
+int driver_sim::process(int rx_count)
+{
+	uint32_t addr;
+	int size, i;
+
+	memset(ibuf, 0, rx_count);
+
+	switch (get16(obuf)) {
+	case PEMU_PT_GENERIC:
+		if (obuf[5] == CMD_PEMU_GET_VERSION_STR) {
+			memcpy(ibuf, REP_VERSION_INFO,
+			       sizeof(REP_VERSION_INFO));
+			strcpy((char *)&ibuf[PEMU_CMD_REPLY_LEN],
+			       SIM_VERSION_STR);
+		}
+		break;
+	case PEMU_PT_WBLOCK:
+		size = get16(&obuf[6]);
+		addr = get32(&obuf[8]);
+		for (i = 0; i < size; ++i)
+			mem_write(addr + i, 1, obuf[12 + i]);
+		break;
+	case PEMU_PT_CMD:
+		switch (obuf[OFS_BDM_PREFIX]) {
+		case CMD_PEMU_RESET:
+			reset_line(obuf[OFS_BDM]);
+			break;
+		case CMD_PEMU_GO:
+			running = true;
+			run(dm[BDM_REG_CSR] & CSR_SSM);
+			break;
+		default:
+			refused = bdm_command(&obuf[OFS_BDM],
+					      &ibuf[OFS_BDM_PREFIX]);
+			break;
+		}
+		break;
+	default:
+		log_err("sim: unknown packet type %04x", get16(obuf));
+		return 1;
+	}
+
+	return 0;
+}
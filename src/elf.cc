@@ -22,15 +22,18 @@
 #include "fs.hh"
 #include "utils.hh"
 #include "elf.hh"
+#include "parts.hh"
 
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
-#include <unistd.h>
+#include <algorithm>
 #include <elf.h>
 
 using namespace trace;
 
 static constexpr uint32_t elf_magic = 0x464c457f;
+static constexpr int elf_ready_timeout_ms = 100;
 
 using namespace fs;
 using namespace utils;
@@ -89,10 +92,10 @@ int elf::load_program_headers(const char *elf, const char *offs, int entries)
 			|| flags == (PF_R | PF_W))) {
 
 			if (phdr->p_filesz)
-				bdm->load_segment((unsigned char *)
-					elf + ntohl(phdr->p_offset),
-					ntohl(phdr->p_paddr),
-					ntohl(phdr->p_filesz));
+				segments.push_back({ ntohl(phdr->p_paddr),
+					ntohl(phdr->p_filesz),
+					(uint8_t *)elf +
+					ntohl(phdr->p_offset) });
 		}
 
 		ptr += sizeof(Elf32_Phdr);
@@ -101,7 +104,157 @@ int elf::load_program_headers(const char *elf, const char *offs, int entries)
 	return 0;
 }
 
-char *elf::load_elf(const string &path)
+elf::~elf()
+{
+	if (image)
+		delete[] image;
+}
+
+/*
+ * Collect function and object symbols from .symtab, sorted by address.
+ */
+int elf::read_symtab(const char *elf)
+{
+	Elf32_Ehdr *ehdr = (Elf32_Ehdr *)elf;
+	Elf32_Shdr *shdr, *strtab;
+	Elf32_Sym *sym;
+	int i, shnum, count;
+
+	symbols.clear();
+
+	if (!ehdr->e_shoff)
+		return -1;
+
+	shdr = (Elf32_Shdr *)&elf[ntohl(ehdr->e_shoff)];
+	shnum = ntohs(ehdr->e_shnum);
+
+	for (i = 0; i < shnum; ++i, ++shdr) {
+		if (ntohl(shdr->sh_type) == SHT_SYMTAB)
+			break;
+	}
+
+	if (i == shnum) {
+		log_wrn("no symbol table found");
+		return -1;
+	}
+
+	strtab = (Elf32_Shdr *)&elf[ntohl(ehdr->e_shoff)] +
+		 ntohl(shdr->sh_link);
+	sym = (Elf32_Sym *)&elf[ntohl(shdr->sh_offset)];
+	count = ntohl(shdr->sh_size) / sizeof(Elf32_Sym);
+
+	for (i = 0; i < count; ++i, ++sym) {
+		int type = ELF32_ST_TYPE(sym->st_info);
+
+		if ((type != STT_FUNC && type != STT_OBJECT) || !sym->st_name)
+			continue;
+
+		symbols.push_back({ ntohl(sym->st_value),
+				    ntohl(sym->st_size),
+				    (uint8_t)type,
+				    &elf[ntohl(strtab->sh_offset) +
+					 ntohl(sym->st_name)] });
+	}
+
+	sort(symbols.begin(), symbols.end(),
+	     [](const elf_symbol &a, const elf_symbol &b) {
+		return a.addr < b.addr;
+	});
+
+	log_dbg("%s() %d symbols", __func__, (int)symbols.size());
+
+	return 0;
+}
+
+const elf_symbol *elf::find_function(uint32_t addr) const
+{
+	auto it = upper_bound(symbols.begin(), symbols.end(), addr,
+			      [](uint32_t a, const elf_symbol &s) {
+		return a < s.addr;
+	});
+
+	while (it != symbols.begin()) {
+		--it;
+		if (it->type != STT_FUNC)
+			continue;
+		if (!it->size || addr < it->addr + it->size)
+			return &*it;
+		break;
+	}
+
+	return NULL;
+}
+
+const elf_symbol *elf::find_symbol(const string &name) const
+{
+	for (const elf_symbol &s : symbols) {
+		if (s.name == name)
+			return &s;
+	}
+
+	return NULL;
+}
+
+/*
+ * Return address from the .debug_frame rules at pc, or from the stack
+ * top while pc is still at the function entry or at its rts, before
+ * or after the frame. Anything else has no reliable answer.
+ */
+int elf::return_address(bdm_ops *b, uint32_t pc, uint32_t &ret) const
+{
+	const elf_symbol *f;
+	frame_rule r;
+	uint32_t cfa;
+
+	if (frames.find(pc, r) == 0) {
+		cfa = b->read_ad_reg(r.cfa_reg) + r.cfa_offset;
+		ret = b->read_mem_long(cfa + r.ra_offset);
+		return 0;
+	}
+
+	f = find_function(pc);
+
+	if ((f && f->addr == pc) || (b->read_mem_word(pc) >> 16) == OP_RTS) {
+		ret = b->read_mem_long(b->read_ad_reg(CF_SP));
+		return 0;
+	}
+
+	log_err("no frame info at %08x, finish needs .debug_frame (-g) "
+		"or pc at the function entry", pc);
+
+	return -1;
+}
+
+/*
+ * Symbols only, for targets already programmed.
+ */
+int elf::load_symbols(const string &path)
+{
+	char *elf;
+	int rval;
+
+	elf = load_file_to_mem(path.c_str());
+	if (!elf)
+		return -1;
+
+	if (strncmp(elf, ELFMAG, 4) != 0) {
+		log_err("not an elf file");
+		delete[] elf;
+		return -1;
+	}
+
+	rval = read_symtab(elf);
+	frames.parse(elf);
+
+	delete[] elf;
+
+	return rval;
+}
+
+/*
+ * Parse only, the image can then be programmed on more targets.
+ */
+int elf::parse(const string &path)
 {
 	Elf32_Ehdr *ehdr;
 
@@ -112,7 +265,7 @@ char *elf::load_elf(const string &path)
 
 	elf = load_file_to_mem(path.c_str());
 	if (!elf)
-		return NULL;
+		return -1;
 
 	ehdr = (Elf32_Ehdr *)elf;
 
@@ -131,18 +284,204 @@ char *elf::load_elf(const string &path)
 	log_dbg("%s() e_entry %08x, e_phoff %08x", __func__,
 		ntohl(ehdr->e_entry), ntohl(ehdr->e_phoff));
 
+	segments.clear();
+
 	if (ehdr->e_phoff)
 		load_program_headers(elf, &elf[ntohl(ehdr->e_phoff)],
 				     ntohs(ehdr->e_phnum));
 
-	usleep(1000);
+	entry = ntohl(ehdr->e_entry);
 
-	bdm->write_ctrl_reg(crt_pc, ntohl(ehdr->e_entry));
+	read_symtab(elf);
+	frames.parse(elf);
 
-	return elf;
+	if (image)
+		delete[] image;
+	image = elf;
+
+	return 0;
 
 exit_err:
 	delete[] elf;
 
-	return NULL;
+	return -1;
+}
+
+/*
+ * With verify, each segment is read back as it is loaded and the
+ * differing chunks are written again.
+ */
+int elf::program(bdm_ops *b, bool verify) const
+{
+	int err;
+
+	for (auto &seg : segments) {
+		if (verify)
+			err = b->load_verified((uint8_t *)seg.data, seg.addr,
+					       seg.size);
+		else
+			err = b->load_segment((uint8_t *)seg.data, seg.addr,
+					      seg.size);
+		if (err)
+			return -1;
+	}
+
+	/* bdm answering again after the block writes */
+	b->poll_csr(0, elf_ready_timeout_ms);
+
+	b->write_ctrl_reg(crt_pc, entry);
+
+	return 0;
+}
+
+/*
+ * Segments against the memory map of the part found on attach. Sram
+ * and flash are where the target bars map them: a segment overlapping
+ * disabled sram, enabled flash or peripherals, or running past sram,
+ * would be lost and is refused unless forced. External regions are
+ * the evaluation board ones, a segment there or outside the map is
+ * only reported. Slower memory is reported when sram could hold it.
+ */
+int elf::check(bdm_ops *b, bool force) const
+{
+	const cf_cpu *part = b->get_part();
+	const cf_region *r, *fast, *sram = NULL, *flash;
+	uint32_t rambar, flashbar = 0, base, fbase = 0, end;
+	char msg[128];
+	int err = 0;
+
+	if (!part)
+		return 0;
+
+	for (auto &i : part->regions) {
+		if (i.type == rt_sram)
+			sram = &i;
+	}
+
+	rambar = b->read_ctrl_reg(crt_rambar);
+	base = rambar & 0xffff0000;
+
+	flash = part->onchip_flash();
+	if (flash) {
+		flashbar = b->read_ctrl_reg(crt_flashbar);
+		fbase = flashbar & ~(flash->size - 1);
+	}
+
+	for (auto &seg : segments) {
+		if (!seg.size)
+			continue;
+
+		end = seg.addr + seg.size - 1;
+		msg[0] = 0;
+
+		/* sram is where rambar maps it */
+		if (sram && (rambar & 1) && seg.addr <= base + sram->size - 1 &&
+		    end >= base) {
+			if (seg.addr >= base && end - base < sram->size)
+				continue;
+			snprintf(msg, sizeof(msg), "segment %08x-%08x "
+				 "crosses sram %08x-%08x", seg.addr, end, base,
+				 base + sram->size - 1);
+		}
+
+		/* and flash where flashbar does */
+		if (!msg[0] && flash && (flashbar & 1) &&
+		    seg.addr <= fbase + flash->size - 1 && end >= fbase)
+			snprintf(msg, sizeof(msg), "segment %08x-%08x overlaps "
+				 "%s at %08x, loads can't write it", seg.addr,
+				 end, flash->name, fbase);
+
+		for (auto &i : part->regions) {
+			/* other flash is the board one */
+			bool board = i.type == rt_external ||
+				     i.type == rt_flash;
+
+			if (msg[0] || board ||
+			    seg.addr > i.base + i.size - 1 || end < i.base)
+				continue;
+
+			if (i.type == rt_sram && !(rambar & 1))
+				snprintf(msg, sizeof(msg), "segment %08x-%08x is "
+					 "in sram, not enabled, rambar %08x",
+					 seg.addr, end, rambar);
+			else if (i.type != rt_sram)
+				snprintf(msg, sizeof(msg), "segment %08x-%08x "
+					 "overlaps %s, loads can't write it",
+					 seg.addr, end, i.name);
+		}
+
+		if (msg[0]) {
+			if (force) {
+				log_wrn("%s, forced", msg);
+			} else {
+				log_err("%s, --force loads it anyway", msg);
+				err = -1;
+			}
+			continue;
+		}
+
+		/* the flash of the table only when flashbar maps it there */
+		r = part->region(seg.addr);
+		if (r && r == flash && (!(flashbar & 1) || fbase != r->base))
+			r = NULL;
+		if (!r || end - r->base >= r->size) {
+			log_wrn("segment %08x-%08x is outside the %s board "
+				"map, loaded as is", seg.addr, end, part->name);
+			continue;
+		}
+
+		if (r->type == rt_external)
+			log_wrn("segment %08x-%08x is in board %s, its "
+				"controller must be set up first", seg.addr,
+				end, r->name);
+
+		fast = part->fastest(seg.size);
+		if (fast && fast->type < r->type)
+			log_wrn("segment at %08x loads to %s, %s is faster",
+				seg.addr, r->name, fast->name);
+	}
+
+	return err;
+}
+
+/*
+ * Read back all segments with block reads.
+ */
+int elf::verify(bdm_ops *b) const
+{
+	vector<uint8_t> buf;
+
+	for (auto &seg : segments) {
+		buf.resize(seg.size);
+
+		if (b->read_block(seg.addr, buf.data(), seg.size))
+			return -1;
+
+		if (memcmp(buf.data(), seg.data, seg.size) != 0) {
+			log_err("verify failed, segment at %08x", seg.addr);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+uint32_t elf::image_size() const
+{
+	uint32_t size = 0;
+
+	for (auto &seg : segments)
+		size += seg.size;
+
+	return size;
+}
+
+char *elf::load_elf(const string &path)
+{
+	if (parse(path))
+		return NULL;
+
+	program(bdm);
+
+	return image;
 }
@@ -0,0 +1,408 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "frame.hh"
+#include "trace.hh"
+
+#include <cstring>
+#include <elf.h>
+#include <arpa/inet.h>
+
+using namespace trace;
+
+enum dw_cfa {
+	DW_CFA_nop = 0x00,
+	DW_CFA_set_loc = 0x01,
+	DW_CFA_advance_loc1 = 0x02,
+	DW_CFA_advance_loc2 = 0x03,
+	DW_CFA_advance_loc4 = 0x04,
+	DW_CFA_offset_extended = 0x05,
+	DW_CFA_restore_extended = 0x06,
+	DW_CFA_undefined = 0x07,
+	DW_CFA_same_value = 0x08,
+	DW_CFA_register = 0x09,
+	DW_CFA_remember_state = 0x0a,
+	DW_CFA_restore_state = 0x0b,
+	DW_CFA_def_cfa = 0x0c,
+	DW_CFA_def_cfa_register = 0x0d,
+	DW_CFA_def_cfa_offset = 0x0e,
+	DW_CFA_def_cfa_expression = 0x0f,
+	DW_CFA_expression = 0x10,
+	DW_CFA_offset_extended_sf = 0x11,
+	DW_CFA_def_cfa_sf = 0x12,
+	DW_CFA_def_cfa_offset_sf = 0x13,
+	DW_CFA_val_offset = 0x14,
+	DW_CFA_val_offset_sf = 0x15,
+	DW_CFA_val_expression = 0x16,
+	DW_CFA_GNU_args_size = 0x2e,
+	DW_CFA_GNU_negative_offset_extended = 0x2f,
+	/* high 2 bits, operand in the low 6 */
+	DW_CFA_advance_loc = 0x40,
+	DW_CFA_offset = 0x80,
+	DW_CFA_restore = 0xc0,
+};
+
+static constexpr uint32_t DW_CIE_ID = 0xffffffff;
+
+/*
+ * Big endian and leb128 reads, past the end reads give 0 and set bad.
+ */
+struct dw_cursor {
+	dw_cursor(const uint8_t *start, const uint8_t *stop) :
+		p(start), end(stop) {}
+
+	uint8_t u8() {
+		if (p >= end) {
+			bad = true;
+			return 0;
+		}
+		return *p++;
+	}
+
+	uint16_t u16() {
+		uint16_t v = u8() << 8;
+
+		return v | u8();
+	}
+
+	uint32_t u32() {
+		uint32_t v = u16() << 16;
+
+		return v | u16();
+	}
+
+	uint32_t uleb() {
+		uint32_t v = 0;
+		int shift = 0;
+		uint8_t b;
+
+		do {
+			b = u8();
+			if (shift < 32)
+				v |= (uint32_t)(b & 0x7f) << shift;
+			shift += 7;
+		} while ((b & 0x80) && !bad);
+
+		return v;
+	}
+
+	int32_t sleb() {
+		uint32_t v = 0;
+		int shift = 0;
+		uint8_t b;
+
+		do {
+			b = u8();
+			if (shift < 32)
+				v |= (uint32_t)(b & 0x7f) << shift;
+			shift += 7;
+		} while ((b & 0x80) && !bad);
+
+		if (shift < 32 && (b & 0x40))
+			v |= ~0u << shift;
+
+		return v;
+	}
+
+	void skip(uint32_t n) {
+		if ((uint32_t)(end - p) < n) {
+			bad = true;
+			p = end;
+			return;
+		}
+		p += n;
+	}
+
+	const uint8_t *p;
+	const uint8_t *end;
+	bool bad {};
+};
+
+/*
+ * .debug_frame copied, symbols only loads do not keep the image.
+ * Entries are a cie or an fde: u32 length, u32 cie id or pointer.
+ */
+int call_frames::parse(const char *elf)
+{
+	Elf32_Ehdr *ehdr = (Elf32_Ehdr *)elf;
+	Elf32_Shdr *shdr, *names;
+	uint32_t off, len, id, end;
+	int i, shnum;
+
+	section.clear();
+	cies.clear();
+	fdes.clear();
+
+	if (!ehdr->e_shoff)
+		return -1;
+
+	shdr = (Elf32_Shdr *)&elf[ntohl(ehdr->e_shoff)];
+	shnum = ntohs(ehdr->e_shnum);
+	names = shdr + ntohs(ehdr->e_shstrndx);
+
+	for (i = 0; i < shnum; ++i, ++shdr) {
+		if (!strcmp(&elf[ntohl(names->sh_offset) +
+				 ntohl(shdr->sh_name)], ".debug_frame"))
+			break;
+	}
+
+	if (i == shnum)
+		return -1;
+
+	section.assign((const uint8_t *)&elf[ntohl(shdr->sh_offset)],
+		       (const uint8_t *)&elf[ntohl(shdr->sh_offset) +
+					     ntohl(shdr->sh_size)]);
+
+	/* cies first, fdes can then point to any of them */
+	for (int pass = 0; pass < 2; ++pass) {
+		for (off = 0; off + 8 <= section.size(); off = end) {
+			dw_cursor c(&section[off], section.data() +
+				    section.size());
+
+			len = c.u32();
+			id = c.u32();
+			end = off + 4 + len;
+
+			/* 64 bit dwarf is not expected on coldfire */
+			if (len == 0xffffffff || len < 4 ||
+			    end > section.size())
+				break;
+
+			c.end = &section[0] + end;
+
+			if (id == DW_CIE_ID && pass == 0) {
+				cie e {};
+				uint8_t version = c.u8();
+
+				/* augmented cies are not supported */
+				if (c.u8())
+					continue;
+				if (version >= 4)
+					c.skip(2);
+
+				e.offset = off;
+				e.code_align = c.uleb();
+				e.data_align = c.sleb();
+				e.ra_reg = version == 1 ? c.u8() : c.uleb();
+				e.insns = c.p - section.data();
+				e.insns_end = end;
+
+				if (!c.bad)
+					cies.push_back(e);
+			} else if (id != DW_CIE_ID && pass == 1) {
+				fde f {};
+
+				f.cie = -1;
+				for (i = 0; i < (int)cies.size(); ++i) {
+					if (cies[i].offset == id)
+						f.cie = i;
+				}
+
+				f.pc_start = c.u32();
+				f.pc_end = f.pc_start + c.u32();
+				f.insns = c.p - section.data();
+				f.insns_end = end;
+
+				if (f.cie >= 0 && !c.bad)
+					fdes.push_back(f);
+			}
+		}
+	}
+
+	log_dbg("%s() %d cies, %d fdes", __func__, (int)cies.size(),
+		(int)fdes.size());
+
+	return 0;
+}
+
+/*
+ * Cfa instructions from..to, starting at loc, up to pc. Rules of
+ * other registers are skipped, expressions fail if they involve the
+ * cfa or the return address.
+ */
+bool call_frames::execute(const cie &c, uint32_t from, uint32_t to,
+			  uint32_t loc, uint32_t pc, const state &init,
+			  state &s) const
+{
+	dw_cursor cur(&section[0] + from, &section[0] + to);
+	vector<state> stack;
+	uint32_t reg, delta;
+	int32_t off;
+	uint8_t op;
+
+	while (cur.p < cur.end && !cur.bad) {
+		op = cur.u8();
+		delta = 0;
+
+		switch (op & 0xc0) {
+		case DW_CFA_advance_loc:
+			delta = (op & 0x3f) * c.code_align;
+			goto advance;
+		case DW_CFA_offset:
+			reg = op & 0x3f;
+			off = cur.uleb() * c.data_align;
+			goto offset;
+		case DW_CFA_restore:
+			reg = op & 0x3f;
+			goto restore;
+		}
+
+		switch (op) {
+		case DW_CFA_nop:
+			continue;
+		case DW_CFA_set_loc:
+			loc = cur.u32();
+			if (loc > pc)
+				return true;
+			continue;
+		case DW_CFA_advance_loc1:
+			delta = cur.u8() * c.code_align;
+			goto advance;
+		case DW_CFA_advance_loc2:
+			delta = cur.u16() * c.code_align;
+			goto advance;
+		case DW_CFA_advance_loc4:
+			delta = cur.u32() * c.code_align;
+			goto advance;
+		case DW_CFA_offset_extended:
+			reg = cur.uleb();
+			off = cur.uleb() * c.data_align;
+			goto offset;
+		case DW_CFA_offset_extended_sf:
+			reg = cur.uleb();
+			off = cur.sleb() * c.data_align;
+			goto offset;
+		case DW_CFA_GNU_negative_offset_extended:
+			reg = cur.uleb();
+			off = -(int32_t)cur.uleb() * c.data_align;
+			goto offset;
+		case DW_CFA_restore_extended:
+			reg = cur.uleb();
+			goto restore;
+		case DW_CFA_undefined:
+		case DW_CFA_same_value:
+			if (cur.uleb() == c.ra_reg)
+				s.ra_saved = false;
+			continue;
+		case DW_CFA_register:
+		case DW_CFA_val_offset:
+		case DW_CFA_val_offset_sf:
+			/* return address kept in a register or computed */
+			if (cur.uleb() == c.ra_reg)
+				return false;
+			cur.uleb();
+			continue;
+		case DW_CFA_remember_state:
+			stack.push_back(s);
+			continue;
+		case DW_CFA_restore_state:
+			if (stack.empty())
+				return false;
+			s = stack.back();
+			stack.pop_back();
+			continue;
+		case DW_CFA_def_cfa:
+			s.cfa_reg = cur.uleb();
+			s.cfa_offset = cur.uleb();
+			continue;
+		case DW_CFA_def_cfa_sf:
+			s.cfa_reg = cur.uleb();
+			s.cfa_offset = cur.sleb() * c.data_align;
+			continue;
+		case DW_CFA_def_cfa_register:
+			s.cfa_reg = cur.uleb();
+			continue;
+		case DW_CFA_def_cfa_offset:
+			s.cfa_offset = cur.uleb();
+			continue;
+		case DW_CFA_def_cfa_offset_sf:
+			s.cfa_offset = cur.sleb() * c.data_align;
+			continue;
+		case DW_CFA_expression:
+		case DW_CFA_val_expression:
+			if (cur.uleb() == c.ra_reg)
+				return false;
+			cur.skip(cur.uleb());
+			continue;
+		case DW_CFA_GNU_args_size:
+			cur.uleb();
+			continue;
+		default:
+			/* DW_CFA_def_cfa_expression and unknown ones */
+			return false;
+		}
+
+advance:
+		loc += delta;
+		if (loc > pc)
+			return true;
+		continue;
+offset:
+		if (reg == c.ra_reg) {
+			s.ra_saved = true;
+			s.ra_offset = off;
+		}
+		continue;
+restore:
+		if (reg == c.ra_reg) {
+			s.ra_saved = init.ra_saved;
+			s.ra_offset = init.ra_offset;
+		}
+	}
+
+	return !cur.bad;
+}
+
+/*
+ * Rules at pc, from the cie initial instructions and then the ones
+ * of the fde covering pc.
+ */
+int call_frames::find(uint32_t pc, frame_rule &r) const
+{
+	state init {}, s;
+
+	for (auto &f : fdes) {
+		if (pc < f.pc_start || pc >= f.pc_end)
+			continue;
+
+		const cie &c = cies[f.cie];
+
+		init.cfa_reg = -1;
+		if (!execute(c, c.insns, c.insns_end, 0, 0xffffffff, init,
+			     init))
+			return -1;
+
+		s = init;
+		if (!execute(c, f.insns, f.insns_end, f.pc_start, pc, init, s))
+			return -1;
+
+		if (s.cfa_reg < 0 || s.cfa_reg > 15 || !s.ra_saved)
+			return -1;
+
+		r.cfa_reg = s.cfa_reg;
+		r.cfa_offset = s.cfa_offset;
+		r.ra_offset = s.ra_offset;
+
+		return 0;
+	}
+
+	return -1;
+}
@@ -0,0 +1,155 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gang.hh"
+#include "core.hh"
+#include "trace.hh"
+
+#include <chrono>
+#include <memory>
+#include <thread>
+
+using namespace trace;
+using namespace std::chrono;
+
+static double ms_since(steady_clock::time_point t)
+{
+	return duration_cast<microseconds>(steady_clock::now() - t)
+		.count() / 1000.0;
+}
+
+/*
+ * The image is shared read only, each worker owns its driver
+ * and bdm_ops.
+ */
+void gang::worker(const pod_info &pod, const elf &img, gang_result &res)
+{
+	steady_clock::time_point t;
+
+	res.serial = pod.serial.size() ? pod.serial : "?";
+	res.ok = false;
+
+	/* outlives the core, the usb handle is closed on any return */
+	std::unique_ptr<driver> drv(dc.create(pod.class_name, pod.device));
+	if (!drv || drv->probe()) {
+		res.error = "probe failed";
+		return;
+	}
+
+	core c(drv.get());
+
+	t = steady_clock::now();
+	if (c.attach()) {
+		res.error = "cpu not found";
+		return;
+	}
+	res.attach_ms = ms_since(t);
+
+	if (img.check(c.get_bdm())) {
+		res.error = "memory map";
+		return;
+	}
+
+	t = steady_clock::now();
+	if (img.program(c.get_bdm())) {
+		res.error = "load failed";
+		return;
+	}
+	res.load_ms = ms_since(t);
+
+	t = steady_clock::now();
+	if (img.verify(c.get_bdm()))
+		res.error = "verify failed";
+	else
+		res.ok = true;
+	res.verify_ms = ms_since(t);
+}
+
+void gang::report(const vector<gang_result> &results, uint32_t size,
+		  double total_ms)
+{
+	int passed = 0;
+
+	log_ansi(ANSI_BOLD, "pod  serial            result  attach   "
+		 "load     verify   KB/s");
+
+	for (unsigned int i = 0; i < results.size(); ++i) {
+		const gang_result &r = results[i];
+
+		if (r.ok) {
+			passed++;
+			log_info("%-4d %-17s pass    %-8.0f %-8.0f %-8.0f %.1f",
+				 i, r.serial.c_str(), r.attach_ms, r.load_ms,
+				 r.verify_ms,
+				 r.load_ms ? size / r.load_ms : 0);
+		} else {
+			log_err("%-4d %-17s FAIL    %s", i, r.serial.c_str(),
+				r.error.c_str());
+		}
+	}
+
+	log_imp("%d/%d passed, %d bytes, %.0fms total", passed,
+		(int)results.size(), size, total_ms);
+}
+
+int gang::run(const string &path)
+{
+	steady_clock::time_point t = steady_clock::now();
+	vector<gang_result> results;
+	vector<std::thread> workers;
+	vector<pod_info> pods;
+	elf img(NULL);
+	unsigned int i;
+	bool ok = true;
+
+	/* parsed once, shared by all workers */
+	if (img.parse(path))
+		return 1;
+
+	if (dc.init_context())
+		return 1;
+
+	if (dc.enumerate_pods(pods) <= 0) {
+		log_err("no usb device found, exiting");
+		return 1;
+	}
+
+	log_info("%d pods, %d bytes to program", (int)pods.size(),
+		 img.image_size());
+
+	results.resize(pods.size());
+
+	for (i = 0; i < pods.size(); ++i)
+		workers.emplace_back(&gang::worker, this, std::cref(pods[i]),
+				     std::cref(img), std::ref(results[i]));
+
+	for (auto &w : workers)
+		w.join();
+
+	for (auto &p : pods)
+		libusb_unref_device(p.device);
+
+	report(results, img.image_size(), ms_since(t));
+
+	for (auto &r : results)
+		ok = ok && r.ok;
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,653 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "gdb-server.hh"
+#include "trace.hh"
+
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+using namespace trace;
+
+/* gdb register numbers, coldfire core feature */
+static constexpr int GDB_REG_PS = 16;
+static constexpr int GDB_REG_PC = 17;
+static constexpr int GDB_NUM_REGS = 18;
+
+static constexpr int SIGINT_GDB = 2;
+static constexpr int SIGTRAP_GDB = 5;
+
+static constexpr char target_xml[] =
+	"<?xml version=\"1.0\"?>\n"
+	"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+	"<target version=\"1.0\">\n"
+	"<feature name=\"org.gnu.gdb.coldfire.core\">\n"
+	"<reg name=\"d0\" bitsize=\"32\"/>\n"
+	"<reg name=\"d1\" bitsize=\"32\"/>\n"
+	"<reg name=\"d2\" bitsize=\"32\"/>\n"
+	"<reg name=\"d3\" bitsize=\"32\"/>\n"
+	"<reg name=\"d4\" bitsize=\"32\"/>\n"
+	"<reg name=\"d5\" bitsize=\"32\"/>\n"
+	"<reg name=\"d6\" bitsize=\"32\"/>\n"
+	"<reg name=\"d7\" bitsize=\"32\"/>\n"
+	"<reg name=\"a0\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+	"<reg name=\"a1\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+	"<reg name=\"a2\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+	"<reg name=\"a3\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+	"<reg name=\"a4\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+	"<reg name=\"a5\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+	"<reg name=\"fp\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+	"<reg name=\"sp\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+	"<reg name=\"ps\" bitsize=\"32\"/>\n"
+	"<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>\n"
+	"</feature>\n"
+	"</target>\n";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int hex_val(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+static string hex32(uint32_t v)
+{
+	char s[9];
+
+	snprintf(s, sizeof(s), "%08x", v);
+
+	return s;
+}
+
+/*
+ * "addr,len" followed by an optional separator, hex values.
+ */
+static const char *parse_addr_len(const char *p, uint32_t &addr,
+				  uint32_t &len)
+{
+	char *end;
+
+	addr = strtoul(p, &end, 16);
+	if (*end != ',')
+		return NULL;
+	len = strtoul(end + 1, &end, 16);
+
+	return end;
+}
+
+gdb_server::~gdb_server()
+{
+	if (fd >= 0)
+		close(fd);
+	if (lfd >= 0)
+		close(lfd);
+}
+
+int gdb_server::read_byte()
+{
+	if (rx_pos == rx_len) {
+		rx_len = recv(fd, rx, sizeof(rx), 0);
+		rx_pos = 0;
+		if (rx_len <= 0) {
+			rx_len = 0;
+			return -1;
+		}
+	}
+
+	return rx[rx_pos++];
+}
+
+/*
+ * Ctrl-C from gdb while the target runs.
+ */
+bool gdb_server::interrupted()
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+
+	if (rx_pos == rx_len) {
+		if (poll(&pfd, 1, 0) <= 0)
+			return false;
+		if (read_byte() < 0)
+			return true;
+		rx_pos--;
+	}
+
+	if (rx[rx_pos] == 0x03) {
+		rx_pos++;
+		return true;
+	}
+
+	return false;
+}
+
+int gdb_server::get_packet(string &pkt)
+{
+	int c, sum, csum;
+
+	for (;;) {
+		c = read_byte();
+		if (c < 0)
+			return -1;
+		if (c == 0x03) {
+			pkt = "\x03";
+			return 0;
+		}
+		if (c != '$')
+			continue;
+
+		pkt.clear();
+		sum = 0;
+
+		while ((c = read_byte()) != '#') {
+			if (c < 0)
+				return -1;
+			pkt.push_back(c);
+			sum += c;
+		}
+
+		csum = hex_val(read_byte()) << 4;
+		csum |= hex_val(read_byte());
+
+		if (no_ack)
+			return 0;
+
+		if ((sum & 0xff) == csum) {
+			send(fd, "+", 1, 0);
+			return 0;
+		}
+
+		send(fd, "-", 1, 0);
+	}
+}
+
+int gdb_server::put_packet(const string &pkt)
+{
+	string out;
+	int sum = 0, c;
+
+	out.reserve(pkt.size() + 4);
+	out.push_back('$');
+	for (char ch : pkt) {
+		out.push_back(ch);
+		sum += (unsigned char)ch;
+	}
+	out.push_back('#');
+	out.push_back(hex_digits[(sum >> 4) & 0xf]);
+	out.push_back(hex_digits[sum & 0xf]);
+
+	for (;;) {
+		if (send(fd, out.data(), out.size(), 0) != (ssize_t)out.size())
+			return -1;
+		if (no_ack)
+			return 0;
+
+		do {
+			c = read_byte();
+			if (c < 0)
+				return -1;
+		} while (c != '+' && c != '-');
+
+		if (c == '+')
+			return 0;
+	}
+}
+
+/*
+ * Stop reply carries pc, sp and fp, saving gdb a register fetch.
+ * Breakpoint and watchpoint hits are told only for a trigger stop
+ * in csr, the pc telling which of the two fired.
+ */
+string gdb_server::stop_reply(int signal)
+{
+	uint32_t pc = bdm->read_ctrl_reg(crt_pc);
+	uint32_t csr = bdm->get_stop_csr();
+	bool trigger;
+	char hdr[4];
+	string r;
+
+	snprintf(hdr, sizeof(hdr), "T%02x", signal);
+	r = hdr;
+
+	trigger = signal == SIGTRAP_GDB &&
+		  (((csr >> CSR_BSTAT_SHIFT) & 0xf) == CSR_BSTAT_L1_HIT ||
+		   (csr & CSR_TRG));
+
+	if (trigger && bp_set && pc == bp_addr)
+		r += "hwbreak:;";
+	else if (trigger && wp_set)
+		r += "watch:" + hex32(wp_addr) + ";";
+
+	r += "0e:" + hex32(bdm->read_ad_reg(CF_FP)) + ";";
+	r += "0f:" + hex32(bdm->read_ad_reg(CF_SP)) + ";";
+	r += "11:" + hex32(pc) + ";";
+
+	return r;
+}
+
+/*
+ * All registers with a single batch.
+ */
+string gdb_server::read_regs()
+{
+	uint32_t regs[CF_NUM_REGS];
+	string r;
+	int i;
+
+	if (bdm->read_all_regs(regs))
+		return "E01";
+
+	for (i = 0; i < GDB_NUM_REGS; ++i)
+		r += hex32(regs[i]);
+
+	return r;
+}
+
+string gdb_server::write_regs(const string &args)
+{
+	uint32_t v;
+	int i;
+
+	if (args.size() < GDB_NUM_REGS * 8)
+		return "E01";
+
+	for (i = 0; i < GDB_NUM_REGS; ++i) {
+		v = strtoul(args.substr(i * 8, 8).c_str(), NULL, 16);
+		if (i < GDB_REG_PS)
+			bdm->write_ad_reg(i, v);
+		else
+			bdm->write_ctrl_reg(i == GDB_REG_PS ?
+					    crt_sr : crt_pc, v);
+	}
+
+	return "OK";
+}
+
+string gdb_server::read_reg(const string &args)
+{
+	int n = strtoul(args.c_str(), NULL, 16);
+
+	if (n < GDB_REG_PS)
+		return hex32(bdm->read_ad_reg(n));
+	if (n == GDB_REG_PS)
+		return hex32(bdm->read_ctrl_reg(crt_sr));
+	if (n == GDB_REG_PC)
+		return hex32(bdm->read_ctrl_reg(crt_pc));
+
+	return "E01";
+}
+
+string gdb_server::write_reg(const string &args)
+{
+	size_t pos = args.find('=');
+	uint32_t v;
+	int n;
+
+	if (pos == string::npos)
+		return "E01";
+
+	n = strtoul(args.c_str(), NULL, 16);
+	v = strtoul(args.c_str() + pos + 1, NULL, 16);
+
+	if (n < GDB_REG_PS)
+		bdm->write_ad_reg(n, v);
+	else if (n == GDB_REG_PS)
+		bdm->write_ctrl_reg(crt_sr, v);
+	else if (n == GDB_REG_PC)
+		bdm->write_ctrl_reg(crt_pc, v);
+	else
+		return "E01";
+
+	return "OK";
+}
+
+/*
+ * m, routed to bulk DUMP reads
+ */
+string gdb_server::read_mem(const string &args)
+{
+	uint8_t *data;
+	uint32_t addr, len, i;
+	string r;
+
+	if (!parse_addr_len(args.c_str(), addr, len))
+		return "E01";
+
+	len = std::min<uint32_t>(len, gdb_packet_size / 2 - 8);
+	data = new uint8_t[len];
+
+	if (bdm->read_block(addr, data, len)) {
+		delete[] data;
+		return "E01";
+	}
+
+	r.reserve(len * 2);
+	for (i = 0; i < len; ++i) {
+		r.push_back(hex_digits[data[i] >> 4]);
+		r.push_back(hex_digits[data[i] & 0xf]);
+	}
+
+	delete[] data;
+
+	return r;
+}
+
+/*
+ * M (hex) and X (binary), both routed to the pod block writes.
+ */
+string gdb_server::write_mem(const string &args, bool binary)
+{
+	const char *p, *end;
+	uint32_t addr, len;
+	string data;
+
+	p = parse_addr_len(args.c_str(), addr, len);
+	if (!p || *p != ':')
+		return "E01";
+	p++;
+	end = args.c_str() + args.size();
+
+	data.reserve(len);
+
+	if (binary) {
+		for (; p < end; ++p) {
+			if (*p == 0x7d && p + 1 < end)
+				data.push_back(*++p ^ 0x20);
+			else
+				data.push_back(*p);
+		}
+	} else {
+		for (; p + 1 < end; p += 2)
+			data.push_back((hex_val(p[0]) << 4) | hex_val(p[1]));
+	}
+
+	if (data.size() != len)
+		return "E01";
+
+	if (len)
+		bdm->load_segment((uint8_t *)data.data(), addr, len);
+
+	return "OK";
+}
+
+/*
+ * Z1 on the pc breakpoint, Z2/Z3/Z4 on the address breakpoint, one
+ * of each is available. Z0 is not supported, gdb then writes its
+ * software breakpoints in memory and the pc breakpoint stays free
+ * for hbreak.
+ */
+string gdb_server::breakpoint(const string &args, bool insert)
+{
+	static const int wtypes[] = { wt_write, wt_read, wt_access };
+	uint32_t addr, len;
+	int type;
+
+	type = args[0] - '0';
+	if (args.size() < 3 || !parse_addr_len(args.c_str() + 2, addr, len))
+		return "E01";
+
+	switch (type) {
+	case 1:
+		if (!insert) {
+			if (bp_set && bp_addr == addr) {
+				bdm->clear_pc_breakpoint();
+				bp_set = false;
+			}
+			return "OK";
+		}
+		if (bp_set && bp_addr != addr)
+			return "E01";
+		bdm->set_pc_breakpoint(addr);
+		bp_addr = addr;
+		bp_set = true;
+		return "OK";
+	case 2:
+	case 3:
+	case 4:
+		if (!insert) {
+			if (wp_set && wp_addr == addr) {
+				bdm->clear_watchpoint();
+				wp_set = false;
+			}
+			return "OK";
+		}
+		if (wp_set && wp_addr != addr)
+			return "E01";
+		bdm->set_watchpoint(addr, len, wtypes[type - 2]);
+		wp_addr = addr;
+		wp_set = true;
+		return "OK";
+	default:
+		return "";
+	}
+}
+
+string gdb_server::query(const string &pkt)
+{
+	uint32_t offs, len;
+	const char *p;
+	string cmd;
+	size_t i;
+
+	if (pkt.compare(0, 11, "qSupported:") == 0 || pkt == "qSupported") {
+		char r[128];
+
+		snprintf(r, sizeof(r), "PacketSize=%x;QStartNoAckMode+;"
+			 "qXfer:features:read+;hwbreak+", gdb_packet_size);
+		return r;
+	}
+	if (pkt == "qAttached")
+		return "1";
+	if (pkt == "qSymbol::")
+		return "OK";
+
+	if (pkt.compare(0, 31, "qXfer:features:read:target.xml:") == 0) {
+		p = parse_addr_len(pkt.c_str() + 31, offs, len);
+		if (!p)
+			return "E01";
+		if (offs >= sizeof(target_xml) - 1)
+			return "l";
+		cmd = string(target_xml + offs,
+			     std::min<size_t>(len, sizeof(target_xml) - 1 - offs));
+		return ((offs + cmd.size() < sizeof(target_xml) - 1) ?
+			"m" : "l") + cmd;
+	}
+
+	/* monitor commands */
+	if (pkt.compare(0, 6, "qRcmd,") == 0) {
+		for (i = 6; i + 1 < pkt.size(); i += 2)
+			cmd.push_back((hex_val(pkt[i]) << 4) |
+				      hex_val(pkt[i + 1]));
+		if (cmd == "reset") {
+			bdm->reset(true);
+			bdm->reset(false);
+			return "OK";
+		}
+		if (cmd == "halt") {
+			bdm->halt();
+			return "OK";
+		}
+		return "";
+	}
+
+	return "";
+}
+
+string gdb_server::resume(const string &args, bool step)
+{
+	if (args.size())
+		bdm->write_ctrl_reg(crt_pc, strtoul(args.c_str(), NULL, 16));
+
+	if (step) {
+		bdm->step();
+		/* a watchpoint may fire on the stepped access */
+		bdm->poll_halted();
+		return stop_reply(SIGTRAP_GDB);
+	}
+
+	bdm->go();
+
+	if (bdm->wait_halted([this] { return interrupted(); })) {
+		bdm->halt();
+		return stop_reply(SIGINT_GDB);
+	}
+
+	return stop_reply(SIGTRAP_GDB);
+}
+
+/*
+ * Returns 1 when the session is over.
+ */
+int gdb_server::handle(const string &pkt)
+{
+	string args = pkt.substr(1);
+
+	switch (pkt[0]) {
+	case 0x03:
+		bdm->halt();
+		return put_packet(stop_reply(SIGINT_GDB));
+	case '?':
+		return put_packet(stop_reply(SIGTRAP_GDB));
+	case 'g':
+		return put_packet(read_regs());
+	case 'G':
+		return put_packet(write_regs(args));
+	case 'p':
+		return put_packet(read_reg(args));
+	case 'P':
+		return put_packet(write_reg(args));
+	case 'm':
+		return put_packet(read_mem(args));
+	case 'M':
+		return put_packet(write_mem(args, false));
+	case 'X':
+		return put_packet(write_mem(args, true));
+	case 'c':
+		return put_packet(resume(args, false));
+	case 's':
+		return put_packet(resume(args, true));
+	case 'Z':
+		return put_packet(breakpoint(args, true));
+	case 'z':
+		return put_packet(breakpoint(args, false));
+	case 'H':
+	case 'T':
+		return put_packet("OK");
+	case 'D':
+		bdm->clear_breakpoints();
+		bp_set = wp_set = false;
+		put_packet("OK");
+		bdm->go();
+		return 1;
+	case 'k':
+		return 1;
+	case 'Q':
+		if (pkt == "QStartNoAckMode") {
+			put_packet("OK");
+			no_ack = true;
+			return 0;
+		}
+		return put_packet("");
+	case 'q':
+		return put_packet(query(pkt));
+	default:
+		return put_packet("");
+	}
+}
+
+int gdb_server::serve_client()
+{
+	string pkt;
+	int rval;
+
+	no_ack = false;
+	rx_len = rx_pos = 0;
+
+	bdm->halt();
+
+	while (get_packet(pkt) == 0) {
+		rval = handle(pkt);
+		if (rval)
+			break;
+	}
+
+	return 0;
+}
+
+int gdb_server::run(const string &bind, int port)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0) {
+		log_err("cannot create socket");
+		return 1;
+	}
+
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+
+	if (inet_pton(AF_INET, bind.c_str(), &addr.sin_addr) != 1) {
+		log_err("invalid bind address %s", bind.c_str());
+		return 1;
+	}
+
+	if (::bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(lfd, 1)) {
+		log_err("cannot listen on %s:%d", bind.c_str(), port);
+		return 1;
+	}
+
+	for (;;) {
+		log_info("gdb server, waiting on %s:%d ...", bind.c_str(),
+			 port);
+
+		fd = accept(lfd, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		log_info("gdb connected");
+		serve_client();
+		log_info("gdb disconnected");
+
+		close(fd);
+		fd = -1;
+	}
+
+	return 0;
+}
@@ -21,6 +21,7 @@
 
 #include <iostream>
 #include <getopt.h>
+#include <cstdlib>
 
 #include "getopts.hh"
 #include "version.hh"
@@ -39,8 +40,39 @@ void getopts::usage()
 	     << "Usage: opencf [OPTION]\n"
 	     << "Example: ./opencf -v\n"
 	     << "Options:\n"
+	     << "  -a,  --attach      no reset, the core is left running or\n"
+	     << "                     halted as found\n"
+	     << "  -A,  --auto-speed  tune the bdm clock on attach, or\n"
+	     << "                     reuse the one cached for the pod,\n"
+	     << "                     pods with known dividers only\n"
+	     << "  -b,  --bind        listen address of the gdb and pod\n"
+	     << "                     servers (def. 127.0.0.1)\n"
+	     << "  -B,  --tftp-bind   listen address of the tftp server\n"
+	     << "                     (def. any)\n"
+	     << "  -c,  --command     run commands (';' separated) and exit\n"
+	     << "  -C,  --connect     run nonopts as a command on a daemon\n"
+	     << "  -d,  --daemon      keep the pod open, serve commands on\n"
+	     << "                     a unix socket\n"
+	     << "  -g,  --gdb-port    serve gdb remote protocol on port\n"
+	     << "  -G,  --gang        program and verify an elf on all the\n"
+	     << "                     connected pods\n"
 	     << "  -h,  --help        this help\n"
+	     << "  -i,  --iss         execute the code on the simulated\n"
+	     << "                     pod, coldfire isa_a/a+ interpreter\n"
+	     << "  -M,  --board-map   program RAMBAR and FLASHBAR for the\n"
+	     << "                     evaluation board of the part\n"
+	     << "  -m,  --sim         simulated pod,\n"
+	     << "                     latency_us[:KB/s[:min_div]]\n"
 	     << "  -p,  --path        server root path (def. /srv/tftp)\n"
+	     << "  -P,  --replay      play a capture back as the pod,\n"
+	     << "                     file[:speed], speed 0 is unpaced\n"
+	     << "  -r,  --remote      use the pod served at host:port\n"
+	     << "  -R,  --record      record the pod usb traffic to file\n"
+	     << "  -s,  --script      run a script file and exit\n"
+	     << "  -S,  --serve       share the pod over tcp on port\n"
+	     << "  -t,  --tftp        serve the root path by tftp on port\n"
+	     << "  -T,  --stats       collect timing stats, write them to\n"
+	     << "                     file on exit, json or prometheus\n"
 	     << "  -V,  --version     program version\n"
 	     << "  -v                 verbose\n"
 	     << "\n";
@@ -63,11 +95,30 @@ getopts::getopts(int argc, char **argv)
 			{"help", no_argument, 0, 'h'},
 			{"version", no_argument, 0, 'V'},
 			{"path", required_argument, 0, 'p'},
+			{"gdb-port", required_argument, 0, 'g'},
+			{"bind", required_argument, 0, 'b'},
+			{"daemon", required_argument, 0, 'd'},
+			{"connect", required_argument, 0, 'C'},
+			{"command", required_argument, 0, 'c'},
+			{"script", required_argument, 0, 's'},
+			{"gang", required_argument, 0, 'G'},
+			{"serve", required_argument, 0, 'S'},
+			{"remote", required_argument, 0, 'r'},
+			{"tftp", required_argument, 0, 't'},
+			{"tftp-bind", required_argument, 0, 'B'},
+			{"sim", required_argument, 0, 'm'},
+			{"iss", no_argument, 0, 'i'},
+			{"record", required_argument, 0, 'R'},
+			{"replay", required_argument, 0, 'P'},
+			{"stats", required_argument, 0, 'T'},
+			{"auto-speed", no_argument, 0, 'A'},
+			{"attach", no_argument, 0, 'a'},
+			{"board-map", no_argument, 0, 'M'},
 			{"", no_argument, 0, 'v'},
 			{0, 0, 0, 0}
 		};
 
-		c = getopt_long(argc, argv, "hvVp:",
+		c = getopt_long(argc, argv, "hvViaAMb:B:p:g:d:C:c:s:G:S:r:t:m:R:P:T:",
 				long_options, &option_index);
 
 		if (c == -1) {
@@ -95,6 +146,63 @@ getopts::getopts(int argc, char **argv)
 		case 'p':
 			opts::get().server_path = optarg;
 			break;
+		case 'g':
+			opts::get().gdb_port = atoi(optarg);
+			break;
+		case 'b':
+			opts::get().bind = optarg;
+			break;
+		case 'd':
+			opts::get().daemon_path = optarg;
+			break;
+		case 'C':
+			opts::get().connect_path = optarg;
+			break;
+		case 'c':
+			opts::get().commands = optarg;
+			break;
+		case 's':
+			opts::get().script_path = optarg;
+			break;
+		case 'G':
+			opts::get().gang_elf = optarg;
+			break;
+		case 'S':
+			opts::get().serve_port = atoi(optarg);
+			break;
+		case 'r':
+			opts::get().remote = optarg;
+			break;
+		case 't':
+			opts::get().tftp_port = atoi(optarg);
+			break;
+		case 'B':
+			opts::get().tftp_bind = optarg;
+			break;
+		case 'm':
+			opts::get().sim = optarg;
+			break;
+		case 'i':
+			opts::get().iss = true;
+			break;
+		case 'R':
+			opts::get().record = optarg;
+			break;
+		case 'P':
+			opts::get().replay = optarg;
+			break;
+		case 'T':
+			opts::get().stats_path = optarg;
+			break;
+		case 'A':
+			opts::get().auto_speed = true;
+			break;
+		case 'a':
+			opts::get().attach = true;
+			break;
+		case 'M':
+			opts::get().board_map = true;
+			break;
 		default:
 			exit(-2);
 		}
@@ -0,0 +1,249 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "opencf.h"
+#include "driver-core.hh"
+#include "bdm.hh"
+#include "elf.hh"
+#include "trace.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <exception>
+
+using namespace trace;
+using namespace std::chrono;
+
+static_assert(OPENCF_NUM_REGS == CF_NUM_REGS, "register count mismatch");
+static_assert(OPENCF_LOG_ERR == ll_err && OPENCF_LOG_DBG == ll_dbg,
+	      "log level mismatch");
+
+/*
+ * Long lived pod handle.
+ */
+struct opencf_pod {
+	opencf_pod() : img(NULL) {}
+	~opencf_pod() { delete bdm; }
+
+	driver_core dc;
+	bdm_ops *bdm {};
+	elf img;
+};
+
+static void log_stderr(int level, const char *msg, void *ctx)
+{
+	fprintf(stderr, "opencf: %s\n", msg);
+}
+
+static bool log_set;
+
+/*
+ * Nothing may unwind into C callers, exceptions become an error.
+ */
+template <typename F>
+static int guard(const char *fn, F f)
+{
+	try {
+		return f();
+	} catch (const std::exception &e) {
+		log_err("%s: %s", fn, e.what());
+	} catch (...) {
+		log_err("%s: unknown exception", fn);
+	}
+
+	return 1;
+}
+
+static bool valid_size(int size)
+{
+	return size == 1 || size == 2 || size == 4;
+}
+
+void opencf_set_log(opencf_log_fn fn, void *ctx)
+{
+	set_sink(fn ? fn : log_stderr, ctx);
+	log_set = true;
+}
+
+int opencf_reset(opencf_pod *pod)
+{
+	return guard(__func__, [&] {
+		if (pod->bdm->reset_target() == 0xffffffff) {
+			log_err("no cpu answering on bdm");
+			return 1;
+		}
+
+		return 0;
+	});
+}
+
+opencf_pod *opencf_open(void)
+{
+	opencf_pod *pod = NULL;
+	driver *drv;
+
+	if (!log_set)
+		opencf_set_log(NULL, NULL);
+
+	try {
+		pod = new opencf_pod();
+
+		if (pod->dc.init())
+			goto exit_err;
+
+		drv = pod->dc.get_current_driver();
+		pod->bdm = new bdm_ops(drv);
+
+		if (drv->get_programmer_info() || opencf_reset(pod))
+			goto exit_err;
+
+		return pod;
+	} catch (const std::exception &e) {
+		log_err("%s: %s", __func__, e.what());
+	} catch (...) {
+		log_err("%s: unknown exception", __func__);
+	}
+
+exit_err:
+	delete pod;
+
+	return NULL;
+}
+
+void opencf_close(opencf_pod *pod)
+{
+	guard(__func__, [&] { delete pod; return 0; });
+}
+
+int opencf_go(opencf_pod *pod)
+{
+	return guard(__func__, [&] { pod->bdm->go(); return 0; });
+}
+
+int opencf_halt(opencf_pod *pod)
+{
+	return guard(__func__, [&] { pod->bdm->halt(); return 0; });
+}
+
+/*
+ * 0 when halted, 1 on timeout, a negative timeout waits forever.
+ */
+int opencf_wait_halted(opencf_pod *pod, int timeout_ms)
+{
+	return guard(__func__, [&] {
+		steady_clock::time_point end =
+			steady_clock::now() + milliseconds(timeout_ms);
+
+		return pod->bdm->wait_halted([&] {
+			return timeout_ms >= 0 && steady_clock::now() > end;
+		});
+	});
+}
+
+int opencf_read_mem(opencf_pod *pod, uint32_t addr, int size,
+		    uint32_t *value)
+{
+	if (!valid_size(size)) {
+		log_err("%s: invalid size %d", __func__, size);
+		return 1;
+	}
+
+	return guard(__func__, [&] {
+		mem_access acc = { addr, size, 0 };
+
+		if (pod->bdm->read_mem_batch(&acc, 1))
+			return 1;
+
+		*value = acc.value;
+
+		return 0;
+	});
+}
+
+int opencf_write_mem(opencf_pod *pod, uint32_t addr, int size,
+		     uint32_t value)
+{
+	if (!valid_size(size)) {
+		log_err("%s: invalid size %d", __func__, size);
+		return 1;
+	}
+
+	return guard(__func__, [&] {
+		bdm_xfer x;
+
+		pod->bdm->fill_mem_write(x, addr, size, value);
+
+		return pod->bdm->xfer_batch(&x, 1);
+	});
+}
+
+int opencf_read_block(opencf_pod *pod, uint32_t addr, void *buf,
+		      uint32_t size)
+{
+	return guard(__func__, [&] {
+		return pod->bdm->read_block(addr, (uint8_t *)buf, size) ? 1 : 0;
+	});
+}
+
+int opencf_write_block(opencf_pod *pod, uint32_t addr, const void *buf,
+		       uint32_t size)
+{
+	return guard(__func__, [&] {
+		/* big block writes don't touch the source */
+		return pod->bdm->load_segment((uint8_t *)buf, addr, size) ?
+		       1 : 0;
+	});
+}
+
+int opencf_read_regs(opencf_pod *pod, uint32_t *regs)
+{
+	return guard(__func__, [&] {
+		return pod->bdm->read_all_regs(regs) ? 1 : 0;
+	});
+}
+
+int opencf_write_reg(opencf_pod *pod, int reg, uint32_t value)
+{
+	static const cr_type ctrl[] = { crt_sr, crt_pc, crt_vbr };
+
+	if (reg < 0 || reg >= CF_NUM_REGS)
+		return 1;
+
+	return guard(__func__, [&] {
+		bdm_xfer x;
+
+		if (reg < CF_PS)
+			pod->bdm->fill_ad_write(x, reg, value);
+		else
+			pod->bdm->fill_ctrl_write(x, ctrl[reg - CF_PS], value);
+
+		return pod->bdm->xfer_batch(&x, 1);
+	});
+}
+
+int opencf_load_elf(opencf_pod *pod, const char *path)
+{
+	return guard(__func__, [&] {
+		if (pod->img.parse(path))
+			return 1;
+
+		return pod->img.program(pod->bdm) ? 1 : 0;
+	});
+}
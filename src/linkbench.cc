@@ -0,0 +1,244 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "linkbench.hh"
+#include "driver-pemu.hh"
+#include "trace.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+using namespace trace;
+using namespace std::chrono;
+
+static constexpr uint32_t LB_SCRATCH = 8192;
+/* bytes moved per block size, at most */
+static constexpr uint32_t LB_BW_BYTES = 32 * 1024;
+
+static const uint32_t block_sizes[] = {
+	4, 16, 64, 256, 1024, PEMU_MAX_BIG_BLOCK, 4096, LB_SCRATCH
+};
+
+static double kbs(uint64_t bytes, uint64_t ns)
+{
+	return ns ? bytes * 1e9 / 1024 / ns : 0;
+}
+
+template <typename F> void linkbench::time(histogram &h, int count, F fn)
+{
+	steady_clock::time_point start;
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		start = steady_clock::now();
+		fn(i);
+		h.record(duration_cast<nanoseconds>(steady_clock::now() -
+			 start).count());
+	}
+}
+
+void linkbench::latency(int iterations)
+{
+	time(lat["rdmreg"], iterations,
+	     [this](int) { bdm->read_dm_reg(BDM_REG_CSR); });
+	time(lat["rcreg"], iterations,
+	     [this](int) { bdm->read_ctrl_reg(crt_pc); });
+	time(lat["read_b"], iterations,
+	     [this](int) { bdm->read_mem_byte(base); });
+	time(lat["read_w"], iterations,
+	     [this](int) { bdm->read_mem_word(base); });
+	time(lat["read_l"], iterations,
+	     [this](int) { bdm->read_mem_long(base); });
+	time(lat["write_b"], iterations,
+	     [this](int i) { bdm->write_mem_byte(base, i); });
+	time(lat["write_w"], iterations,
+	     [this](int i) { bdm->write_mem_word(base, i); });
+	time(lat["write_l"], iterations,
+	     [this](int i) { bdm->write_mem_long(base, i); });
+}
+
+/*
+ * Each size is written reps times, then read back the same, the last
+ * write is checked against what is read.
+ */
+int linkbench::bandwidth(int iterations)
+{
+	vector<uint8_t> out(LB_SCRATCH), in(LB_SCRATCH);
+	uint32_t size, i;
+	int reps, err = 0;
+
+	for (uint32_t s : block_sizes) {
+		bw_result &r = bw[s];
+
+		size = s;
+		r.size = size;
+		reps = std::max<int>(3, std::min<uint32_t>(iterations,
+					LB_BW_BYTES / size));
+
+		for (i = 0; i < size; ++i)
+			out[i] = i * 7 + size;
+
+		time(r.wr, reps, [&](int) {
+			if (bdm->load_segment(out.data(), base, size))
+				err = 1;
+		});
+		time(r.rd, reps, [&](int) {
+			if (bdm->read_block(base, in.data(), size))
+				err = 1;
+		});
+
+		r.verified = memcmp(out.data(), in.data(), size) == 0;
+		if (!r.verified)
+			log_err("linkbench: %u bytes block readback differs",
+				size);
+	}
+
+	return err;
+}
+
+void linkbench::report()
+{
+	log_ansi(ANSI_BOLD, "  %-10s %8s %9s %9s %9s %9s %9s", "command",
+		 "count", "mean us", "p50 us", "p90 us", "p99 us", "max us");
+	for (auto &i : lat) {
+		histogram &h = i.second;
+
+		log_info("  %-10s %8llu %9.1f %9.1f %9.1f %9.1f %9.1f",
+			 i.first.c_str(), (unsigned long long)h.count.load(),
+			 h.sum_ns / 1000.0 / h.count, h.percentile(50) / 1000.0,
+			 h.percentile(90) / 1000.0, h.percentile(99) / 1000.0,
+			 h.max_ns / 1000.0);
+	}
+
+	log_ansi(ANSI_BOLD, "  %-10s %8s %12s %12s %8s", "block", "reps",
+		 "write KB/s", "read KB/s", "verify");
+	for (auto &i : bw) {
+		bw_result &r = i.second;
+
+		log_info("  %-10u %8llu %12.1f %12.1f %8s", r.size,
+			 (unsigned long long)r.wr.count.load(),
+			 kbs(r.size, r.wr.percentile(50)),
+			 kbs(r.size, r.rd.percentile(50)),
+			 r.verified ? "ok" : "FAIL");
+	}
+}
+
+int linkbench::write_json(const string &path, int iterations)
+{
+	const char *sep = "";
+	char date[32];
+	time_t now = ::time(NULL);
+	FILE *f;
+
+	f = fopen(path.c_str(), "w");
+	if (!f) {
+		log_err("cannot create %s", path.c_str());
+		return 1;
+	}
+
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+	fprintf(f, "{\n  \"date\": \"%s\",\n  \"iterations\": %d,\n"
+		"  \"scratch\": \"0x%08x\",\n  \"latency_us\": [", date,
+		iterations, base);
+
+	for (auto &i : lat) {
+		histogram &h = i.second;
+
+		fprintf(f, "%s\n    { \"cmd\": \"%s\", \"count\": %llu, "
+			"\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+			"\"p99\": %.3f, \"max\": %.3f }", sep, i.first.c_str(),
+			(unsigned long long)h.count.load(),
+			h.sum_ns / 1000.0 / h.count, h.percentile(50) / 1000.0,
+			h.percentile(90) / 1000.0, h.percentile(99) / 1000.0,
+			h.max_ns / 1000.0);
+		sep = ",";
+	}
+
+	fprintf(f, "\n  ],\n  \"bandwidth_kbs\": [");
+
+	sep = "";
+	for (auto &i : bw) {
+		bw_result &r = i.second;
+
+		fprintf(f, "%s\n    { \"size\": %u, \"reps\": %llu, "
+			"\"write\": %.1f, \"write_mean\": %.1f, "
+			"\"read\": %.1f, \"read_mean\": %.1f, "
+			"\"verified\": %s }", sep, r.size,
+			(unsigned long long)r.wr.count.load(),
+			kbs(r.size, r.wr.percentile(50)),
+			kbs(r.size * r.wr.count, r.wr.sum_ns),
+			kbs(r.size, r.rd.percentile(50)),
+			kbs(r.size * r.rd.count, r.rd.sum_ns),
+			r.verified ? "true" : "false");
+		sep = ",";
+	}
+
+	fprintf(f, "\n  ]\n}\n");
+	fclose(f);
+
+	log_info("report written to %s", path.c_str());
+
+	return 0;
+}
+
+/*
+ * The core must be halted, the scratch area is saved and restored.
+ */
+int linkbench::run(int iterations, const string &out)
+{
+	vector<uint8_t> saved(LB_SCRATCH);
+	uint32_t rambar;
+	int err;
+
+	if (iterations <= 0)
+		return 1;
+
+	rambar = bdm->read_ctrl_reg(crt_rambar);
+	if (!(rambar & 1)) {
+		log_err("linkbench: sram not enabled, rambar %08x", rambar);
+		return 1;
+	}
+
+	base = rambar & 0xffff0000;
+
+	log_info("linkbench: %d iterations, scratch %08x-%08x", iterations,
+		 base, base + LB_SCRATCH - 1);
+
+	if (bdm->read_block(base, saved.data(), LB_SCRATCH)) {
+		log_err("linkbench: can't save the scratch area");
+		return 1;
+	}
+
+	latency(iterations);
+	err = bandwidth(iterations);
+
+	if (bdm->load_segment(saved.data(), base, LB_SCRATCH)) {
+		log_err("linkbench: can't restore the scratch area");
+		err = 1;
+	}
+
+	report();
+
+	return write_json(out, iterations) || err;
+}
@@ -22,17 +22,40 @@
 #include "core.hh"
 #include "getopts.hh"
 #include "version.hh"
+#include "daemon.hh"
+#include "stats.hh"
 
 using namespace trace;
 
 int main(int argc, char **argv)
 {
 	getopts opts(argc, argv);
+	int rval;
+
+	if (opts::get().connect_path.size()) {
+		string line;
+
+		for (auto &s : opts::get().nonopts)
+			line += s + " ";
+
+		return daemon_server::client(opts::get().connect_path, line);
+	}
 
 	log_imp("opencf " version " starting", argv[0]);
 	log_info("starting driver core ...");
 
-	core c;
+	if (opts::get().stats_path.size())
+		stats::get().enable(true);
+
+	{
+		core c;
+
+		rval = c.run();
+	}
+
+	/* pod thread gone, all samples are in */
+	if (opts::get().stats_path.size())
+		stats::get().dump(opts::get().stats_path);
 
-	return c.run();
+	return rval;
 }
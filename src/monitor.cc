@@ -0,0 +1,214 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "monitor.hh"
+#include "trace.hh"
+#include "utils.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+using namespace trace;
+using namespace utils;
+using namespace std::chrono;
+
+static constexpr int csv_buff_size = 1 << 20;
+
+/*
+ * Types: b, w, l (as mem.x) or u8, u16, u32, i8, i16, i32, f32
+ */
+int monitor::parse_type(const string &type, int &size, int &t)
+{
+	static const struct {
+		const char *name;
+		int size;
+		int type;
+	} types[] = {
+		{ "b", 1, mt_unsigned }, { "w", 2, mt_unsigned },
+		{ "l", 4, mt_unsigned },
+		{ "u8", 1, mt_unsigned }, { "u16", 2, mt_unsigned },
+		{ "u32", 4, mt_unsigned },
+		{ "i8", 1, mt_signed }, { "i16", 2, mt_signed },
+		{ "i32", 4, mt_signed },
+		{ "f32", 4, mt_float },
+	};
+
+	for (auto &e : types) {
+		if (type == e.name) {
+			size = e.size;
+			t = e.type;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * addr|symbol[:type], symbol size is used when type is omitted.
+ */
+int monitor::add(const string &spec)
+{
+	string loc = spec, type;
+	mem_access a {};
+	int t = mt_unsigned;
+	size_t pos;
+
+	pos = spec.find(':');
+	if (pos != string::npos) {
+		loc = spec.substr(0, pos);
+		type = spec.substr(pos + 1);
+	}
+
+	if (loc.size() > 1 && loc[0] == '0' && loc[1] == 'x') {
+		a.addr = str_to_bin(loc);
+		a.size = 4;
+	} else if (isdigit(loc[0])) {
+		a.addr = str_to_bin(loc);
+		a.size = 4;
+	} else {
+		const elf_symbol *s = img ? img->find_symbol(loc) : NULL;
+
+		if (!s) {
+			log_err("symbol %s not found", loc.c_str());
+			return -1;
+		}
+		a.addr = s->addr;
+		a.size = (s->size == 1 || s->size == 2) ? s->size : 4;
+	}
+
+	if (type.size() && parse_type(type, a.size, t)) {
+		log_err("invalid type %s", type.c_str());
+		return -1;
+	}
+
+	vars.push_back({ loc, t });
+	acc.push_back(a);
+
+	return 0;
+}
+
+void monitor::write_sample(FILE *f, long long us)
+{
+	unsigned int i;
+
+	fprintf(f, "%lld", us);
+
+	for (i = 0; i < acc.size(); ++i) {
+		uint32_t v = acc[i].value;
+
+		switch (vars[i].type) {
+		case mt_signed:
+			if (acc[i].size == 1)
+				fprintf(f, ",%d", (int8_t)v);
+			else if (acc[i].size == 2)
+				fprintf(f, ",%d", (int16_t)v);
+			else
+				fprintf(f, ",%d", (int32_t)v);
+			break;
+		case mt_float: {
+			float fv;
+
+			memcpy(&fv, &v, sizeof(fv));
+			fprintf(f, ",%g", fv);
+			break;
+		}
+		default:
+			fprintf(f, ",%u", v);
+			break;
+		}
+	}
+	fputc('\n', f);
+}
+
+/*
+ * Sample all the variables at a fixed rate while the target runs,
+ * one batch per sample, timestamps are host side, microseconds
+ * from start.
+ */
+int monitor::run(int rate, const string &path, int seconds,
+		 const std::function<bool()> &cancel)
+{
+	steady_clock::time_point start, next, now;
+	nanoseconds period(1000000000LL / rate);
+	int samples = 0, overruns = 0, errors = 0;
+	double secs;
+	FILE *f;
+
+	if (!acc.size())
+		return -1;
+
+	f = fopen(path.c_str(), "w");
+	if (!f) {
+		log_err("cannot create %s", path.c_str());
+		return -1;
+	}
+
+	setvbuf(f, NULL, _IOFBF, csv_buff_size);
+
+	fprintf(f, "time_us");
+	for (auto &v : vars)
+		fprintf(f, ",%s", v.name.c_str());
+	fprintf(f, "\n");
+
+	start = steady_clock::now();
+	next = start;
+
+	for (;;) {
+		now = steady_clock::now();
+		if (seconds && now - start >= seconds * 1s)
+			break;
+		if (cancel && cancel())
+			break;
+
+		/* a failed read waits its period too, not to flood the pod */
+		if (bdm->read_mem_batch(acc.data(), acc.size())) {
+			errors++;
+		} else {
+			write_sample(f, duration_cast<microseconds>
+				     (now - start).count());
+			samples++;
+		}
+
+		next += period;
+		now = steady_clock::now();
+		if (next > now) {
+			std::this_thread::sleep_until(next);
+		} else {
+			overruns++;
+			next = now;
+		}
+	}
+
+	fclose(f);
+
+	secs = duration_cast<microseconds>(steady_clock::now() - start)
+		.count() / 1e6;
+
+	log_info("%d samples in %.2fs, %.1f samples/s sustained "
+		 "(%dHz requested), %d overruns, %d errors",
+		 samples, secs, secs ? samples / secs : 0, rate,
+		 overruns, errors);
+	log_info("written to %s", path.c_str());
+
+	return 0;
+}
@@ -22,16 +22,30 @@
 #include "utils.hh"
 #include "trace.hh"
 #include "elf.hh"
-
+#include "profiler.hh"
+#include "monitor.hh"
+#include "rtt.hh"
+#include "linkbench.hh"
+#include "parts.hh"
+#include "speed.hh"
+#include "stats.hh"
+#include "driver-core.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
+#include <fstream>
 #include <fcntl.h>
 #include <unistd.h>
+#include <poll.h>
 
 using namespace trace;
 using namespace utils;
 using namespace std;
+using namespace std::chrono;
 
 enum kstate {
 	kst_normal,
@@ -40,14 +54,68 @@ enum kstate {
 };
 
 static constexpr char special_regs[] = "pc, vbr, rambar, sp, sr";
+static constexpr char profile_out[] = "profile.folded";
+static constexpr char linkbench_out[] = "linkbench.json";
+
+/* batched read prints */
+enum {
+	pr_none,
+	pr_byte,
+	pr_word,
+	pr_long,
+};
+
+static const struct {
+	const char *name;
+	cr_type rd;
+	cr_type wr;
+} batch_regs[] = {
+	{ "pc", crt_pc, crt_pc },
+	{ "vbr", crt_vbr, crt_vbr },
+	{ "rambar", crt_rambar, crt_rambar },
+	{ "sp", crt_sp_r, crt_sp_w },
+	{ "sr", crt_sr, (cr_type)0 },
+};
 
 parser_help::parser_help()
 {
 	mcmd_help["exit"] = "exit application";
+	mcmd_help["finish"] = "run until current function returns,\n"
+		"    return address from .debug_frame, or from the stack\n"
+		"    at the function entry";
 	mcmd_help["go"] = "execute continuously";
 	mcmd_help["halt"] = "stop execution";
 	mcmd_help["help"] = "this help";
-	mcmd_help["load"] = "load elf executable";
+	mcmd_help["linkbench"] = "bdm link latency and bandwidth, core halted:\n"
+		"    linkbench [iterations] [--out file]\n"
+		"    def. 200 iterations, internal sram start is used as\n"
+		"    scratch and restored, report goes to ";
+	mcmd_help["linkbench"] += linkbench_out;
+	mcmd_help["load"] = "load elf executable:\n"
+		"    load file [--verify] [--force]\n"
+		"    verify reads the image back, differing chunks are\n"
+		"    written again, force loads segments overlapping\n"
+		"    on-chip memory";
+	mcmd_help["map"] = "memory map of the part found on attach";
+	mcmd_help["monitor"] = "sample variables while running, to csv:\n"
+		"    monitor var ... [--rate hz] [--out file] [--time s]\n"
+		"    var is addr|symbol[:type], type b, w, l, u8, u16, u32,\n"
+		"    i8, i16, i32, f32 (def. symbol size or l)\n"
+		"    defaults 100Hz, monitor.csv, until a key is pressed";
+	mcmd_help["n"] = "next alias, shorted";
+	mcmd_help["next"] = "step, stepping over subroutine calls";
+	mcmd_help["periph"] = "peripheral registers, one batch per block:\n"
+		"    periph                   list peripherals\n"
+		"    periph name              read and decode a block\n"
+		"    periph watch name [--rate hz]\n"
+		"                             re-read at rate (def. 4Hz)\n"
+		"    periph load file         descriptions, def. the\n"
+		"                             part one, when known";
+	mcmd_help["profile"] = "sample pc periodically, report hot spots:\n"
+		"    profile seconds [rate] [depth]\n"
+		"    rate in Hz (def. 100), depth is the number of a6 frames\n"
+		"    to unwind (def. 0), collapsed stacks go to ";
+	mcmd_help["profile"] += profile_out;
 	mcmd_help["quit"] = "exit alias, exit application";
 	mcmd_help["read"] = "read memory or register:\n"
 		"    read mem.b location    read one byte from memory\n"
@@ -57,8 +125,27 @@ parser_help::parser_help()
 		"    special registers: ";
 	mcmd_help["read"] += special_regs;
 	mcmd_help["regs"] = "dump cpu registers";
+	mcmd_help["rtt"] = "target log channels over bdm memory reads:\n"
+		"    rtt [symbol|addr] [--scan start size] [--out file]\n"
+		"    def. symbol _SEGGER_RTT, or a scan of internal sram,\n"
+		"    keys are sent to down channel 0, escape to exit";
+	mcmd_help["semihosting"] = "serve target semihosting requests on go:\n"
+		"    semihosting [on|off]";
+	mcmd_help["speed"] = "bdm clock divider of the pod:\n"
+		"    speed             current divider and supported ones\n"
+		"    speed div         set the divider, lower is faster\n"
+		"    speed auto [addr] probe from the slowest, keep the\n"
+		"                      fastest reliable one, scratch at addr\n"
+		"                      (def. sram start) is restored\n"
+		"    set and auto need a pod with known dividers, the sim,\n"
+		"    P&E pods keep their default clock";
 	mcmd_help["st"] = "step alias, shorted";
+	mcmd_help["stats"] = "session timing per bdm call and pod command:\n"
+		"    stats [on|off|reset]\n"
+		"    stats dump file    json if file ends by .json,\n"
+		"                       prometheus text otherwise";
 	mcmd_help["step"] = "step";
+	mcmd_help["symbols"] = "load symbols only from elf executable";
 	mcmd_help["write"] = "write memory or register:\n"
 		"    write mem.b location val    write one byte to memory\n"
 		"    write mem.w location val    write two bytes to memory\n"
@@ -68,34 +155,42 @@ parser_help::parser_help()
 	mcmd_help["write"] += special_regs;
 }
 
-parser::parser(bdm_ops *b): bdm(b)
+parser::parser(bdm_ops *b): bdm(b), img(b), sh(b)
 {
+	keys = isatty(STDIN_FILENO);
+
 	mcmd["exit"] = &parser::cmd_exit;
+	mcmd["finish"] = &parser::cmd_finish;
 	mcmd["go"] = &parser::cmd_go;
 	mcmd["halt"] = &parser::cmd_halt;
 	mcmd["help"] = &parser::cmd_help;
+	mcmd["linkbench"] = &parser::cmd_linkbench;
 	mcmd["load"] = &parser::cmd_load;
+	mcmd["map"] = &parser::cmd_map;
+	mcmd["monitor"] = &parser::cmd_monitor;
+	mcmd["n"] = &parser::cmd_next;
+	mcmd["next"] = &parser::cmd_next;
+	mcmd["periph"] = &parser::cmd_periph;
+	mcmd["profile"] = &parser::cmd_profile;
 	mcmd["quit"] = &parser::cmd_exit;
 	mcmd["read"] = &parser::cmd_read;
 	mcmd["regs"] = &parser::cmd_dump_cpu_regs;
+	mcmd["rtt"] = &parser::cmd_rtt;
+	mcmd["semihosting"] = &parser::cmd_semihosting;
+	mcmd["speed"] = &parser::cmd_speed;
 	mcmd["st"] = &parser::cmd_step;
+	mcmd["stats"] = &parser::cmd_stats;
 	mcmd["step"] = &parser::cmd_step;
+	mcmd["symbols"] = &parser::cmd_symbols;
 	mcmd["write"] = &parser::cmd_write;
 
-	tcgetattr(STDIN_FILENO, &oldt);
-
-	newt = oldt;
-	newt.c_lflag &= ~(ICANON);
-	newt.c_lflag &= ~(ECHO);
-
-	/* Disable canonical mode */
-	tcsetattr( STDIN_FILENO, TCSANOW, &newt);
 }
 
 parser::~parser()
 {
 	/* Back to old config */
-	tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+	if (interactive)
+		tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
 }
 
 int parser::cmd_help()
@@ -117,22 +212,261 @@ int parser::cmd_help()
 	return 0;
 }
 
+static volatile sig_atomic_t interrupted;
+
+static void on_sigint(int)
+{
+	interrupted = 1;
+}
+
+/*
+ * Load throughput bar, redrawn at most every 100ms.
+ */
+struct progress_bar {
+	progress_bar(uint32_t size) : total(size) {
+		start = last = steady_clock::now();
+	}
+
+	bool operator()(int size) {
+		steady_clock::time_point now = steady_clock::now();
+		uint32_t prev = done;
+
+		/* rewritten chunks are not counted again */
+		done = std::min(done + size, total);
+
+		if ((done == total && prev != total) ||
+		    now - last > milliseconds(100)) {
+			last = now;
+			draw(now);
+		}
+
+		return !interrupted;
+	}
+
+	void draw(steady_clock::time_point now) {
+		static constexpr int width = 40;
+		int fill = total ? (uint64_t)done * width / total : width;
+		double secs = duration<double>(now - start).count();
+
+		cout << "\r[" << string(fill, '#') << string(width - fill, ' ')
+		     << "] " << setw(3) << (total ? done * 100ull / total : 100)
+		     << "% " << fixed << setprecision(1)
+		     << (secs ? done / 1024.0 / secs : 0.0) << " KB/s "
+		     << defaultfloat << flush;
+	}
+
+	uint32_t total;
+	uint32_t done {};
+	steady_clock::time_point start, last;
+};
+
 int parser::cmd_load()
 {
-	char *edata;
-	elf e(bdm);
+	struct sigaction sa {}, old;
+	bool verify = false, force = false;
+	unsigned int i;
+	int err;
+
+	if (args.size() < 1)
+		return 1;
+
+	for (i = 1; i < args.size(); ++i) {
+		if (args[i] == "--verify")
+			verify = true;
+		else if (args[i] == "--force")
+			force = true;
+		else
+			return 1;
+	}
+
+	if (img.parse(args[0]) || img.check(bdm, force))
+		return 1;
 
-	edata = e.load_elf(args[0]);
-	if (!edata)
+	progress_bar bar(img.image_size());
+
+	/* ctrl-c aborts the load between chunks */
+	interrupted = 0;
+	sa.sa_handler = on_sigint;
+	sigaction(SIGINT, &sa, &old);
+
+	bdm->set_progress(std::ref(bar));
+	err = img.program(bdm, verify);
+	bdm->set_progress(nullptr);
+
+	sigaction(SIGINT, &old, NULL);
+	cout << "\n";
+
+	if (err) {
+		log_err(interrupted ? "load interrupted" : "load failed");
 		return 1;
+	}
 
 	return 0;
 }
 
+int parser::cmd_symbols()
+{
+	if (args.size() < 1)
+		return 1;
+
+	return img.load_symbols(args[0]) ? 1 : 0;
+}
+
+int parser::cmd_profile()
+{
+	int seconds, rate = 100, depth = 0;
+
+	if (args.size() < 1)
+		return 1;
+
+	seconds = str_to_bin(args[0]);
+	if (args.size() > 1)
+		rate = str_to_bin(args[1]);
+	if (args.size() > 2)
+		depth = str_to_bin(args[2]);
+
+	if (seconds <= 0 || rate <= 0)
+		return 1;
+
+	profiler p(bdm, &img);
+
+	log_info("profiling %ds at %dHz, press a key to stop ...",
+		 seconds, rate);
+
+	if (p.run(seconds, rate, depth, [this] { return key_hit(); }))
+		return 1;
+
+	p.report();
+
+	return p.write_folded(profile_out);
+}
+
+int parser::cmd_linkbench()
+{
+	string out = linkbench_out;
+	int iterations = 200;
+	unsigned int i;
+
+	for (i = 0; i < args.size(); ++i) {
+		if (args[i] == "--out" && i + 1 < args.size())
+			out = args[++i];
+		else
+			iterations = str_to_bin(args[i]);
+	}
+
+	linkbench lb(bdm);
+
+	return lb.run(iterations, out);
+}
+
+int parser::cmd_speed()
+{
+	speed_tuner st(bdm);
+
+	if (args.size() == 0) {
+		st.show();
+		return 0;
+	}
+
+	if (args[0] == "auto")
+		return st.tune(false, args.size() > 1 ?
+			       str_to_bin(args[1]) : 0);
+
+	return st.set(str_to_bin(args[0]));
+}
+
+int parser::cmd_map()
+{
+	static const char *types[] = { "sram", "external", "flash", "ipsbar" };
+	const cf_cpu *part = bdm->get_part();
+
+	if (!part) {
+		log_err("part not in the database");
+		return 1;
+	}
+
+	log_ansi(ANSI_BOLD, "%s", part->name);
+	for (auto &r : part->regions)
+		log_info("  %-10s %08x-%08x %-8s %d bit%s", r.name, r.base,
+			 r.base + r.size - 1, types[r.type], r.width * 8,
+			 r.cacheable ? ", cacheable" : "");
+
+	return 0;
+}
+
+/*
+ * With semihosting enabled go does not return until the core halts
+ * for other reasons, or a key is pressed, the core is then left
+ * running.
+ */
+int parser::wait_semihosting()
+{
+	log_info("running, semihosting on, press a key to detach ...");
+
+	for (;;) {
+		if (bdm->wait_halted([this] { return key_hit(); }))
+			return 0;
+
+		switch (sh.service()) {
+		case sh_resumed:
+			continue;
+		case sh_exit:
+			log_info("target exit, code %d", sh.exit_code());
+			return 0;
+		default:
+			log_info("halted, pc: %08x",
+				 bdm->read_ctrl_reg(crt_pc));
+			return 0;
+		}
+	}
+}
+
 int parser::cmd_go()
 {
 	bdm->go();
 
+	if (semihosting)
+		return wait_semihosting();
+
+	return 0;
+}
+
+int parser::cmd_semihosting()
+{
+	if (args.size() > 0) {
+		if (args[0] == "on")
+			semihosting = true;
+		else if (args[0] == "off")
+			semihosting = false;
+		else
+			return 1;
+	}
+
+	log_info("semihosting %s", semihosting ? "on" : "off");
+
+	return 0;
+}
+
+int parser::cmd_stats()
+{
+	if (args.size() == 0) {
+		if (!stats::enabled())
+			log_info("stats off, \"stats on\" to collect");
+		stats::get().report();
+		return 0;
+	}
+
+	if (args[0] == "on")
+		stats::get().enable(true);
+	else if (args[0] == "off")
+		stats::get().enable(false);
+	else if (args[0] == "reset")
+		stats::get().reset();
+	else if (args[0] == "dump" && args.size() > 1)
+		return stats::get().dump(args[1]);
+	else
+		return 1;
+
 	return 0;
 }
 
@@ -157,9 +491,175 @@ int parser::cmd_step()
 	return 0;
 }
 
+int parser::cmd_next()
+{
+	uint32_t rval;
+
+	rval = bdm->next([this] { return key_hit(); });
+
+	if (rval != 0xffffffff)
+		log_info("pc: %08x", rval);
+
+	return 0;
+}
+
+int parser::cmd_finish()
+{
+	uint32_t rval, ret;
+
+	if (bdm->get_state() == st_running) {
+		log_err("core running, halt first");
+		return 1;
+	}
+
+	if (img.return_address(bdm, bdm->read_ctrl_reg(crt_pc), ret))
+		return 1;
+
+	log_info("running to %08x, press a key to stop ...", ret);
+
+	rval = bdm->run_to(ret, [this] { return key_hit(); });
+
+	if (rval != 0xffffffff)
+		log_info("pc: %08x", rval);
+
+	return 0;
+}
+
+int parser::cmd_monitor()
+{
+	string out = "monitor.csv";
+	int rate = 100, seconds = 0;
+	unsigned int i;
+
+	monitor m(bdm, &img);
+
+	for (i = 0; i < args.size(); ++i) {
+		if (args[i] == "--rate" && i + 1 < args.size()) {
+			rate = str_to_bin(args[++i]);
+		} else if (args[i] == "--out" && i + 1 < args.size()) {
+			out = args[++i];
+		} else if (args[i] == "--time" && i + 1 < args.size()) {
+			seconds = str_to_bin(args[++i]);
+		} else if (m.add(args[i])) {
+			return 1;
+		}
+	}
+
+	if (rate <= 0)
+		return 1;
+
+	log_info("monitoring at %dHz, press a key to stop ...", rate);
+
+	return m.run(rate, out, seconds, [this] { return key_hit(); }) ? 1 : 0;
+}
+
+/*
+ * Descriptions of the part found on attach are loaded on first use,
+ * as pkgdatadir/<part>.periph, e.g. mcf5282.periph.
+ */
+int parser::cmd_periph()
+{
+	const periph_block *p;
+	const cf_cpu *part;
+	vector<uint32_t> values;
+	string file;
+	bool watch;
+	int rate = 4;
+
+	if (args.size() == 2 && args[0] == "load")
+		return periphs.load(args[1]) ? 1 : 0;
+
+	if (periphs.empty()) {
+		part = bdm->get_part();
+		if (!part) {
+			log_err("no descriptions, periph load file");
+			return 1;
+		}
+
+		file = part->name;
+		file = file.substr(0, file.find('/'));
+		transform(file.begin(), file.end(), file.begin(), ::tolower);
+		if (periphs.load(string(PKGDATADIR) + "/" + file + ".periph"))
+			return 1;
+	}
+
+	if (args.size() == 0) {
+		periphs.list();
+		return 0;
+	}
+
+	watch = args[0] == "watch";
+	if (watch) {
+		if (args.size() < 2)
+			return 1;
+		if (args.size() > 3 && args[2] == "--rate")
+			rate = str_to_bin(args[3]);
+		if (rate <= 0)
+			return 1;
+	}
+
+	p = periphs.find(args[watch]);
+	if (!p) {
+		log_err("peripheral %s not found", args[watch].c_str());
+		return 1;
+	}
+
+	if (watch)
+		return periphs.watch(bdm, *p, rate,
+				     [this] { return key_hit(); }) ? 1 : 0;
+
+	if (periphs.read(bdm, *p, values))
+		return 1;
+
+	periphs.show(*p, values, {});
+
+	return 0;
+}
+
+int parser::cmd_rtt()
+{
+	string where = rtt_symbol, out;
+	uint32_t start = 0, size = 0;
+	unsigned int i;
+	int rval;
+
+	for (i = 0; i < args.size(); ++i) {
+		if (args[i] == "--scan" && i + 2 < args.size()) {
+			start = str_to_bin(args[++i]);
+			size = str_to_bin(args[++i]);
+		} else if (args[i] == "--out" && i + 1 < args.size()) {
+			out = args[++i];
+		} else {
+			where = args[i];
+		}
+	}
+
+	rtt r(bdm, &img);
+
+	rval = size ? r.scan(start, size) : r.locate(where);
+	if (rval && !size) {
+		/* default, internal sram, 64KB */
+		start = bdm->read_ctrl_reg(crt_rambar) & 0xffff0000;
+		rval = r.scan(start, 0x10000);
+	}
+
+	if (rval) {
+		log_err("control block not found");
+		return 1;
+	}
+
+	return r.run(out, [this] { return poll_key(); }) ? 1 : 0;
+}
+
+/*
+ * The session returns through core::run, closing the pod and the
+ * capture, and writing stats.
+ */
 int parser::cmd_exit()
 {
-	exit(0);
+	quit = true;
+
+	return 0;
 }
 
 void parser::dump_set(stringstream &ss, int reg, char pre)
@@ -217,6 +717,12 @@ int parser::cmd_read()
 		return rval;
 
 	if (args[0] == "reg") {
+		/* registers are not ready on a running core */
+		if (bdm->get_state() == st_running && !bdm->poll_halted()) {
+			log_err("core running, halt first");
+			return 1;
+		}
+
 		if (args[1] == "rambar") {
 			rval = bdm->read_ctrl_reg(crt_rambar);
 		} else if (args[1] == "pc") {
@@ -305,6 +811,12 @@ int parser::cmd_write()
 		return 1;
 
 	if (args[0] == "reg") {
+		/* registers are not ready on a running core */
+		if (bdm->get_state() == st_running && !bdm->poll_halted()) {
+			log_err("core running, halt first");
+			return 1;
+		}
+
 		val = str_to_bin(args[2]);
 		if (args[1] == "rambar") {
 			rval = bdm->write_ctrl_reg(crt_rambar, val);
@@ -348,49 +860,301 @@ int parser::get_key_pressed()
 	return getchar();
 }
 
-void parser::process_line(string &line)
+/*
+ * Non blocking read of a key, -1 if none, or if stdin is not a
+ * terminal or belongs to the daemon. There, escape is returned when
+ * the command has to stop.
+ */
+int parser::poll_key()
 {
-	string cmd;
+	struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+
+	if (!keys)
+		return no_key_stop && no_key_stop() ? 27 : -1;
+
+	if (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN))
+		return get_key_pressed();
+
+	return -1;
+}
+
+/*
+ * Non blocking check for a key press, the key is consumed.
+ */
+bool parser::key_hit()
+{
+	return poll_key() != -1;
+}
+
+/*
+ * Split a line in commands on ';', comments are dropped.
+ */
+static void split_commands(const string &line, vector<string> &cmds)
+{
+	string l = line;
 	size_t pos;
 
+	pos = l.find('#');
+	if (pos != string::npos)
+		l.resize(pos);
+
+	while ((pos = l.find(';')) != string::npos) {
+		cmds.push_back(l.substr(0, pos));
+		l.erase(0, pos + 1);
+	}
+	cmds.push_back(l);
+}
+
+static void tokenize(const string &cmd, vector<string> &tokens)
+{
+	stringstream ss(cmd);
+	string t;
+
+	tokens.clear();
+	while (ss >> t)
+		tokens.push_back(t);
+}
+
+/*
+ * args must be already set.
+ */
+int parser::dispatch(const string &cmd)
+{
+	if (mcmd.find(cmd) == mcmd.end()) {
+		log_err("command not found");
+		return 1;
+	}
+
+	if ((this->*mcmd[cmd])()) {
+		log_err("invalid command");
+		return 1;
+	}
+
+	return 0;
+}
+
+int parser::process_line(string &line)
+{
+	vector<string> cmds;
+	string cmd;
+
 	/* Store last. */
 	last = line;
 
-	args.clear();
+	split_commands(line, cmds);
 
-	/* Check for comments */
+	for (auto &c : cmds) {
+		tokenize(c, args);
+		if (!args.size())
+			continue;
 
-	pos = line.find('#');
-	if (pos != (size_t)-1)
-		line.resize(pos);
+		cmd = args[0];
+		args.erase(args.begin());
 
-	if (!line.size()) {
-		printf("enter pressed\n");
+		if (dispatch(cmd))
+			return 1;
+		if (quit)
+			break;
+	}
+
+	return 0;
+}
+
+/*
+ * Plain register and memory accesses are compiled to bdm commands,
+ * returns -1 for anything else.
+ */
+int parser::compile(const script_cmd &c, bdm_xfer &x, int &print)
+{
+	static const char *mem[] = { "mem.b", "mem.w", "mem.l" };
+	static const int sizes[] = { 1, 2, 4 };
+	static const uint32_t max[] = { 0xff, 0xffff, 0xffffffff };
+	const vector<string> &a = c.args;
+	uint32_t val;
+	string s;
+	int i;
+
+	if (c.cmd == "write" && a.size() == 3) {
+		for (i = 0; i < 3; ++i) {
+			if (a[0] != mem[i])
+				continue;
+			s = a[2];
+			val = str_to_bin(s);
+			if (val > max[i])
+				return -1;
+			s = a[1];
+			bdm->fill_mem_write(x, str_to_bin(s), sizes[i], val);
+			print = pr_none;
+			return 0;
+		}
+		if (a[0] != "reg")
+			return -1;
+		for (auto &r : batch_regs) {
+			if (a[1] != r.name || !r.wr)
+				continue;
+			s = a[2];
+			bdm->fill_ctrl_write(x, r.wr, str_to_bin(s));
+			print = pr_none;
+			return 0;
+		}
+		return -1;
+	}
+
+	if (c.cmd == "read" && a.size() == 2) {
+		for (i = 0; i < 3; ++i) {
+			if (a[0] != mem[i])
+				continue;
+			s = a[1];
+			bdm->fill_mem_read(x, str_to_bin(s), sizes[i]);
+			print = pr_byte + i;
+			return 0;
+		}
+		if (a[0] != "reg")
+			return -1;
+		for (auto &r : batch_regs) {
+			if (a[1] != r.name)
+				continue;
+			bdm->fill_ctrl_read(x, r.rd);
+			print = pr_long;
+			return 0;
+		}
+		if (a[1].size() == 2 && a[1][1] >= '0' && a[1][1] <= '7') {
+			i = a[1][1] - '0';
+			if (tolower(a[1][0]) == 'a')
+				i += CF_A0;
+			else if (tolower(a[1][0]) != 'd')
+				return -1;
+			bdm->fill_ad_read(x, i);
+			print = pr_long;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+int parser::flush_batch(vector<bdm_xfer> &xfers, vector<int> &prints)
+{
+	uint32_t rval;
+	unsigned int i;
+	int err;
+
+	if (!xfers.size())
+		return 0;
+
+	err = bdm->xfer_batch(xfers.data(), xfers.size());
+	if (err) {
+		log_err(err == xr_refused ? "batch refused, core running ?" :
+			"batch transfer failed");
+		return 1;
 	}
 
-	/* TO DO, check for ; */
-	while (line.size()) {
-		pos = line.find(' ');
-		if (pos == string::npos) {
-			args.push_back(line);
+	for (i = 0; i < xfers.size(); ++i) {
+		rval = ntohl(*(uint32_t *)xfers[i].buff);
+
+		switch (prints[i]) {
+		case pr_byte:
+			printf("%02x\n", (rval >> 16) & 0xff);
+			break;
+		case pr_word:
+			printf("%04x\n", (rval >> 16) & 0xffff);
+			break;
+		case pr_long:
+			printf("%08x\n", rval);
 			break;
-		} else {
-			args.push_back(line.substr(0, pos));
-			line.erase(0, pos + 1);
 		}
 	}
 
-	cmd = args[0];
-	args.erase(args.begin());
+	xfers.clear();
+	prints.clear();
 
-	if (mcmd.find(cmd) == mcmd.end()) {
-		log_err("command not found");
-		return;
+	return 0;
+}
+
+/*
+ * The whole text is parsed and checked before anything is sent,
+ * runs of plain register/memory accesses go to the pod as one batch.
+ * Stops at the first failing command.
+ */
+int parser::run_batch(const string &text)
+{
+	vector<script_cmd> script;
+	vector<bdm_xfer> xfers;
+	vector<int> prints;
+	vector<string> cmds;
+	stringstream ss(text);
+	string line;
+	bdm_xfer x;
+	int n = 0, print;
+
+	while (getline(ss, line)) {
+		n++;
+		cmds.clear();
+		split_commands(line, cmds);
+		for (auto &c : cmds) {
+			script_cmd sc;
+
+			tokenize(c, sc.args);
+			if (!sc.args.size())
+				continue;
+			sc.cmd = sc.args[0];
+			sc.args.erase(sc.args.begin());
+			sc.line = n;
+
+			if (mcmd.find(sc.cmd) == mcmd.end()) {
+				log_err("line %d: command not found: %s",
+					n, sc.cmd.c_str());
+				return 1;
+			}
+			script.push_back(sc);
+		}
 	}
 
-	if ((this->*mcmd[cmd])()) {
-		log_err("invalid command");
+	for (auto &sc : script) {
+		if (compile(sc, x, print) == 0) {
+			xfers.push_back(x);
+			prints.push_back(print);
+			continue;
+		}
+
+		if (flush_batch(xfers, prints))
+			return 1;
+
+		args = sc.args;
+		if (dispatch(sc.cmd)) {
+			log_err("line %d: %s failed", sc.line, sc.cmd.c_str());
+			return 1;
+		}
+		if (quit)
+			return 0;
 	}
+
+	return flush_batch(xfers, prints);
+}
+
+int parser::run_script(const string &path)
+{
+	ifstream f(path);
+	stringstream ss;
+
+	if (!f) {
+		log_err("cannot open %s", path.c_str());
+		return 1;
+	}
+
+	ss << f.rdbuf();
+
+	return run_batch(ss.str());
+}
+
+/*
+ * Non interactive entry, for clients of the daemon.
+ */
+int parser::execute(const string &line)
+{
+	string l = line;
+
+	return process_line(l);
 }
 
 void parser::repeat_last_cmd()
@@ -502,7 +1266,17 @@ int parser::run()
 
 	log_info("starting parser ...");
 
-	for (;;) {
+	tcgetattr(STDIN_FILENO, &oldt);
+
+	newt = oldt;
+	newt.c_lflag &= ~(ICANON);
+	newt.c_lflag &= ~(ECHO);
+
+	/* Disable canonical mode */
+	tcsetattr( STDIN_FILENO, TCSANOW, &newt);
+	interactive = true;
+
+	while (!quit) {
 		prompt();
 		get_input_line(line);
 		if (line.size())
@@ -510,4 +1284,6 @@ int parser::run()
 		else
 			repeat_last_cmd();
 	}
+
+	return 0;
 }
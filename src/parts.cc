@@ -0,0 +1,180 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "parts.hh"
+#include "trace.hh"
+
+#include <arpa/inet.h>
+
+using namespace trace;
+
+/* invalidate, caches left disabled while loading */
+static constexpr uint32_t CACR_CINVA = 0x01000000;
+
+static const vector<cf_cpu> parts = {
+	{
+		0xcf20c000, 0x00000080, "MCF5282/5281/5280",
+		0x20000001, 0xf0000001, CACR_CINVA, 0, 0,
+		{
+			{ "sdram", 0x00000000, 0x01000000, rt_external,
+			  4, true },
+			{ "sram", 0x20000000, 0x00010000, rt_sram, 4,
+			  false },
+			{ "ipsbar", 0x40000000, 0x40000000, rt_ipsbar, 4,
+			  false },
+			{ "flash", 0xf0000000, 0x00080000, rt_flash, 4,
+			  true },
+			{ "ext flash", 0xffe00000, 0x00200000, rt_flash, 2,
+			  true },
+		},
+	},
+	{
+		0xcf206000, 0x00000080, "MCF5235/5275",
+		0x20000001, 0, CACR_CINVA, 0, 0,
+		{
+			{ "sdram", 0x00000000, 0x01000000, rt_external,
+			  4, true },
+			{ "sram", 0x20000000, 0x00010000, rt_sram, 4,
+			  false },
+			{ "ipsbar", 0x40000000, 0x40000000, rt_ipsbar, 4,
+			  false },
+			{ "ext flash", 0xffe00000, 0x00200000, rt_flash, 2,
+			  true },
+		},
+	},
+	{
+		0xcf206000, 0x00000070, "MCF52235/52233",
+		0x20000001, 0x00000001, 0, 0, 0,
+		{
+			{ "flash", 0x00000000, 0x00040000, rt_flash, 4,
+			  false },
+			{ "sram", 0x20000000, 0x00008000, rt_sram, 4,
+			  false },
+			{ "ipsbar", 0x40000000, 0x40000000, rt_ipsbar, 4,
+			  false },
+		},
+	},
+};
+
+const cf_cpu *find_part(uint32_t d0, uint32_t d1)
+{
+	for (auto &p : parts) {
+		if (((d0 ^ p.d0_rst) & CF_D0_PART_MASK) == 0 &&
+		    ((d1 ^ p.d1_rst) & CF_D1_PART_MASK) == 0)
+			return &p;
+	}
+
+	return NULL;
+}
+
+/*
+ * All the setup registers in one batch. The evaluation board bars are
+ * only written when asked for, otherwise the FLASHBAR of the target is
+ * kept, and so is its RAMBAR when valid, loads need sram.
+ */
+int cf_cpu::setup(bdm_ops *bdm, bool board) const
+{
+	struct {
+		cr_type reg;
+		uint32_t value;
+	} regs[] = {
+		{ crt_rambar, rambar },
+		{ crt_flashbar, flashbar },
+		{ crt_cacr, cacr },
+		{ crt_acr0, acr0 },
+		{ crt_acr1, acr1 },
+	};
+	vector<bdm_xfer> xfers;
+	bdm_xfer bars[2];
+
+	if (!board) {
+		bdm->fill_ctrl_read(bars[0], crt_rambar);
+		bdm->fill_ctrl_read(bars[1], crt_flashbar);
+
+		/* parts without flash have no FLASHBAR to read */
+		if (bdm->xfer_batch(bars, flashbar ? 2 : 1)) {
+			log_err("%s setup failed", name);
+			return 1;
+		}
+
+		if (ntohl(*(uint32_t *)bars[0].buff) & 1)
+			regs[0].value = 0;
+		if (flashbar)
+			log_dbg("flashbar %08x kept",
+				ntohl(*(uint32_t *)bars[1].buff));
+		regs[1].value = 0;
+	}
+
+	for (auto &r : regs) {
+		if (!r.value)
+			continue;
+
+		xfers.emplace_back();
+		bdm->fill_ctrl_write(xfers.back(), r.reg, r.value);
+	}
+
+	if (xfers.size() && bdm->xfer_batch(xfers.data(), xfers.size())) {
+		log_err("%s setup failed", name);
+		return 1;
+	}
+
+	return 0;
+}
+
+const cf_region *cf_cpu::region(uint32_t addr) const
+{
+	for (auto &r : regions) {
+		if (addr - r.base < r.size)
+			return &r;
+	}
+
+	return NULL;
+}
+
+const cf_region *cf_cpu::onchip_flash() const
+{
+	for (auto &r : regions) {
+		if (r.type == rt_flash && flashbar &&
+		    r.base == (flashbar & 0xffff0000))
+			return &r;
+	}
+
+	return NULL;
+}
+
+/*
+ * External regions are not set up by opencf, they are not offered.
+ */
+const cf_region *cf_cpu::fastest(uint32_t size) const
+{
+	const cf_region *best = NULL;
+
+	for (auto &r : regions) {
+		if (r.type != rt_sram || r.size < size)
+			continue;
+
+		if (!best || r.type < best->type ||
+		    (r.type == best->type && r.width > best->width))
+			best = &r;
+	}
+
+	return best;
+}
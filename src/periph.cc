@@ -0,0 +1,339 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "periph.hh"
+#include "trace.hh"
+#include "utils.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <arpa/inet.h>
+
+using namespace trace;
+using namespace std::chrono;
+
+static string lower(string s)
+{
+	std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+
+	return s;
+}
+
+/*
+ * Parsed in new tables, the loaded ones are replaced only if the
+ * whole file is valid.
+ */
+int periph_db::load(const string &path)
+{
+	std::ifstream in(path);
+	periph_db db;
+	string line, kw, name, a, b, flag;
+	const char *err = NULL;
+	int n = 0;
+
+	if (!in) {
+		log_err("can't open %s", path.c_str());
+		return -1;
+	}
+
+	while (!err && std::getline(in, line)) {
+		size_t pos = line.find('#');
+
+		n++;
+		if (pos != string::npos)
+			line.erase(pos);
+
+		std::istringstream ss(line);
+
+		kw.clear();
+		flag.clear();
+		ss >> kw;
+		if (kw.empty())
+			continue;
+
+		if (kw == "peripheral") {
+			periph_block p {};
+
+			if (!(ss >> name >> a)) {
+				err = "peripheral name base expected";
+				continue;
+			}
+
+			p.name = lower(name);
+			p.base = utils::str_to_bin(a);
+			p.reg = db.regs.size();
+			std::getline(ss >> std::ws, p.desc);
+
+			if (db.index.count(p.name)) {
+				err = "peripheral already defined";
+				continue;
+			}
+
+			db.index[p.name] = db.blocks.size();
+			db.blocks.push_back(p);
+		} else if (kw == "register") {
+			periph_reg r {};
+
+			if (db.blocks.empty()) {
+				err = "register out of a peripheral";
+				continue;
+			}
+			if (!(ss >> name >> a >> b)) {
+				err = "register name offset size expected";
+				continue;
+			}
+			ss >> flag;
+
+			r.name = name;
+			r.offset = utils::str_to_bin(a);
+			r.size = utils::str_to_bin(b);
+			r.noread = flag == "nr";
+			r.field = db.fields.size();
+
+			if (r.size != 1 && r.size != 2 && r.size != 4) {
+				err = "register size must be 1, 2 or 4";
+				continue;
+			}
+
+			db.regs.push_back(r);
+			db.blocks.back().regs++;
+		} else if (kw == "field") {
+			periph_field f {};
+			unsigned int msb, lsb;
+
+			if (db.blocks.empty() || !db.blocks.back().regs) {
+				err = "field out of a register";
+				continue;
+			}
+			if (!(ss >> name >> a)) {
+				err = "field name bits expected";
+				continue;
+			}
+
+			pos = a.find(':');
+			msb = utils::str_to_bin(a.substr(0, pos));
+			lsb = pos == string::npos ? msb :
+			      utils::str_to_bin(a.substr(pos + 1));
+
+			if (lsb > msb || msb >= db.regs.back().size * 8u) {
+				err = "field bits out of the register";
+				continue;
+			}
+
+			f.name = name;
+			f.msb = msb;
+			f.lsb = lsb;
+			db.fields.push_back(f);
+			db.regs.back().fields++;
+		} else {
+			err = "unknown item";
+		}
+	}
+
+	if (err) {
+		log_err("%s:%d: %s", path.c_str(), n, err);
+		return -1;
+	}
+
+	db.finish();
+	*this = std::move(db);
+
+	log_info("%s: %zu peripherals, %zu registers", path.c_str(),
+		 blocks.size(), regs.size());
+
+	return 0;
+}
+
+/*
+ * Registers by offset, a register right after one of the same size
+ * is read by a dump, so a block costs one read per run of same sized
+ * registers, all sent in one batch.
+ */
+void periph_db::finish()
+{
+	const periph_reg *prev;
+
+	for (auto &p : blocks) {
+		auto first = regs.begin() + p.reg;
+
+		std::stable_sort(first, first + p.regs,
+				 [](const periph_reg &a, const periph_reg &b) {
+			return a.offset < b.offset;
+		});
+
+		prev = NULL;
+		p.reads = 0;
+
+		for (auto it = first; it != first + p.regs; ++it) {
+			if (it->noread) {
+				prev = NULL;
+				continue;
+			}
+
+			it->dump = prev && prev->size == it->size &&
+				   prev->offset + prev->size == it->offset;
+			if (!it->dump)
+				p.reads++;
+			prev = &*it;
+		}
+	}
+}
+
+const periph_block *periph_db::find(const string &name) const
+{
+	auto it = index.find(lower(name));
+
+	return it == index.end() ? NULL : &blocks[it->second];
+}
+
+void periph_db::list() const
+{
+	for (auto &i : index) {
+		const periph_block &p = blocks[i.second];
+
+		log_info("  %-10s %08x %3u registers %3u reads  %s",
+			 p.name.c_str(), p.base, p.regs, p.reads,
+			 p.desc.c_str());
+	}
+}
+
+int periph_db::read(bdm_ops *bdm, const periph_block &p,
+		    vector<uint32_t> &values) const
+{
+	vector<bdm_xfer> xfers;
+	vector<uint32_t> which;
+	uint32_t i, rval;
+
+	for (i = 0; i < p.regs; ++i) {
+		const periph_reg &r = regs[p.reg + i];
+
+		if (r.noread)
+			continue;
+
+		xfers.emplace_back();
+		if (r.dump)
+			bdm->fill_mem_dump(xfers.back(), r.size);
+		else
+			bdm->fill_mem_read(xfers.back(), p.base + r.offset,
+					   r.size);
+		which.push_back(i);
+	}
+
+	values.assign(p.regs, 0);
+
+	if (xfers.size() && bdm->xfer_batch(xfers.data(), xfers.size()))
+		return -1;
+
+	for (i = 0; i < which.size(); ++i) {
+		int size = regs[p.reg + which[i]].size;
+
+		rval = ntohl(*(uint32_t *)xfers[i].buff);
+		if (size < 4)
+			rval = (rval >> 16) & ((1u << size * 8) - 1);
+		values[which[i]] = rval;
+	}
+
+	return 0;
+}
+
+void periph_db::show(const periph_block &p, const vector<uint32_t> &values,
+		     const vector<uint32_t> &prev) const
+{
+	uint32_t i, j, v;
+	char buff[64], hex[12];
+	string line;
+
+	log_ansi(ANSI_BOLD, "%s %08x %s", p.name.c_str(), p.base,
+		 p.desc.c_str());
+
+	for (i = 0; i < p.regs; ++i) {
+		const periph_reg &r = regs[p.reg + i];
+
+		if (r.noread) {
+			log_info("  %-10s %08x -", r.name.c_str(),
+				 p.base + r.offset);
+			continue;
+		}
+
+		/* fields aligned for all sizes */
+		snprintf(hex, sizeof(hex), "%0*x", r.size * 2, values[i]);
+		snprintf(buff, sizeof(buff), "  %-10s %08x %-*s",
+			 r.name.c_str(), p.base + r.offset, r.fields ? 8 : 0,
+			 hex);
+		line = buff;
+
+		for (j = 0; j < r.fields; ++j) {
+			const periph_field &f = fields[r.field + j];
+
+			v = (uint64_t)values[i] >> f.lsb &
+			    ((1ull << (f.msb - f.lsb + 1)) - 1);
+			snprintf(buff, sizeof(buff),
+				 f.msb == f.lsb ? " %s=%u" : " %s=0x%x",
+				 f.name.c_str(), v);
+			line += buff;
+		}
+
+		if (prev.size() && prev[i] != values[i])
+			log_ansi(ANSI_BOLD, "%s", line.c_str());
+		else
+			log_info("%s", line.c_str());
+	}
+}
+
+/*
+ * Whole block re-read at a fixed rate and redrawn, registers changed
+ * since the previous read are highlighted.
+ */
+int periph_db::watch(bdm_ops *bdm, const periph_block &p, int rate,
+		     const std::function<bool()> &cancel) const
+{
+	steady_clock::time_point next, now;
+	nanoseconds period(1000000000LL / rate);
+	vector<uint32_t> values, prev;
+	int reads = 0, errors = 0;
+
+	next = steady_clock::now();
+
+	while (!cancel || !cancel()) {
+		if (read(bdm, p, values)) {
+			errors++;
+		} else {
+			printf("\x1b[H\x1b[J");
+			show(p, values, prev);
+			log_info("%dHz, %d reads, %d errors, press a key to "
+				 "stop ...", rate, ++reads, errors);
+			prev.swap(values);
+		}
+
+		next += period;
+		now = steady_clock::now();
+		if (next > now)
+			std::this_thread::sleep_until(next);
+		else
+			next = now;
+	}
+
+	return 0;
+}
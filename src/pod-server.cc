@@ -0,0 +1,203 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "pod-server.hh"
+#include "trace.hh"
+
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+using namespace trace;
+
+pod_server::~pod_server()
+{
+	if (fd >= 0)
+		close(fd);
+	if (lfd >= 0)
+		close(lfd);
+}
+
+/*
+ * Batch of bdm commands, executed as one driver batch.
+ */
+int pod_server::xfer(vector<uint8_t> &req, vector<uint8_t> &rep)
+{
+	vector<bdm_xfer> xfers;
+	uint32_t pos = 0;
+	uint16_t len;
+	int i, err;
+
+	while (pos + 2 <= req.size()) {
+		len = ntohs(*(uint16_t *)&req[pos]);
+		pos += 2;
+
+		if (len > BDM_XFER_SIZE || pos + len > req.size())
+			return -1;
+
+		xfers.emplace_back();
+		memcpy(xfers.back().buff, &req[pos], len);
+		xfers.back().len = len;
+		pos += len;
+	}
+
+	err = drv->xfer_bdm_batch(xfers.data(), xfers.size());
+
+	rep.resize(xfers.size() * PP_REPLY_LEN);
+	for (i = 0; i < (int)xfers.size(); ++i)
+		memcpy(&rep[i * PP_REPLY_LEN], xfers[i].buff, PP_REPLY_LEN);
+
+	return err;
+}
+
+int pod_server::handle(pod_hdr &hdr, vector<uint8_t> &req,
+		       vector<uint8_t> &rep)
+{
+	uint32_t csr;
+
+	rep.clear();
+
+	switch (hdr.op) {
+	case PP_INFO:
+		return drv->get_programmer_info();
+	case PP_XFER:
+		return xfer(req, rep);
+	case PP_BLOCK:
+		if (req.size() < 4)
+			return -1;
+		return drv->send_big_block(&req[4],
+					   ntohl(*(uint32_t *)&req[0]),
+					   req.size() - 4);
+	case PP_RESET:
+		if (req.size() < 1)
+			return -1;
+		drv->send_reset(req[0]);
+		return 0;
+	case PP_GO:
+		drv->send_go();
+		csr = htonl(drv->get_go_csr());
+		rep.assign((uint8_t *)&csr, (uint8_t *)&csr + 4);
+		return 0;
+	case PP_HALT:
+		drv->send_halt();
+		return 0;
+	}
+
+	log_err("pod server: unknown op %d", hdr.op);
+
+	return -1;
+}
+
+/*
+ * Requests are executed in order, replies are collected and written
+ * only once no more requests are pending, so pipelined requests
+ * get their replies in a few segments.
+ */
+int pod_server::serve_client()
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	vector<uint8_t> req, rep, out;
+	pod_hdr hdr;
+
+	for (;;) {
+		if (pp_read(fd, &hdr, sizeof(hdr)))
+			return 0;
+
+		hdr.op = ntohs(hdr.op);
+		hdr.len = ntohl(hdr.len);
+
+		if (hdr.len > PP_MAX_PAYLOAD) {
+			log_err("pod server: bad request length");
+			return 1;
+		}
+
+		req.resize(hdr.len);
+		if (pp_read(fd, req.data(), hdr.len))
+			return 0;
+
+		hdr.status = htons(handle(hdr, req, rep));
+		hdr.op = htons(hdr.op);
+		hdr.len = htonl(rep.size());
+
+		out.insert(out.end(), (uint8_t *)&hdr,
+			   (uint8_t *)&hdr + sizeof(hdr));
+		out.insert(out.end(), rep.begin(), rep.end());
+
+		if (poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN))
+			continue;
+
+		if (pp_write(fd, out.data(), out.size()))
+			return 0;
+		out.clear();
+	}
+}
+
+int pod_server::run(const string &bind, int port)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0) {
+		log_err("cannot create socket");
+		return 1;
+	}
+
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+
+	if (inet_pton(AF_INET, bind.c_str(), &addr.sin_addr) != 1) {
+		log_err("invalid bind address %s", bind.c_str());
+		return 1;
+	}
+
+	if (::bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(lfd, 4)) {
+		log_err("cannot listen on %s:%d", bind.c_str(), port);
+		return 1;
+	}
+
+	for (;;) {
+		log_info("pod server, waiting on %s:%d ...", bind.c_str(),
+			 port);
+
+		fd = accept(lfd, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+		log_info("pod client connected");
+		serve_client();
+		log_info("pod client disconnected");
+
+		close(fd);
+		fd = -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "profile.hh"
+#include "trace.hh"
+#include "utils.hh"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <arpa/inet.h>
+
+using namespace trace;
+
+int target_profile::apply(bdm_ops *bdm) const
+{
+	vector<bdm_xfer> xfers;
+	driver *drv = bdm->get_driver();
+
+	if (rambar & 1) {
+		xfers.emplace_back();
+		bdm->fill_ctrl_write(xfers.back(), crt_rambar, rambar);
+	}
+	if (flashbar & 1) {
+		xfers.emplace_back();
+		bdm->fill_ctrl_write(xfers.back(), crt_flashbar, flashbar);
+	}
+
+	if (xfers.size() && bdm->xfer_batch(xfers.data(), xfers.size())) {
+		log_err("profile: setup failed");
+		return 1;
+	}
+
+	if (clock && drv->set_bdm_clock(clock, true))
+		log_wrn("profile: bdm clock /%d not set", clock);
+
+	log_dbg("profile: rambar %08x, flashbar %08x, clock /%d", rambar,
+		flashbar, clock);
+
+	return 0;
+}
+
+int target_profile::capture(bdm_ops *bdm)
+{
+	bdm_xfer xfers[2];
+
+	bdm->fill_ctrl_read(xfers[0], crt_rambar);
+	bdm->fill_ctrl_read(xfers[1], crt_flashbar);
+
+	if (bdm->xfer_batch(xfers, 2))
+		return 1;
+
+	rambar = ntohl(*(uint32_t *)xfers[0].buff);
+	flashbar = ntohl(*(uint32_t *)xfers[1].buff);
+	clock = bdm->get_driver()->get_bdm_clock();
+
+	return 0;
+}
+
+profile_cache::profile_cache() : path(utils::cache_path("profiles"))
+{
+}
+
+/*
+ * serial d0 d1 rambar flashbar clock cpu description
+ */
+vector<target_profile> profile_cache::read()
+{
+	vector<target_profile> profiles;
+	std::ifstream in(path);
+	string line;
+
+	while (std::getline(in, line)) {
+		std::istringstream ss(line);
+		target_profile p;
+
+		ss >> p.serial >> std::hex >> p.d0_rst >> p.d1_rst >>
+		      p.rambar >> p.flashbar >> std::dec >> p.clock;
+		if (!ss)
+			continue;
+
+		std::getline(ss >> std::ws, p.cpu);
+		profiles.push_back(p);
+	}
+
+	return profiles;
+}
+
+bool profile_cache::find(target_profile &p)
+{
+	if (path.empty())
+		return false;
+
+	for (auto &i : read()) {
+		if (i.serial == p.serial && i.d0_rst == p.d0_rst &&
+		    i.d1_rst == p.d1_rst) {
+			p = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void profile_cache::store(const target_profile &p)
+{
+	vector<target_profile> profiles;
+	char hex[40];
+
+	if (path.empty())
+		return;
+
+	profiles = read();
+	for (auto it = profiles.begin(); it != profiles.end(); ++it) {
+		if (it->serial == p.serial && it->d0_rst == p.d0_rst &&
+		    it->d1_rst == p.d1_rst) {
+			profiles.erase(it);
+			break;
+		}
+	}
+	profiles.push_back(p);
+
+	std::ofstream out(path);
+	for (auto &i : profiles) {
+		snprintf(hex, sizeof(hex), "%08x %08x %08x %08x", i.d0_rst,
+			 i.d1_rst, i.rambar, i.flashbar);
+		out << i.serial << " " << hex << " " << i.clock << " " <<
+		       i.cpu << "\n";
+	}
+
+	if (!out)
+		log_wrn("profile: can't write %s", path.c_str());
+}
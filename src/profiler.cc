@@ -0,0 +1,191 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "profiler.hh"
+#include "trace.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+using namespace trace;
+using namespace std::chrono;
+
+static constexpr int report_lines = 20;
+static constexpr int max_depth = 32;
+
+string profiler::symbolize(uint32_t addr)
+{
+	const elf_symbol *s = img ? img->find_function(addr) : NULL;
+	char unknown[16];
+
+	if (s)
+		return s->name;
+
+	snprintf(unknown, sizeof(unknown), "0x%08x", addr);
+
+	return unknown;
+}
+
+/*
+ * One sample: halt, read pc (and walk the a6 chain if depth is
+ * requested), resume. Frames are stored leaf first. A core found
+ * stopped is sampled as it is and left halted, false is returned.
+ */
+bool profiler::sample(int depth)
+{
+	bool running;
+	uint32_t fp;
+
+	frames.clear();
+
+	running = bdm->get_state() == st_running && !bdm->poll_halted();
+	if (running)
+		bdm->halt();
+
+	frames.push_back(bdm->read_ctrl_reg(crt_pc));
+
+	if (depth) {
+		fp = bdm->read_ad_reg(CF_FP);
+		while (depth-- && fp && !(fp & 1)) {
+			frames.push_back(bdm->read_mem_long(fp + 4));
+			fp = bdm->read_mem_long(fp);
+		}
+	}
+
+	if (running)
+		bdm->go();
+
+	return running;
+}
+
+int profiler::run(int seconds, int rate, int depth,
+		  const std::function<bool()> &cancel)
+{
+	steady_clock::time_point start, next, t0;
+	nanoseconds period(1000000000LL / rate);
+	string stack;
+	bool running;
+	int64_t ns;
+	int i;
+
+	depth = std::min(depth, max_depth);
+
+	start = steady_clock::now();
+	next = start;
+
+	while (steady_clock::now() - start < seconds * 1s) {
+		if (cancel && cancel())
+			break;
+
+		t0 = steady_clock::now();
+		running = sample(depth);
+		ns = duration_cast<nanoseconds>(steady_clock::now() - t0)
+			.count();
+
+		probe_ns += ns;
+		probe_max_ns = std::max(probe_max_ns, ns);
+		samples++;
+
+		functions[symbolize(frames[0])]++;
+
+		/* collapsed stacks are root first */
+		stack.clear();
+		for (i = frames.size() - 1; i >= 0; --i) {
+			stack += symbolize(frames[i]);
+			if (i)
+				stack += ';';
+		}
+		stacks[stack]++;
+
+		if (!running) {
+			log_wrn("core halted at %08x, profiling stopped",
+				frames[0]);
+			break;
+		}
+
+		next += period;
+		if (next > steady_clock::now())
+			std::this_thread::sleep_until(next);
+		else
+			next = steady_clock::now();
+	}
+
+	elapsed_ns = duration_cast<nanoseconds>(steady_clock::now() - start)
+		.count();
+
+	return samples ? 0 : -1;
+}
+
+void profiler::report()
+{
+	vector<std::pair<string, int>> sorted(functions.begin(),
+					      functions.end());
+	double mean_us, duty;
+	int i;
+
+	if (!samples) {
+		log_wrn("no samples");
+		return;
+	}
+
+	sort(sorted.begin(), sorted.end(),
+	     [](const auto &a, const auto &b) { return a.second > b.second; });
+
+	log_ansi(ANSI_BOLD, "  samples   %%      function");
+	for (i = 0; i < (int)sorted.size() && i < report_lines; ++i) {
+		log_info("  %-8d  %5.1f  %s", sorted[i].second,
+			 100.0 * sorted[i].second / samples,
+			 sorted[i].first.c_str());
+	}
+
+	mean_us = probe_ns / 1000.0 / samples;
+	duty = elapsed_ns ? 100.0 * probe_ns / elapsed_ns : 0;
+
+	log_info("%d samples in %.2fs, %.1f samples/s", samples,
+		 elapsed_ns / 1e9, samples / (elapsed_ns / 1e9));
+	log_info("probe effect: %.1fus/sample mean, %.1fus max, "
+		 "core halted %.2f%% of the time",
+		 mean_us, probe_max_ns / 1000.0, duty);
+}
+
+/*
+ * flamegraph.pl collapsed format, "root;...;leaf count"
+ */
+int profiler::write_folded(const string &path)
+{
+	FILE *f;
+
+	f = fopen(path.c_str(), "w");
+	if (!f) {
+		log_err("cannot create %s", path.c_str());
+		return -1;
+	}
+
+	for (auto &s : stacks)
+		fprintf(f, "%s %d\n", s.first.c_str(), s.second);
+
+	fclose(f);
+
+	log_info("collapsed stacks written to %s", path.c_str());
+
+	return 0;
+}
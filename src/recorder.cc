@@ -0,0 +1,170 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "recorder.hh"
+#include "trace.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <arpa/inet.h>
+
+using namespace trace;
+using namespace std::chrono;
+
+static constexpr int REC_FLUSH_MS = 10;
+
+int recorder::open(const string &file)
+{
+	out = fopen(file.c_str(), "wb");
+	if (!out) {
+		log_err("can't create capture %s", file.c_str());
+		return 1;
+	}
+
+	fwrite(REC_MAGIC, sizeof(REC_MAGIC), 1, out);
+
+	path = file;
+	last = steady_clock::now();
+	stop = false;
+	thr = std::thread(&recorder::writer, this);
+	on = true;
+
+	log_info("recording pod traffic to %s", path.c_str());
+
+	return 0;
+}
+
+/*
+ * Producer gone, drain and close.
+ */
+void recorder::close()
+{
+	if (!on)
+		return;
+
+	on = false;
+	stop = true;
+	thr.join();
+
+	if (pending) {
+		uint8_t rec[sizeof(rec_hdr) + 4];
+
+		drop_marker(rec);
+		fwrite(rec, sizeof(rec), 1, out);
+	}
+
+	fclose(out);
+	out = NULL;
+
+	log_info("recorded %llu frames to %s, %llu dropped",
+		 (unsigned long long)frames, path.c_str(),
+		 (unsigned long long)dropped);
+}
+
+void recorder::put(size_t pos, const void *data, size_t len)
+{
+	size_t ofs = pos % REC_RING_SIZE;
+	size_t first = std::min(len, REC_RING_SIZE - ofs);
+
+	memcpy(&ring[ofs], data, first);
+	memcpy(ring, (const uint8_t *)data + first, len - first);
+}
+
+/*
+ * Record of the frames lost so far, pending is reset.
+ */
+void recorder::drop_marker(uint8_t *rec)
+{
+	rec_hdr hdr {};
+	uint32_t count = htonl(pending);
+
+	hdr.size = htons(sizeof(count));
+	hdr.len = htons(sizeof(count));
+	hdr.dir = REC_DROP;
+
+	memcpy(rec, &hdr, sizeof(hdr));
+	memcpy(rec + sizeof(hdr), &count, sizeof(count));
+	pending = 0;
+}
+
+void recorder::frame(int dir, const uint8_t *data, int size)
+{
+	steady_clock::time_point now = steady_clock::now();
+	size_t h = head.load(std::memory_order_relaxed);
+	uint8_t marker[sizeof(rec_hdr) + 4];
+	size_t need;
+	rec_hdr hdr;
+	int len = size;
+
+	while (len && !data[len - 1])
+		len--;
+
+	need = sizeof(hdr) + len + (pending ? sizeof(marker) : 0);
+
+	if (REC_RING_SIZE - (h - tail.load(std::memory_order_acquire)) <
+	    need) {
+		dropped++;
+		pending++;
+		return;
+	}
+
+	if (pending) {
+		drop_marker(marker);
+		put(h, marker, sizeof(marker));
+		h += sizeof(marker);
+	}
+
+	hdr.delta_us = htonl(duration_cast<microseconds>(now - last).count());
+	hdr.size = htons(size);
+	hdr.len = htons(len);
+	hdr.dir = dir;
+	last = now;
+
+	put(h, &hdr, sizeof(hdr));
+	put(h + sizeof(hdr), data, len);
+
+	head.store(h + sizeof(hdr) + len, std::memory_order_release);
+	frames++;
+}
+
+void recorder::flush()
+{
+	size_t t = tail.load(std::memory_order_relaxed);
+	size_t h = head.load(std::memory_order_acquire);
+	size_t chunk;
+
+	while (t != h) {
+		chunk = std::min(h - t, REC_RING_SIZE - t % REC_RING_SIZE);
+		fwrite(&ring[t % REC_RING_SIZE], 1, chunk, out);
+		t += chunk;
+	}
+
+	tail.store(t, std::memory_order_release);
+}
+
+void recorder::writer()
+{
+	while (!stop) {
+		flush();
+		std::this_thread::sleep_for(milliseconds(REC_FLUSH_MS));
+	}
+
+	flush();
+}
@@ -0,0 +1,282 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "rtt.hh"
+#include "trace.hh"
+#include "utils.hh"
+
+#include <cstring>
+#include <unistd.h>
+
+using namespace trace;
+using namespace utils;
+
+static constexpr int min_poll_us = 500;
+static constexpr int max_poll_us = 50000;
+static constexpr int scan_chunk = 1024;
+static constexpr int key_escape = 27;
+
+static uint32_t be32(const uint8_t *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+uint32_t rtt::ring_addr(bool is_up, int ch)
+{
+	return cb + rtt_hdr_size +
+		(is_up ? ch : max_up + ch) * rtt_ring_size;
+}
+
+/*
+ * Symbol name or address of the control block.
+ */
+int rtt::locate(const string &where)
+{
+	const elf_symbol *s;
+	string w = where;
+
+	if (isdigit(w[0])) {
+		cb = str_to_bin(w);
+	} else {
+		s = img ? img->find_symbol(w) : NULL;
+		if (!s)
+			return -1;
+		cb = s->addr;
+	}
+
+	return read_rings();
+}
+
+/*
+ * Look for the control block id in target memory, the search
+ * is done with bulk reads, while the target runs.
+ */
+int rtt::scan(uint32_t start, uint32_t size)
+{
+	uint8_t buf[scan_chunk + sizeof(rtt_id)];
+	uint32_t offs, len;
+	int i;
+
+	log_info("scanning %08x-%08x for control block ...",
+		 start, start + size);
+
+	for (offs = 0; offs < size; offs += scan_chunk) {
+		len = std::min<uint32_t>(scan_chunk + sizeof(rtt_id),
+					 size - offs);
+		if (bdm->read_block(start + offs, buf, len))
+			return -1;
+
+		for (i = 0; i + (int)sizeof(rtt_id) <= (int)len; i += 4) {
+			if (memcmp(&buf[i], rtt_id, sizeof(rtt_id)) == 0) {
+				cb = start + offs + i;
+				return read_rings();
+			}
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * The whole control block is fetched with a single block read,
+ * indexes of all the rings included.
+ */
+int rtt::read_rings()
+{
+	uint8_t buf[rtt_hdr_size + rtt_ring_size * rtt_max_rings * 2];
+	uint8_t *p;
+	uint32_t i, size;
+
+	if (!max_up) {
+		if (bdm->read_block(cb, buf, rtt_hdr_size))
+			return -1;
+
+		if (memcmp(buf, rtt_id, sizeof(rtt_id)) != 0)
+			return -1;
+
+		max_up = be32(&buf[16]);
+		max_down = be32(&buf[20]);
+
+		if (max_up > rtt_max_rings || max_down > rtt_max_rings) {
+			log_err("invalid control block at %08x", cb);
+			max_up = 0;
+			return -1;
+		}
+
+		up.resize(max_up);
+		down.resize(max_down);
+	}
+
+	size = rtt_hdr_size + rtt_ring_size * (max_up + max_down);
+	if (bdm->read_block(cb, buf, size))
+		return -1;
+
+	p = &buf[rtt_hdr_size];
+	for (i = 0; i < max_up + max_down; ++i, p += rtt_ring_size) {
+		rtt_ring &r = (i < max_up) ? up[i] : down[i - max_up];
+
+		r.name = be32(&p[0]);
+		r.buffer = be32(&p[4]);
+		r.size = be32(&p[8]);
+		r.wr = be32(&p[12]);
+		r.rd = be32(&p[16]);
+		r.flags = be32(&p[20]);
+	}
+
+	return 0;
+}
+
+/*
+ * Drain an up ring, returns bytes read, fill is the percentage of
+ * the ring that was in use.
+ */
+int rtt::poll_up(int ch, FILE *log, int &fill)
+{
+	rtt_ring &r = up[ch];
+	uint8_t *data;
+	uint32_t count, first;
+
+	if (!r.size || r.wr == r.rd || r.wr >= r.size || r.rd >= r.size)
+		return 0;
+
+	count = (r.wr + r.size - r.rd) % r.size;
+	fill = count * 100 / r.size;
+
+	data = new uint8_t[count];
+
+	first = std::min(count, r.size - r.rd);
+	if (bdm->read_block(r.buffer + r.rd, data, first) ||
+	    (count > first &&
+	     bdm->read_block(r.buffer, data + first, count - first))) {
+		delete[] data;
+		return -1;
+	}
+
+	r.rd = (r.rd + count) % r.size;
+	bdm->write_mem_long(ring_addr(true, ch) + 0x10, r.rd);
+
+	if (ch)
+		printf("[%d] ", ch);
+	fwrite(data, 1, count, stdout);
+	fflush(stdout);
+
+	if (log) {
+		if (ch)
+			fprintf(log, "[%d] ", ch);
+		fwrite(data, 1, count, log);
+	}
+
+	delete[] data;
+
+	return count;
+}
+
+int rtt::write_down(int ch, const char *data, int size)
+{
+	uint32_t space, first;
+
+	if (ch >= (int)max_down)
+		return -1;
+
+	rtt_ring &r = down[ch];
+	if (!r.size)
+		return -1;
+
+	space = (r.rd + r.size - r.wr - 1) % r.size;
+	size = std::min<uint32_t>(size, space);
+	if (!size)
+		return 0;
+
+	first = std::min<uint32_t>(size, r.size - r.wr);
+	bdm->load_segment((uint8_t *)data, r.buffer + r.wr, first);
+	if (size > (int)first)
+		bdm->load_segment((uint8_t *)data + first, r.buffer,
+				  size - first);
+
+	r.wr = (r.wr + size) % r.size;
+	bdm->write_mem_long(ring_addr(false, ch) + 0x0c, r.wr);
+
+	return size;
+}
+
+/*
+ * Poll loop. The interval is halved when a ring is more than half
+ * full and doubled while nothing arrives. Keys go to down ring 0,
+ * escape ends the session.
+ */
+int rtt::run(const string &path, const std::function<int()> &get_key)
+{
+	int interval = max_poll_us, total, fill, rval, c;
+	uint32_t ch;
+	FILE *log = NULL;
+	char key;
+
+	if (!max_up)
+		return -1;
+
+	if (path.size()) {
+		log = fopen(path.c_str(), "w");
+		if (!log) {
+			log_err("cannot create %s", path.c_str());
+			return -1;
+		}
+	}
+
+	log_info("control block at %08x, %d up, %d down, "
+		 "escape to exit", cb, max_up, max_down);
+
+	for (;;) {
+		c = get_key();
+		if (c == key_escape)
+			break;
+		if (c >= 0 && max_down) {
+			key = c;
+			write_down(0, &key, 1);
+		}
+
+		if (read_rings()) {
+			log_err("cannot read control block");
+			break;
+		}
+
+		total = 0;
+		fill = 0;
+		for (ch = 0; ch < max_up; ++ch) {
+			int f = 0;
+
+			rval = poll_up(ch, log, f);
+			if (rval > 0)
+				total += rval;
+			fill = std::max(fill, f);
+		}
+
+		if (fill > 50)
+			interval = std::max(interval / 2, min_poll_us);
+		else if (!total)
+			interval = std::min(interval * 2, max_poll_us);
+
+		usleep(interval);
+	}
+
+	if (log)
+		fclose(log);
+
+	return 0;
+}
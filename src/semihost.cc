@@ -0,0 +1,365 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "semihost.hh"
+#include "trace.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+using namespace trace;
+
+static constexpr uint16_t OP_NOP = 0x4e71;
+static constexpr uint16_t OP_HALT = 0x4ac8;
+static constexpr uint32_t SH_SENTINEL = 0x4e7bf000;
+static constexpr int max_args = 4;
+static constexpr int io_chunk = 0x10000;
+static constexpr int max_path = 1024;
+
+/* gdb file-i/o open flags */
+enum gdb_open_flags {
+	GDB_O_WRONLY = 0x1,
+	GDB_O_RDWR = 0x2,
+	GDB_O_APPEND = 0x8,
+	GDB_O_CREAT = 0x200,
+	GDB_O_TRUNC = 0x400,
+	GDB_O_EXCL = 0x800,
+};
+
+static constexpr int GDB_ENAMETOOLONG = 91;
+static constexpr int GDB_EUNKNOWN = 9999;
+
+static uint32_t be32(const uint8_t *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+semihost::semihost(bdm_ops *b) : bdm(b)
+{
+	fds[0] = STDIN_FILENO;
+	fds[1] = STDOUT_FILENO;
+	fds[2] = STDERR_FILENO;
+}
+
+semihost::~semihost()
+{
+	for (auto &f : fds) {
+		if (f.first > 2)
+			close(f.second);
+	}
+}
+
+bool semihost::is_trap(uint32_t pc)
+{
+	uint8_t seq[8];
+
+	if (pc & 3)
+		return false;
+
+	if (bdm->read_block(pc - 4, seq, sizeof(seq)))
+		return false;
+
+	return (be32(seq) == (uint32_t)((OP_NOP << 16) | OP_HALT) &&
+		be32(&seq[4]) == SH_SENTINEL);
+}
+
+int semihost::host_fd(uint32_t fd)
+{
+	auto it = fds.find(fd);
+
+	return (it == fds.end()) ? -1 : it->second;
+}
+
+/*
+ * gdb file-i/o errno values match Linux, except these.
+ */
+uint32_t semihost::target_errno(int err)
+{
+	if (err == ENAMETOOLONG)
+		return GDB_ENAMETOOLONG;
+	if (err > 30)
+		return GDB_EUNKNOWN;
+
+	return err;
+}
+
+void semihost::ret(uint32_t args, uint32_t value, int err)
+{
+	bdm->write_mem_long(args, value);
+	bdm->write_mem_long(args + 4, err ? target_errno(err) : 0);
+}
+
+int semihost::do_open(uint32_t *arg, int &err)
+{
+	char path[max_path];
+	int flags = 0, fd;
+
+	if (arg[1] == 0 || arg[1] > max_path) {
+		err = ENAMETOOLONG;
+		return -1;
+	}
+
+	if (bdm->read_block(arg[0], (uint8_t *)path, arg[1])) {
+		err = EFAULT;
+		return -1;
+	}
+	path[arg[1] - 1] = 0;
+
+	if (arg[2] & GDB_O_RDWR)
+		flags = O_RDWR;
+	else if (arg[2] & GDB_O_WRONLY)
+		flags = O_WRONLY;
+	if (arg[2] & GDB_O_APPEND)
+		flags |= O_APPEND;
+	if (arg[2] & GDB_O_CREAT)
+		flags |= O_CREAT;
+	if (arg[2] & GDB_O_TRUNC)
+		flags |= O_TRUNC;
+	if (arg[2] & GDB_O_EXCL)
+		flags |= O_EXCL;
+
+	fd = open(path, flags, arg[3] & 0777);
+	if (fd < 0) {
+		err = errno;
+		return -1;
+	}
+
+	log_dbg("%s() %s, fd %d", __func__, path, next_fd);
+
+	fds[next_fd] = fd;
+
+	return next_fd++;
+}
+
+/*
+ * Host file to target memory, block writes.
+ */
+int semihost::do_read(uint32_t *arg, int &err)
+{
+	uint8_t *buf;
+	uint32_t done = 0, len;
+	int fd = host_fd(arg[0]), rd;
+
+	if (fd < 0) {
+		err = EBADF;
+		return -1;
+	}
+
+	buf = new uint8_t[io_chunk];
+
+	while (done < arg[2]) {
+		len = std::min<uint32_t>(io_chunk, arg[2] - done);
+
+		rd = read(fd, buf, len);
+		if (rd < 0) {
+			err = errno;
+			delete[] buf;
+			return -1;
+		}
+		if (rd)
+			bdm->load_segment(buf, arg[1] + done, rd);
+		done += rd;
+
+		/* eof, or a short read from stdin or a pipe */
+		if ((uint32_t)rd < len)
+			break;
+	}
+
+	delete[] buf;
+
+	return done;
+}
+
+/*
+ * Target memory to host file, block reads.
+ */
+int semihost::do_write(uint32_t *arg, int &err)
+{
+	uint8_t *buf;
+	uint32_t done = 0, len;
+	int fd = host_fd(arg[0]);
+
+	if (fd < 0) {
+		err = EBADF;
+		return -1;
+	}
+
+	buf = new uint8_t[io_chunk];
+
+	while (done < arg[2]) {
+		len = std::min<uint32_t>(io_chunk, arg[2] - done);
+
+		if (bdm->read_block(arg[1] + done, buf, len)) {
+			err = EFAULT;
+			break;
+		}
+		if (write(fd, buf, len) != (ssize_t)len) {
+			err = errno;
+			break;
+		}
+		done += len;
+	}
+
+	delete[] buf;
+
+	return (err && !done) ? -1 : (int)done;
+}
+
+int64_t semihost::do_lseek(uint32_t *arg, int &err)
+{
+	int fd = host_fd(arg[0]);
+	off_t rval;
+
+	if (fd < 0) {
+		err = EBADF;
+		return -1;
+	}
+
+	rval = lseek(fd, ((int64_t)arg[1] << 32) | arg[2], arg[3]);
+	if (rval < 0)
+		err = errno;
+
+	return rval;
+}
+
+/*
+ * struct gdb_timeval { uint32_t tv_sec; uint64_t tv_usec; }
+ */
+int semihost::do_gettimeofday(uint32_t *arg, int &err)
+{
+	struct timeval tv;
+	uint8_t out[12];
+
+	gettimeofday(&tv, NULL);
+
+	put_be32(&out[0], tv.tv_sec);
+	put_be32(&out[4], 0);
+	put_be32(&out[8], tv.tv_usec);
+
+	bdm->load_segment(out, arg[0], sizeof(out));
+
+	return 0;
+}
+
+int semihost::do_request(uint32_t nr, uint32_t args)
+{
+	uint8_t block[max_args * 4];
+	uint32_t arg[max_args];
+	int64_t rval = 0;
+	int err = 0, i, fd;
+
+	if (bdm->read_block(args, block, sizeof(block)))
+		return -1;
+
+	for (i = 0; i < max_args; ++i)
+		arg[i] = be32(&block[i * 4]);
+
+	switch (nr) {
+	case HOSTED_OPEN:
+		rval = do_open(arg, err);
+		break;
+	case HOSTED_CLOSE:
+		fd = host_fd(arg[0]);
+		if (fd < 0) {
+			err = EBADF;
+			rval = -1;
+		} else {
+			if (arg[0] > 2)
+				rval = close(fd);
+			fds.erase(arg[0]);
+		}
+		break;
+	case HOSTED_READ:
+		rval = do_read(arg, err);
+		break;
+	case HOSTED_WRITE:
+		rval = do_write(arg, err);
+		break;
+	case HOSTED_LSEEK:
+		rval = do_lseek(arg, err);
+		/* 64 bit result, hi, lo, errno */
+		bdm->write_mem_long(args, rval >> 32);
+		bdm->write_mem_long(args + 4, rval);
+		bdm->write_mem_long(args + 8, err ? target_errno(err) : 0);
+		return 0;
+	case HOSTED_GETTIMEOFDAY:
+		rval = do_gettimeofday(arg, err);
+		break;
+	case HOSTED_ISATTY:
+		fd = host_fd(arg[0]);
+		rval = (fd >= 0) ? isatty(fd) : 0;
+		break;
+	case HOSTED_INIT_SIM:
+		rval = 0;
+		break;
+	default:
+		log_wrn("semihosting request %d not supported", nr);
+		rval = -1;
+		err = ENOSYS;
+		break;
+	}
+
+	ret(args, rval, err);
+
+	return 0;
+}
+
+/*
+ * Called with the core halted. If the halt is a semihosting trap,
+ * the request is served and the core resumed.
+ */
+int semihost::service()
+{
+	uint32_t pc, nr, args;
+
+	pc = bdm->read_ctrl_reg(crt_pc);
+	if (!is_trap(pc))
+		return sh_none;
+
+	nr = bdm->read_ad_reg(CF_D0);
+	args = bdm->read_ad_reg(CF_D1);
+
+	log_dbg("%s() request %d, args %08x", __func__, nr, args);
+
+	if (nr == HOSTED_EXIT) {
+		code = args;
+		bdm->write_ctrl_reg(crt_pc, pc + 4);
+		return sh_exit;
+	}
+
+	do_request(nr, args);
+
+	bdm->write_ctrl_reg(crt_pc, pc + 4);
+	bdm->go();
+
+	return sh_resumed;
+}
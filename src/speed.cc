@@ -0,0 +1,283 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "speed.hh"
+#include "trace.hh"
+#include "utils.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <arpa/inet.h>
+
+using namespace trace;
+
+static constexpr int SPEED_PATTERNS = 6;
+
+/*
+ * Long i of a pattern: solid, checkerboard, walking one and zero,
+ * then pseudo random, different per round.
+ */
+static uint32_t pattern_long(int pattern, int round, int i)
+{
+	switch (pattern) {
+	case 0:
+		return 0;
+	case 1:
+		return 0xffffffff;
+	case 2:
+		return i & 1 ? 0xaaaaaaaa : 0x55555555;
+	case 3:
+		return 1u << (i & 31);
+	case 4:
+		return ~(1u << (i & 31));
+	default:
+		return (i + 1) * 0x9e3779b1 ^ (round << 16);
+	}
+}
+
+int speed_tuner::probe_sram(int pattern, int round)
+{
+	uint8_t out[SPEED_SCRATCH], in[SPEED_SCRATCH];
+	uint32_t value;
+	int i;
+
+	for (i = 0; i < SPEED_SCRATCH / 4; ++i)
+		*(uint32_t *)&out[i * 4] = htonl(pattern_long(pattern,
+							       round, i));
+
+	if (bdm->load_segment(out, base, SPEED_SCRATCH) ||
+	    bdm->read_block(base, in, SPEED_SCRATCH) ||
+	    memcmp(out, in, SPEED_SCRATCH))
+		return 1;
+
+	/* single accesses, other pod commands */
+	for (i = 0; i < 8; ++i) {
+		value = ~pattern_long(pattern, round, i);
+		bdm->write_mem_long(base + i * 4, value);
+		if (bdm->read_mem_long(base + i * 4) != value)
+			return 1;
+	}
+
+	return 0;
+}
+
+int speed_tuner::probe_regs(int pattern, int round)
+{
+	int reg;
+
+	for (reg = SPEED_REG_FIRST; reg <= SPEED_REG_LAST; ++reg)
+		bdm->write_ad_reg(reg, pattern_long(pattern, round, reg));
+
+	for (reg = SPEED_REG_FIRST; reg <= SPEED_REG_LAST; ++reg) {
+		if (bdm->read_ad_reg(reg) !=
+		    pattern_long(pattern, round, reg))
+			return 1;
+	}
+
+	return 0;
+}
+
+int speed_tuner::probe(int rounds)
+{
+	int round, pattern;
+
+	for (round = 0; round < rounds; ++round) {
+		for (pattern = 0; pattern < SPEED_PATTERNS; ++pattern) {
+			if (base ? probe_sram(pattern, round) :
+				   probe_regs(pattern, round))
+				return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * One "serial divider" line per pod.
+ */
+int speed_tuner::load_cache(const string &serial)
+{
+	std::ifstream in(utils::cache_path("speed"));
+	string s;
+	int div;
+
+	while (in >> s >> div) {
+		if (s == serial)
+			return div;
+	}
+
+	return 0;
+}
+
+void speed_tuner::store_cache(const string &serial, int div)
+{
+	string path = utils::cache_path("speed");
+	std::map<string, int> pods;
+	string s;
+	int d;
+
+	if (path.empty()) {
+		log_wrn("speed: no cache directory");
+		return;
+	}
+
+	std::ifstream in(path);
+	while (in >> s >> d)
+		pods[s] = d;
+	in.close();
+
+	pods[serial] = div;
+
+	std::ofstream out(path);
+	for (auto &i : pods)
+		out << i.first << " " << i.second << "\n";
+}
+
+void speed_tuner::show()
+{
+	vector<int> divs = drv->get_bdm_clocks();
+	string list;
+
+	if (divs.empty()) {
+		log_info("bdm clock: pod default, no known clock command");
+		return;
+	}
+
+	for (int div : divs)
+		list += " /" + std::to_string(div);
+
+	log_info("bdm clock /%d, dividers%s", drv->get_bdm_clock(),
+		 list.c_str());
+}
+
+int speed_tuner::set(int div)
+{
+	if (drv->get_bdm_clocks().empty()) {
+		log_err("speed: the pod has no known clock command");
+		return 1;
+	}
+
+	if (drv->set_bdm_clock(div, true)) {
+		log_err("speed: divider %d not supported", div);
+		return 1;
+	}
+
+	log_info("bdm clock /%d", div);
+
+	return 0;
+}
+
+/*
+ * The core must be halted, the scratch area, or registers, are saved
+ * and restored.
+ */
+int speed_tuner::tune(bool cached, uint32_t scratch)
+{
+	vector<int> divs = drv->get_bdm_clocks();
+	string serial = drv->get_serial();
+	uint8_t saved[SPEED_SCRATCH];
+	uint32_t regs[SPEED_REG_LAST + 1], rambar;
+	int i, best = -1, div = 0, reg, err = 0;
+	bool failed = false;
+
+	if (divs.empty()) {
+		log_wrn("speed: the pod has no known clock command, "
+			"keeping its default");
+		return 1;
+	}
+
+	std::sort(divs.begin(), divs.end());
+
+	base = scratch;
+	if (!base) {
+		rambar = bdm->read_ctrl_reg(crt_rambar);
+		if (rambar & 1)
+			base = rambar & 0xffff0000;
+	}
+
+	if (base) {
+		log_info("speed: probing on %08x-%08x", base,
+			 base + SPEED_SCRATCH - 1);
+		if (bdm->read_block(base, saved, SPEED_SCRATCH)) {
+			log_err("speed: can't save the scratch area");
+			return 1;
+		}
+	} else {
+		log_info("speed: no sram, probing on cpu registers");
+		for (reg = SPEED_REG_FIRST; reg <= SPEED_REG_LAST; ++reg)
+			regs[reg] = bdm->read_ad_reg(reg);
+	}
+
+	if (cached && serial.size()) {
+		div = load_cache(serial);
+		if (div && std::count(divs.begin(), divs.end(), div) &&
+		    !drv->set_bdm_clock(div, false) && !probe(1)) {
+			log_info("speed: cached divider for %s",
+				 serial.c_str());
+			goto restore;
+		}
+		if (div)
+			log_wrn("speed: cached /%d fails, tuning again", div);
+	}
+
+	for (i = divs.size() - 1; i >= 0; --i) {
+		if (drv->set_bdm_clock(divs[i], false) ||
+		    probe(SPEED_ROUNDS)) {
+			log_dbg("speed: /%d fails", divs[i]);
+			failed = true;
+			break;
+		}
+		log_dbg("speed: /%d passes", divs[i]);
+		best = i;
+	}
+
+	if (best < 0) {
+		log_err("speed: no reliable bdm clock");
+		err = 1;
+		best = divs.size() - 1;
+	} else if (failed && best < (int)divs.size() - 1) {
+		/* one step of margin */
+		best++;
+	}
+
+	div = divs[best];
+	if (!err && serial.size())
+		store_cache(serial, div);
+
+restore:
+	drv->set_bdm_clock(div, true);
+
+	if (base) {
+		if (bdm->load_segment(saved, base, SPEED_SCRATCH)) {
+			log_err("speed: can't restore the scratch area");
+			err = 1;
+		}
+	} else {
+		for (reg = SPEED_REG_FIRST; reg <= SPEED_REG_LAST; ++reg)
+			bdm->write_ad_reg(reg, regs[reg]);
+	}
+
+	log_info("bdm clock /%d", div);
+
+	return err;
+}
@@ -0,0 +1,260 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "stats.hh"
+#include "bdm-defs.hh"
+#include "trace.hh"
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace trace;
+
+static const map<int, const char *> bdm_cmd_names = {
+	{ CMD_BDMCF_CMD_NOP, "nop" },
+	{ CMD_BDMCF_GO, "go" },
+	{ CMD_BDMCF_RDMREG, "rdmreg" },
+	{ CMD_BDMCF_WDMREG, "wdmreg" },
+	{ CMD_BDMCF_RCREG, "rcreg" },
+	{ CMD_BDMCF_WCREG, "wcreg" },
+	{ CMD_BDMCF_RDAREG, "rdareg" },
+	{ CMD_BDMCF_WDAREG, "wdareg" },
+	{ CMD_BDMCF_RD_MEM_B, "read_b" },
+	{ CMD_BDMCF_RD_MEM_W, "read_w" },
+	{ CMD_BDMCF_RD_MEM_L, "read_l" },
+	{ CMD_BDMCF_WR_MEM_B, "write_b" },
+	{ CMD_BDMCF_WR_MEM_W, "write_w" },
+	{ CMD_BDMCF_WR_MEM_L, "write_l" },
+	{ CMD_BDMCF_DUMP_B, "dump_b" },
+	{ CMD_BDMCF_DUMP_W, "dump_w" },
+	{ CMD_BDMCF_DUMP_L, "dump_l" },
+	{ CMD_BDMCF_FILL_B, "fill_b" },
+	{ CMD_BDMCF_FILL_W, "fill_w" },
+	{ CMD_BDMCF_FILL_L, "fill_l" },
+};
+
+static inline int bucket(uint64_t v)
+{
+	int e;
+
+	if (v < (2u << HIST_SUB_BITS))
+		return v;
+
+	e = 63 - __builtin_clzll(v);
+
+	return ((e - HIST_SUB_BITS) << HIST_SUB_BITS) +
+		(v >> (e - HIST_SUB_BITS));
+}
+
+static inline uint64_t bucket_top(int i)
+{
+	int shift;
+
+	if (i < (2 << HIST_SUB_BITS))
+		return i;
+
+	shift = (i >> HIST_SUB_BITS) - 1;
+
+	return (((uint64_t)((i & ((1 << HIST_SUB_BITS) - 1)) |
+		(1 << HIST_SUB_BITS)) + 1) << shift) - 1;
+}
+
+void histogram::record(uint64_t ns, uint64_t size)
+{
+	uint64_t max = max_ns.load(std::memory_order_relaxed);
+
+	buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	sum_ns.fetch_add(ns, std::memory_order_relaxed);
+	if (size)
+		bytes.fetch_add(size, std::memory_order_relaxed);
+
+	while (ns > max && !max_ns.compare_exchange_weak(max, ns,
+			std::memory_order_relaxed))
+		;
+}
+
+uint64_t histogram::percentile(double p) const
+{
+	uint64_t total = count.load(), target, seen = 0;
+	int i;
+
+	if (!total)
+		return 0;
+
+	target = (uint64_t)(p / 100 * total + 0.5);
+	if (!target)
+		target = 1;
+
+	for (i = 0; i < HIST_BUCKETS; ++i) {
+		seen += buckets[i].load(std::memory_order_relaxed);
+		if (seen >= target)
+			return std::min(bucket_top(i), max_ns.load());
+	}
+
+	return max_ns;
+}
+
+void histogram::reset()
+{
+	for (auto &b : buckets)
+		b = 0;
+
+	count = 0;
+	sum_ns = 0;
+	max_ns = 0;
+	bytes = 0;
+}
+
+histogram &stats::hist(const string &name)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	return hists[name];
+}
+
+histogram &stats::bdm_cmd(uint16_t op)
+{
+	std::atomic<histogram *> &slot = cmds[op >> 4];
+	histogram *h = slot.load(std::memory_order_acquire);
+	char name[32];
+	auto it = bdm_cmd_names.find(op & 0xfff0);
+
+	if (h)
+		return *h;
+
+	if (it != bdm_cmd_names.end())
+		snprintf(name, sizeof(name), "pemu.bdm.%s", it->second);
+	else
+		snprintf(name, sizeof(name), "pemu.bdm.%04x", op & 0xfff0);
+
+	h = &hist(name);
+	slot.store(h, std::memory_order_release);
+
+	return *h;
+}
+
+void stats::reset()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	for (auto &h : hists)
+		h.second.reset();
+}
+
+void stats::report()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	double mean, secs;
+
+	log_ansi(ANSI_BOLD, "  %-24s %8s %9s %9s %9s %9s %9s %8s", "point",
+		 "count", "mean us", "p50 us", "p90 us", "p99 us", "max us",
+		 "KB/s");
+
+	for (auto &i : hists) {
+		histogram &h = i.second;
+
+		if (!h.count)
+			continue;
+
+		mean = h.sum_ns / 1000.0 / h.count;
+		secs = h.sum_ns / 1e9;
+
+		log_info("  %-24s %8llu %9.1f %9.1f %9.1f %9.1f %9.1f %8s",
+			 i.first.c_str(), (unsigned long long)h.count.load(),
+			 mean, h.percentile(50) / 1000.0,
+			 h.percentile(90) / 1000.0,
+			 h.percentile(99) / 1000.0, h.max_ns / 1000.0,
+			 h.bytes ? std::to_string((uint64_t)(h.bytes /
+			 1024.0 / secs)).c_str() : "-");
+	}
+}
+
+int stats::dump(const string &path)
+{
+	static const double quantiles[] = { 50, 90, 99, 99.9 };
+	std::lock_guard<std::mutex> lock(mtx);
+	bool json = path.size() > 5 &&
+		    path.compare(path.size() - 5, 5, ".json") == 0;
+	const char *sep = "";
+	FILE *f;
+
+	f = fopen(path.c_str(), "w");
+	if (!f) {
+		log_err("cannot create %s", path.c_str());
+		return 1;
+	}
+
+	if (json)
+		fprintf(f, "{\n  \"histograms\": [");
+	else
+		fprintf(f, "# TYPE opencf_latency_seconds summary\n");
+
+	for (auto &i : hists) {
+		histogram &h = i.second;
+
+		if (!h.count)
+			continue;
+
+		if (json) {
+			fprintf(f, "%s\n    { \"name\": \"%s\", \"count\": %llu"
+				", \"sum_ns\": %llu, \"max_ns\": %llu"
+				", \"bytes\": %llu", sep, i.first.c_str(),
+				(unsigned long long)h.count.load(),
+				(unsigned long long)h.sum_ns.load(),
+				(unsigned long long)h.max_ns.load(),
+				(unsigned long long)h.bytes.load());
+			for (double q : quantiles)
+				fprintf(f, ", \"p%g_ns\": %llu", q,
+					(unsigned long long)h.percentile(q));
+			fprintf(f, " }");
+			sep = ",";
+			continue;
+		}
+
+		for (double q : quantiles)
+			fprintf(f, "opencf_latency_seconds{point=\"%s\","
+				"quantile=\"%g\"} %.9f\n", i.first.c_str(),
+				q / 100, h.percentile(q) / 1e9);
+		fprintf(f, "opencf_latency_seconds_sum{point=\"%s\"} %.9f\n",
+			i.first.c_str(), h.sum_ns / 1e9);
+		fprintf(f, "opencf_latency_seconds_count{point=\"%s\"} %llu\n",
+			i.first.c_str(), (unsigned long long)h.count.load());
+	}
+
+	if (json) {
+		fprintf(f, "\n  ]\n}\n");
+	} else {
+		fprintf(f, "# TYPE opencf_bytes_total counter\n");
+		for (auto &i : hists) {
+			if (i.second.bytes)
+				fprintf(f, "opencf_bytes_total{point=\"%s\"} "
+					"%llu\n", i.first.c_str(),
+					(unsigned long long)
+					i.second.bytes.load());
+		}
+	}
+
+	fclose(f);
+
+	log_info("stats written to %s", path.c_str());
+
+	return 0;
+}
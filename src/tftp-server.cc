@@ -0,0 +1,384 @@
+/*
+ * opencf - a ColdFire CPU family programming tool
+ *
+ * Copyright 2023 Angelo Dureghello
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "tftp-server.hh"
+#include "trace.hh"
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+using namespace trace;
+using namespace std::chrono;
+
+enum tftp_opcodes {
+	TFTP_RRQ = 1,
+	TFTP_WRQ,
+	TFTP_DATA,
+	TFTP_ACK,
+	TFTP_ERROR,
+	TFTP_OACK,
+};
+
+enum tftp_errors {
+	TFTP_ENOTDEF,
+	TFTP_ENOTFOUND,
+	TFTP_EACCESS,
+	TFTP_ENOSPACE,
+	TFTP_EBADOP,
+	TFTP_EBADID,
+	TFTP_EEXISTS,
+	TFTP_ENOUSER,
+	TFTP_EOPTNEG,
+};
+
+static constexpr int poll_ms = 200;
+
+tftp_server::~tftp_server()
+{
+	stop();
+}
+
+void tftp_server::send_error(int fd, struct sockaddr_in *peer, int code,
+			     const char *msg)
+{
+	char pkt[512];
+	int len;
+
+	*(uint16_t *)&pkt[0] = htons(TFTP_ERROR);
+	*(uint16_t *)&pkt[2] = htons(code);
+	len = snprintf(&pkt[4], sizeof(pkt) - 4, "%s", msg) + 5;
+
+	sendto(fd, pkt, len, 0, (struct sockaddr *)peer,
+	       peer ? sizeof(*peer) : 0);
+}
+
+/*
+ * 0 on ack, 1 on timeout, -1 on error packets.
+ */
+int tftp_server::wait_ack(int fd, int timeout, uint16_t &block)
+{
+	struct pollfd pfd = { fd, POLLIN, 0 };
+	uint8_t pkt[516];
+	int len;
+
+	for (;;) {
+		if (poll(&pfd, 1, timeout * 1000) <= 0)
+			return 1;
+
+		len = recv(fd, pkt, sizeof(pkt), 0);
+		if (len < 4)
+			continue;
+
+		switch (ntohs(*(uint16_t *)pkt)) {
+		case TFTP_ACK:
+			block = ntohs(*(uint16_t *)&pkt[2]);
+			return 0;
+		case TFTP_ERROR:
+			return -1;
+		}
+	}
+}
+
+/*
+ * A window of blocks is sent, then the client acks the last one
+ * received in order, sending restarts from the next one. Block
+ * numbers roll over at 65535.
+ */
+int tftp_server::send_file(int fd, tftp_xfer &x, const uint8_t *data,
+			   size_t size)
+{
+	uint32_t blocks = size / x.blksize + 1;
+	uint32_t base = 1, next = 1, k;
+	struct iovec iov[2];
+	uint8_t hdr[4];
+	uint16_t ack, ofs;
+	size_t pos;
+	int retries = 0;
+
+	*(uint16_t *)&hdr[0] = htons(TFTP_DATA);
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = 4;
+
+	while (base <= blocks) {
+		if (quit)
+			return 1;
+
+		for (; next < base + x.window && next <= blocks; ++next) {
+			pos = (size_t)(next - 1) * x.blksize;
+
+			*(uint16_t *)&hdr[2] = htons(next);
+			iov[1].iov_base = (void *)(data + pos);
+			iov[1].iov_len = std::min<size_t>(x.blksize,
+							  size - pos);
+
+			if (writev(fd, iov, 2) < 0)
+				return 1;
+		}
+
+		switch (wait_ack(fd, x.timeout, ack)) {
+		case 0:
+			ofs = ack - (uint16_t)(base - 1);
+			k = base - 1 + ofs;
+			if (k < base - 1 || k >= next)
+				continue;
+			base = k + 1;
+			next = base;
+			retries = 0;
+			break;
+		case 1:
+			if (++retries > tftp_retries)
+				return 1;
+			next = base;
+			break;
+		default:
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int put_option(char *p, const char *name, int value)
+{
+	return sprintf(p, "%s", name) + 1 +
+		sprintf(p + strlen(name) + 1, "%d", value) + 1;
+}
+
+void tftp_server::transfer(tftp_xfer x)
+{
+	steady_clock::time_point t = steady_clock::now();
+	string path = root + "/" + x.file;
+	const uint8_t *data = NULL;
+	struct stat st;
+	char oack[128];
+	uint16_t ack;
+	int fd, ffd, len, retry, rval;
+	double secs;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		goto exit;
+
+	if (connect(fd, (struct sockaddr *)&x.peer, sizeof(x.peer)))
+		goto exit_close;
+
+	ffd = open(path.c_str(), O_RDONLY);
+	if (ffd < 0 || fstat(ffd, &st) || !S_ISREG(st.st_mode)) {
+		if (ffd >= 0)
+			close(ffd);
+		send_error(fd, NULL, TFTP_ENOTFOUND, "file not found");
+		goto exit_close;
+	}
+
+	if (st.st_size) {
+		data = (const uint8_t *)mmap(NULL, st.st_size, PROT_READ,
+					     MAP_PRIVATE, ffd, 0);
+		if (data == MAP_FAILED) {
+			close(ffd);
+			send_error(fd, NULL, TFTP_EACCESS, "cannot map file");
+			goto exit_close;
+		}
+		madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+	}
+	close(ffd);
+
+	if (x.options) {
+		*(uint16_t *)oack = htons(TFTP_OACK);
+		len = 2;
+		if (x.options & TFTP_OPT_BLKSIZE)
+			len += put_option(&oack[len], "blksize", x.blksize);
+		if (x.options & TFTP_OPT_WINDOWSIZE)
+			len += put_option(&oack[len], "windowsize", x.window);
+		if (x.options & TFTP_OPT_TSIZE)
+			len += put_option(&oack[len], "tsize", st.st_size);
+		if (x.options & TFTP_OPT_TIMEOUT)
+			len += put_option(&oack[len], "timeout", x.timeout);
+
+		for (retry = 0; retry <= tftp_retries; ++retry) {
+			send(fd, oack, len, 0);
+			rval = wait_ack(fd, x.timeout, ack);
+			if (rval != 1)
+				break;
+		}
+
+		if (rval || ack != 0)
+			goto exit_unmap;
+	}
+
+	if (send_file(fd, x, data, st.st_size)) {
+		log_wrn("tftp: %s transfer failed", x.file.c_str());
+		goto exit_unmap;
+	}
+
+	secs = duration<double>(steady_clock::now() - t).count();
+	log_info("tftp: %s sent to %s, %ld bytes, %.1f MB/s",
+		 x.file.c_str(), inet_ntoa(x.peer.sin_addr),
+		 (long)st.st_size, secs ? st.st_size / secs / 1e6 : 0.0);
+
+exit_unmap:
+	if (data)
+		munmap((void *)data, st.st_size);
+exit_close:
+	close(fd);
+exit:
+	active--;
+}
+
+/*
+ * Read request, options out of range are ignored as the rfcs ask.
+ */
+void tftp_server::request(const char *pkt, int len, struct sockaddr_in &peer)
+{
+	const char *p = pkt + 2, *end = pkt + len, *name, *value;
+	tftp_xfer x;
+	int v;
+
+	if (len < 4 || pkt[len - 1] != 0)
+		return;
+
+	if (ntohs(*(uint16_t *)pkt) != TFTP_RRQ) {
+		send_error(sfd, &peer, TFTP_EBADOP, "only reads supported");
+		return;
+	}
+
+	x.peer = peer;
+	x.file = p;
+	x.blksize = tftp_def_blksize;
+	x.window = 1;
+	x.timeout = 1;
+	x.options = 0;
+
+	while (x.file.size() && x.file[0] == '/')
+		x.file.erase(0, 1);
+
+	if (x.file.empty() || x.file.find("..") != string::npos) {
+		send_error(sfd, &peer, TFTP_EACCESS, "access violation");
+		return;
+	}
+
+	/* mode, netascii is sent as octet */
+	p += strlen(p) + 1;
+	if (p >= end)
+		return;
+	p += strlen(p) + 1;
+
+	while (p < end) {
+		name = p;
+		p += strlen(p) + 1;
+		if (p >= end)
+			break;
+		value = p;
+		p += strlen(p) + 1;
+		v = atoi(value);
+
+		if (!strcasecmp(name, "blksize") && v >= 8) {
+			x.blksize = std::min(v, tftp_max_blksize);
+			x.options |= TFTP_OPT_BLKSIZE;
+		} else if (!strcasecmp(name, "windowsize") && v >= 1 &&
+			   v <= 65535) {
+			x.window = v;
+			x.options |= TFTP_OPT_WINDOWSIZE;
+		} else if (!strcasecmp(name, "timeout") && v >= 1 &&
+			   v <= 255) {
+			x.timeout = v;
+			x.options |= TFTP_OPT_TIMEOUT;
+		} else if (!strcasecmp(name, "tsize")) {
+			x.options |= TFTP_OPT_TSIZE;
+		}
+	}
+
+	active++;
+	std::thread(&tftp_server::transfer, this, x).detach();
+}
+
+void tftp_server::serve()
+{
+	struct pollfd pfd = { sfd, POLLIN, 0 };
+	struct sockaddr_in peer;
+	socklen_t plen;
+	char pkt[1024];
+	int len;
+
+	while (!quit) {
+		if (poll(&pfd, 1, poll_ms) <= 0)
+			continue;
+
+		plen = sizeof(peer);
+		len = recvfrom(sfd, pkt, sizeof(pkt), 0,
+			       (struct sockaddr *)&peer, &plen);
+		if (len > 0)
+			request(pkt, len, peer);
+	}
+}
+
+int tftp_server::start(const string &bind, int port)
+{
+	struct sockaddr_in addr;
+
+	sfd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sfd < 0) {
+		log_err("cannot create socket");
+		return 1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+
+	if (inet_pton(AF_INET, bind.c_str(), &addr.sin_addr) != 1 ||
+	    ::bind(sfd, (struct sockaddr *)&addr, sizeof(addr))) {
+		log_err("tftp: cannot bind %s:%d", bind.c_str(), port);
+		close(sfd);
+		sfd = -1;
+		return 1;
+	}
+
+	log_info("tftp server on %s:%d, root %s", bind.c_str(), port,
+		 root.c_str());
+
+	th = std::thread(&tftp_server::serve, this);
+
+	return 0;
+}
+
+void tftp_server::stop()
+{
+	quit = true;
+
+	if (th.joinable())
+		th.join();
+
+	while (active)
+		usleep(10000);
+
+	if (sfd >= 0)
+		close(sfd);
+	sfd = -1;
+}
@@ -31,11 +31,34 @@ using namespace std;
 
 namespace trace {
 
+static log_sink sink;
+static void *sink_ctx;
+
+void set_sink(log_sink fn, void *ctx)
+{
+	sink = fn;
+	sink_ctx = ctx;
+}
+
+static void emit(int level, const char *color, const char *format,
+		 va_list args)
+{
+	char msg[512];
+
+	if (!sink) {
+		printf(color);
+		vprintf(format, args);
+		printf(ANSI_COLOR_RESET "\n");
+		return;
+	}
+
+	vsnprintf(msg, sizeof(msg), format, args);
+	sink(level, msg, sink_ctx);
+}
+
 void log(const char *color, const char *format, va_list args)
 {
-	printf(color);
-	vprintf(format, args);
-	printf(ANSI_COLOR_RESET "\n");
+	emit(ll_info, color, format, args);
 }
 
 void log_ansi(const char *code, const char *format, ...)
@@ -43,7 +66,7 @@ void log_ansi(const char *code, const char *format, ...)
 	va_list args;
 
 	va_start(args, format);
-	log(code, format, args);
+	emit(ll_info, code, format, args);
 	va_end(args);
 }
 
@@ -52,7 +75,7 @@ void log_info(const char *format, ...)
 	va_list args;
 
 	va_start(args, format);
-	log(ANSI_COLOR_YELLOW, format, args);
+	emit(ll_info, ANSI_COLOR_YELLOW, format, args);
 	va_end(args);
 }
 
@@ -61,7 +84,7 @@ void log_imp(const char *format, ...)
 	va_list args;
 
 	va_start(args, format);
-	log(ANSI_COLOR_IMPORTANT, format, args);
+	emit(ll_info, ANSI_COLOR_IMPORTANT, format, args);
 	va_end(args);
 }
 
@@ -70,7 +93,7 @@ void log_wrn(const char *format, ...)
 	va_list args;
 
 	va_start(args, format);
-	log(ANSI_COLOR_MAGENTA, format, args);
+	emit(ll_wrn, ANSI_COLOR_MAGENTA, format, args);
 	va_end(args);
 }
 
@@ -80,7 +103,7 @@ void log_dbg(const char *format, ...)
 
 	if (opts::get().verbose) {
 		va_start(args, format);
-		log(ANSI_COLOR_RESET, format, args);
+		emit(ll_dbg, ANSI_COLOR_RESET, format, args);
 		va_end(args);
 	}
 }
@@ -90,7 +113,7 @@ void log_err(const char *format, ...)
 	va_list args;
 
 	va_start(args, format);
-	log(ANSI_COLOR_RED, format, args);
+	emit(ll_err, ANSI_COLOR_RED, format, args);
 	va_end(args);
 }
 
@@ -20,8 +20,9 @@
 
 #include "utils.hh"
 
-#include <iomanip>
-#include <sstream>
+#include <cerrno>
+#include <cstdlib>
+#include <sys/stat.h>
 
 namespace utils {
 
@@ -38,18 +39,44 @@ uint32_t ntohl(uint32_t val)
 	       (val >> 24);
 }
 
-unsigned int str_to_bin(string &str)
+/*
+ * Hex with 0x prefix, decimal otherwise, 0 if not a number. Called
+ * per token of scripts and watch loops, no stream is set up.
+ */
+unsigned int str_to_bin(const string &str)
+{
+	const char *p = str.c_str();
+
+	if (p[0] == '0' && p[1] == 'x')
+		return strtoul(p + 2, NULL, 16);
+
+	return strtoul(p, NULL, 10);
+}
+
+/*
+ * File under $XDG_CACHE_HOME/opencf, or ~/.cache/opencf, the
+ * directories are created. Empty if there is no home.
+ */
+string cache_path(const string &name)
 {
-	stringstream ss;
-	unsigned int rval;
+	const char *env = getenv("XDG_CACHE_HOME");
+	string dir;
+
+	if (env && *env) {
+		dir = env;
+	} else {
+		env = getenv("HOME");
+		if (!env)
+			return "";
+		dir = string(env) + "/.cache";
+		mkdir(dir.c_str(), 0755);
+	}
 
-	ss << str;
-	if (str[0] == '0' && str[1] == 'x')
-		ss >> hex >> rval;
-	else
-		ss >> dec >> rval;
+	dir += "/opencf";
+	if (mkdir(dir.c_str(), 0755) && errno != EEXIST)
+		return "";
 
-	return rval;
+	return dir + "/" + name;
 }
 
 }